@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "blob_table.h"
+
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+
+#include <openssl/evp.h>
+
+bool BlobTable::Key::operator==(const Key& other) const
+{
+	return size == other.size && std::memcmp(digest.bytes, other.digest.bytes, sizeof(digest.bytes)) == 0;
+}
+
+size_t BlobTable::KeyHash::operator()(const Key& key) const
+{
+	// The digest is already well distributed.
+	uint64_t hash = 0;
+	std::memcpy(&hash, key.digest.bytes, sizeof(hash));
+	return hash ^ (uint64_t)key.size;
+}
+
+BlobTable::BlobTable()
+    : m_IsEnabled(false)
+    , m_VerifyDigests(false)
+    , m_Deduplicated(0)
+    , m_BytesSaved(0)
+    , m_Rejected(0)
+{
+}
+
+FileTable::Digest BlobTable::ComputeDigest(const char* data, const size_t& size)
+{
+	FileTable::Digest digest = {};
+	unsigned int digestSize = 0;
+	EVP_Digest(data, size, digest.bytes, &digestSize, EVP_md5(), nullptr);
+	return digest;
+}
+
+void BlobTable::Initialize(const bool enable, const bool verifyDigests)
+{
+	Clear();
+	m_IsEnabled = enable;
+	m_VerifyDigests = enable && verifyDigests;
+}
+
+bool BlobTable::GetKey(const FileTable& files, const size_t& row, Key& key)
+{
+	if (files.IsDeleted(row) || files.IsTranslated(row) || !files.HasDigest(row) || files.GetFileSize(row) < 0)
+	{
+		return false;
+	}
+
+	key.digest = files.GetDigestBytes(row);
+	key.size = files.GetFileSize(row);
+	return true;
+}
+
+bool BlobTable::Claim(const FileTable& files, const size_t& row, const std::string& cl)
+{
+	Key key;
+	if (!m_IsEnabled || !GetKey(files, row, key))
+	{
+		return false;
+	}
+
+	const int64_t clNumber = std::stoll(cl);
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto entryIt = m_Entries.find(key);
+	if (entryIt == m_Entries.end())
+	{
+		Entry entry = {};
+		entry.state = Claimed;
+		entry.ownerCL = clNumber;
+		m_Entries.insert({ key, entry });
+		return false;
+	}
+
+	Entry& entry = entryIt->second;
+	switch (entry.state)
+	{
+	case Written:
+		break;
+	case Claimed:
+		// Changelists can be scheduled out of order, and only an earlier
+		// CL is sure to be committed first. Rows of the same CL are
+		// committed in download order, so they all print.
+		if (entry.ownerCL >= clNumber)
+		{
+			entry.ownerCL = clNumber;
+			return false;
+		}
+		break;
+	case Rejected:
+		return false;
+	}
+
+	m_Deduplicated++;
+	m_BytesSaved += key.size;
+	return true;
+}
+
+bool BlobTable::Verify(const FileTable& files, const size_t& row)
+{
+	Key key;
+	if (!m_IsEnabled || !m_VerifyDigests || !GetKey(files, row, key))
+	{
+		return true;
+	}
+
+	const ContentBuffer& contents = files.GetContents(row);
+	const FileTable::Digest digest = ComputeDigest(contents.GetData(), contents.GetSize());
+	if ((int64_t)contents.GetSize() == key.size && std::memcmp(digest.bytes, key.digest.bytes, sizeof(digest.bytes)) == 0)
+	{
+		return true;
+	}
+
+	WARN("The contents of " << files.GetDepotFileRevision(row) << " do not match the digest " << files.GetDigest(row)
+	                        << " of the server, they will not be reused for other files");
+	m_Rejected++;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	Entry& entry = m_Entries[key];
+	entry.state = Rejected;
+	return false;
+}
+
+void BlobTable::SetBlob(const FileTable& files, const size_t& row, const git_oid& blob)
+{
+	Key key;
+	if (!m_IsEnabled || !GetKey(files, row, key))
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	Entry& entry = m_Entries[key];
+	if (entry.state != Rejected)
+	{
+		entry.state = Written;
+		entry.blob = blob;
+	}
+}
+
+bool BlobTable::GetBlob(const FileTable& files, const size_t& row, git_oid& blob)
+{
+	Key key;
+	if (!GetKey(files, row, key))
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto entryIt = m_Entries.find(key);
+	if (entryIt == m_Entries.end() || entryIt->second.state != Written)
+	{
+		return false;
+	}
+	blob = entryIt->second.blob;
+	return true;
+}
+
+void BlobTable::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Entries.clear();
+	m_Deduplicated = 0;
+	m_BytesSaved = 0;
+	m_Rejected = 0;
+}
+
+std::string BlobTable::GetStats()
+{
+	size_t entries = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		entries = m_Entries.size();
+	}
+
+	std::ostringstream stats;
+	stats << std::fixed << std::setprecision(2)
+	      << "Content deduplication: " << m_Deduplicated << " files not printed ("
+	      << m_BytesSaved / (1024.0 * 1024.0) << " MB), "
+	      << entries << " distinct contents, " << m_Rejected << " digest mismatches";
+	return stats.str();
+}
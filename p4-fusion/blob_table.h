@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+
+#include "common.h"
+#include "commands/file_table.h"
+#include "git2/oid.h"
+
+// Maps the contents of file revisions, identified by the digest and size
+// reported by the server, to the blobs written for them, so that content
+// seen before is committed again without being printed.
+//
+// The first changelist to schedule some content claims it and prints it.
+// Later changelists skip the print and pick up the blob once the claiming
+// changelist is committed, which happens first since commits are made in
+// CL order. Revisions whose printed contents are not what the digest was
+// computed on, like keyword expanded ones, never take part. Blobs belong to
+// a repository, so each repository being converted has its own table.
+class BlobTable
+{
+public:
+	struct Key
+	{
+		FileTable::Digest digest;
+		int64_t size;
+
+		bool operator==(const Key& other) const;
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const;
+	};
+
+private:
+	enum State
+	{
+		Claimed, // Being printed by the owning CL
+		Written,
+		Rejected, // The printed contents did not match the digest
+	};
+
+	struct Entry
+	{
+		State state;
+		int64_t ownerCL;
+		git_oid blob;
+	};
+
+	bool m_IsEnabled;
+	bool m_VerifyDigests;
+
+	std::mutex m_Mutex;
+	std::unordered_map<Key, Entry, KeyHash> m_Entries;
+
+	std::atomic<long long> m_Deduplicated;
+	std::atomic<long long> m_BytesSaved;
+	std::atomic<long long> m_Rejected;
+
+public:
+	BlobTable();
+
+	// The MD5 digest of the contents, as reported by the server.
+	static FileTable::Digest ComputeDigest(const char* data, const size_t& size);
+
+	void Initialize(const bool enable, const bool verifyDigests);
+	bool IsEnabled() const { return m_IsEnabled; }
+	bool IsVerifyingDigests() const { return m_VerifyDigests; }
+
+	// False for revisions which cannot be identified by their digest.
+	static bool GetKey(const FileTable& files, const size_t& row, Key& key);
+
+	// Returns true if an earlier CL committed or is printing the contents of
+	// the row, which then needs no print. Otherwise the row claims them.
+	bool Claim(const FileTable& files, const size_t& row, const std::string& cl);
+	// Checks the printed contents of the row against its digest, so that
+	// no other row is committed with them if they differ. Returns false then.
+	bool Verify(const FileTable& files, const size_t& row);
+	// Records the blob committed for the printed contents of the row.
+	void SetBlob(const FileTable& files, const size_t& row, const git_oid& blob);
+	// Returns false if the claiming CL did not end up with a usable blob.
+	bool GetBlob(const FileTable& files, const size_t& row, git_oid& blob);
+
+	void Clear();
+	std::string GetStats();
+};
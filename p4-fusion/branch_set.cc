@@ -6,49 +6,38 @@
  */
 #include "branch_set.h"
 #include <map>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 
 static const std::string EMPTY_STRING = "";
-static const std::array<std::string, 2> INVALID_BRANCH_PATH { EMPTY_STRING, EMPTY_STRING };
 
-std::vector<std::string> BranchedFileGroup::GetRelativeFileNames()
-{
-	std::vector<std::string> ret;
-	for (auto& fileData : files)
-	{
-		ret.push_back(fileData.GetRelativePath());
-	}
-	return ret;
-}
+const size_t BranchSet::ParallelParseMinFiles;
 
 ChangedFileGroups::ChangedFileGroups()
     : totalFileCount(0)
 {
 }
 
-ChangedFileGroups::ChangedFileGroups(std::vector<BranchedFileGroup>& groups, int totalFileCount)
-    : totalFileCount(totalFileCount)
+ChangedFileGroups::ChangedFileGroups(FileTable&& files, std::vector<BranchedFileGroup>& groups)
+    : files(std::move(files))
+    , totalFileCount(this->files.GetSize())
 {
 	branchedFileGroups = std::move(groups);
 }
 
 void ChangedFileGroups::Clear()
 {
-	for (auto& fileGroup : branchedFileGroups)
-	{
-		for (auto& file : fileGroup.files)
-		{
-			file.Clear();
-		}
-		fileGroup.files.clear();
-		fileGroup.sourceBranch.clear();
-		fileGroup.targetBranch.clear();
-	}
+	files.Clear();
+	branchedFileGroups.clear();
 	totalFileCount = 0;
 }
 
 Branch::Branch(const std::string& branch, const std::string& alias)
     : depotBranchPath(branch)
     , gitAlias(alias)
+    , depotBranchPathID(PathInterner::GetSingleton()->Intern(branch))
 {
 	if (depotBranchPath.empty())
 	{
@@ -60,19 +49,45 @@ Branch::Branch(const std::string& branch, const std::string& alias)
 	}
 }
 
-std::array<std::string, 2> Branch::SplitBranchPath(const std::string& relativeDepotPath) const
+PathInterner::ID Branch::SplitBranchPath(const PathInterner::ID& relativeDepotPath) const
 {
-	if (
-	    // The relative depot branch, to match this branch path, must start with the
-	    // branch path + "/".  The "StartsWith" is put at the end of the 'and' checks,
-	    // because it takes the longest.
-	    relativeDepotPath.size() > depotBranchPath.size()
-	    && relativeDepotPath[depotBranchPath.size()] == '/'
-	    && STDHelpers::StartsWith(relativeDepotPath, depotBranchPath))
+	// The relative depot path, to match this branch path, must be a file under the branch directory.
+	PathInterner* paths = PathInterner::GetSingleton();
+	if (paths->IsUnder(relativeDepotPath, depotBranchPathID))
+	{
+		return paths->Rebase(relativeDepotPath, depotBranchPathID);
+	}
+	return PathInterner::Root;
+}
+
+BranchTrie::BranchTrie(const std::vector<Branch>& branches)
+{
+	for (size_t i = 0; i < branches.size(); i++)
 	{
-		return { gitAlias, relativeDepotPath.substr(depotBranchPath.size() + 1) };
+		// A branch listed twice keeps its first alias.
+		m_branchIndices.insert({ branches[i].depotBranchPathID, i });
 	}
-	return { "", "" };
+}
+
+int BranchTrie::Find(const PathInterner::ID& relativeDepotPath) const
+{
+	if (m_branchIndices.empty())
+	{
+		return -1;
+	}
+
+	// Files are strictly under their branch directory, so start from the parent.
+	PathInterner* paths = PathInterner::GetSingleton();
+	for (PathInterner::ID current = relativeDepotPath; current != PathInterner::Root;)
+	{
+		current = paths->GetParent(current);
+		auto found = m_branchIndices.find(current);
+		if (found != m_branchIndices.end())
+		{
+			return found->second;
+		}
+	}
+	return -1;
 }
 
 Branch createBranchFromPath(const std::string& depotBranchPath)
@@ -108,11 +123,34 @@ std::vector<Branch> createBranchesFromPaths(const std::vector<std::string>& bran
 
 BranchSet::BranchSet(std::vector<std::string>& clientViewMapping, const std::string& baseDepotPath, const std::vector<std::string>& branches, const std::vector<StreamResult::MappingData>& mappings, const std::vector<StreamResult::MappingData>& exclusions, const bool includeBinaries)
     : m_branches(createBranchesFromPaths(branches))
+    , m_branchTrie(m_branches)
     , m_mappings(mappings)
     , m_exclusions(exclusions)
     , m_includeBinaries(includeBinaries)
 {
-	m_view.InsertTranslationMapping(clientViewMapping);
+	FileMap clientView;
+	clientView.InsertTranslationMapping(clientViewMapping);
+	m_view = clientView.CompileLeft();
+
+	// The earlier mappings take precedence, so they are added last.
+	// Only a literal path followed by "..." can be imported.
+	for (size_t i = m_mappings.size(); i-- > 0;)
+	{
+		const std::string& imported = m_mappings[i].stream2;
+		if (STDHelpers::EndsWith(imported, "...")
+		    && imported.find('*') == std::string::npos
+		    && imported.find("...") == imported.size() - 3
+		    && imported.find("%%") == std::string::npos)
+		{
+			m_imports.AddRule(m_mappings[i].stream2, PathFilter::Include);
+			m_importMappings.push_back(i);
+		}
+	}
+	for (auto const& v : m_exclusions)
+	{
+		m_exclusionFilter.AddRule(v.stream1, PathFilter::Include);
+	}
+
 	if (STDHelpers::EndsWith(baseDepotPath, "/..."))
 	{
 		// Keep the final '/'.
@@ -126,56 +164,69 @@ BranchSet::BranchSet(std::vector<std::string>& clientViewMapping, const std::str
 	{
 		m_basePath = baseDepotPath;
 	}
+	m_basePathID = PathInterner::GetSingleton()->Intern(m_basePath.substr(0, m_basePath.size() - 1));
 }
 
-std::array<std::string, 2> BranchSet::splitBranchPath(const std::string& relativeDepotPath) const
+const Branch* BranchSet::splitBranchPath(const PathInterner::ID& relativeDepotPath, PathInterner::ID& branchFilePath) const
 {
-	// Check if the relative depot path starts with any of the branches.
-	// This checks the branches in their stored order, which can mean that having a branch
-	// order like "//a/b/c" and "//a/b" will only work if the sub-branches are listed first.
-	// To do this properly, the stored branches should be scanned based on their length - longest
-	// first, but that's extra processing and code for a use case that is rare and has a manual
-	// work around (list branches in a specific order).
-	for (auto& branch : m_branches)
+	const int index = m_branchTrie.Find(relativeDepotPath);
+	if (index < 0)
 	{
-		auto split = branch.SplitBranchPath(relativeDepotPath);
-		if (!split[0].empty() && !split[1].empty())
-		{
-			return split;
-		}
+		branchFilePath = PathInterner::Root;
+		return nullptr;
 	}
-	return { "", "" };
+
+	const Branch& branch = m_branches[index];
+	branchFilePath = branch.SplitBranchPath(relativeDepotPath);
+	return &branch;
 }
 
-std::string BranchSet::stripBasePath(const std::string& depotPath) const
+PathInterner::ID BranchSet::stripBasePath(const PathInterner::ID& depotPath) const
 {
-	if (STDHelpers::StartsWith(depotPath, m_basePath))
+	PathInterner* paths = PathInterner::GetSingleton();
+	if (paths->IsUnder(depotPath, m_basePathID))
 	{
-		// strip off the leading '/', too.
-		return depotPath.substr(m_basePath.size());
+		return paths->Rebase(depotPath, m_basePathID);
 	}
-	return EMPTY_STRING;
+	return PathInterner::Root;
 }
 
 struct branchIntegrationMap
 {
 	std::vector<BranchedFileGroup> branchGroups;
+	std::vector<std::vector<size_t>> branchRows;
 	std::unordered_map<std::string, int> branchIndicies;
 	int fileCount = 0;
 
-	void addMerge(const std::string& sourceBranch, const std::string& targetBranch, const FileData& rev);
-	void addTarget(const std::string& targetBranch, const FileData& rev);
+	void addMerge(const std::string& sourceBranch, const std::string& targetBranch, const size_t& row);
+	void addTarget(const std::string& targetBranch, const size_t& row);
 
 	// note: not const, because it cleans out the branchGroups.
-	std::unique_ptr<ChangedFileGroups> createChangedFileGroups() { return std::unique_ptr<ChangedFileGroups>(new ChangedFileGroups(branchGroups, fileCount)); };
+	std::unique_ptr<ChangedFileGroups> createChangedFileGroups(FileTable&& files);
 };
 
-void branchIntegrationMap::addTarget(const std::string& targetBranch, const FileData& fileData)
+void branchIntegrationMap::addTarget(const std::string& targetBranch, const size_t& row)
 {
-	addMerge(EMPTY_STRING, targetBranch, fileData);
+	addMerge(EMPTY_STRING, targetBranch, row);
 }
 
-void branchIntegrationMap::addMerge(const std::string& sourceBranch, const std::string& targetBranch, const FileData& fileData)
+std::unique_ptr<ChangedFileGroups> branchIntegrationMap::createChangedFileGroups(FileTable&& files)
+{
+	// Lay the rows out group after group, so that each group is a span of the table.
+	std::vector<size_t> rows;
+	rows.reserve(fileCount);
+	for (size_t i = 0; i < branchGroups.size(); i++)
+	{
+		branchGroups[i].begin = rows.size();
+		rows.insert(rows.end(), branchRows[i].begin(), branchRows[i].end());
+		branchGroups[i].end = rows.size();
+	}
+	files.Reorder(rows);
+
+	return std::unique_ptr<ChangedFileGroups>(new ChangedFileGroups(std::move(files), branchGroups));
+}
+
+void branchIntegrationMap::addMerge(const std::string& sourceBranch, const std::string& targetBranch, const size_t& row)
 {
 	// Need to store this in the integration map, using "src/tgt" as the
 	// key.  Because stream names can't have a '/' in them, this creates a unique key.
@@ -191,144 +242,211 @@ void branchIntegrationMap::addMerge(const std::string& sourceBranch, const std::
 		bfg.sourceBranch = sourceBranch;
 		bfg.targetBranch = targetBranch;
 		bfg.hasSource = !sourceBranch.empty();
-		bfg.files.push_back(fileData);
+		branchRows.push_back({ row });
 	}
 	else
 	{
-		branchGroups.at(entry->second).files.push_back(fileData);
+		branchRows.at(entry->second).push_back(row);
 	}
 	fileCount++;
 }
 
-// Post condition: all returned FileData (e.g. filtered for git commit) have the relativePath set.
-std::unique_ptr<ChangedFileGroups> BranchSet::ParseAffectedFiles(const std::vector<FileData>& cl) const
+bool BranchSet::classifyFile(FileTable& cl, const size_t& row, ClassifiedFile& classified) const
 {
-	branchIntegrationMap branchMap;
-	for (auto& clFileData : cl)
+	PathInterner* paths = PathInterner::GetSingleton();
+
+	// Reused for every file classified on the thread.
+	static thread_local std::string depotFile;
+	static thread_local std::string relativePath;
+	static const std::string gitDirectory = ".git";
+
+	// First, filter out files we don't want.
+	paths->GetPath(cl.GetDepotFileID(row), depotFile);
+	if (
+	    // depot file should always be present.
+	    // The left side of the client view is the depot side.
+	    !m_view.IsIncluded(depotFile)
+	    || (!m_includeBinaries && cl.IsBinary(row))
+	    // To avoid adding .git/ files or a .git submodule file in the Perforce history if any
+	    || paths->HasComponent(cl.GetDepotFileID(row), gitDirectory)
+	)
+	{
+		return false;
+	}
+	// Put logic for Absolutely do not dare map these files here, here :)
+	PathInterner::ID relativeDepotPath = stripBasePath(cl.GetDepotFileID(row));
+	if (relativeDepotPath == PathInterner::Root)
+	{
+		// Not under regular depot path, might be mapped in
+		// check and attenuate if it is.
+		const int importRule = m_imports.Match(depotFile);
+		if (importRule == PathFilter::NoRule)
+		{
+			return false;
+		}
+
+		// Shove the replacement path at the front, in place of the path without the trailing ...
+		const StreamResult::MappingData& v = m_mappings[m_importMappings[importRule]];
+		const size_t importedSize = v.stream2.size() - 3;
+		relativeDepotPath = paths->Intern(v.stream1.substr(0, v.stream1.size() - 3) + depotFile.substr(importedSize));
+	}
+
+	// Check the file or path is not marked as excluded (There is a chance that not all of a mapped in directory is desired, so we have to check post mapping.)
+	if (!m_exclusionFilter.IsEmpty())
 	{
-		FileData fileData(clFileData);
-
-		// First, filter out files we don't want.
-		const std::string& depotFile = fileData.GetDepotFile();
-		if (
-		    // depot file should always be present.
-		    // The left side of the client view is the depot side.
-		    !m_view.IsInLeft(depotFile)
-		    || (!m_includeBinaries && fileData.IsBinary())
-		    || STDHelpers::Contains(depotFile, "/.git/") // To avoid adding .git/ files in the Perforce history if any
-		    || STDHelpers::EndsWith(depotFile, "/.git") // To avoid adding a .git submodule file in the Perforce history if any
-		)
+		paths->GetPath(relativeDepotPath, relativePath);
+		if (m_exclusionFilter.Match(relativePath) != PathFilter::NoRule)
 		{
-			continue;
+			return false;
 		}
-		// Put logic for Absolutely do not dare map these files here, here :)
-		std::string relativeDepotPath = stripBasePath(depotFile);
-		if (relativeDepotPath.empty())
+	}
+
+	classified.row = row;
+	classified.source = nullptr;
+	classified.target = nullptr;
+
+	// If we have branches, then possibly sort the file into a branch group.
+	if (HasMergeableBranch())
+	{
+		PathInterner::ID branchFilePath = PathInterner::Root;
+		const Branch* branch = splitBranchPath(relativeDepotPath, branchFilePath);
+		if (!branch)
 		{
-			// Not under regular depot path, might be mapped in
-			// check and attenuate if it is.
-			bool isImport = false;
-			for (auto const& v : m_mappings)
-			{
-				if (STDHelpers::EndsWith(v.stream2, "..."))
-				{
-					// get rid of trailing ...
-					auto tempStr = v.stream2.substr(0, v.stream2.size() - 3);
-					if (STDHelpers::StartsWith(depotFile, tempStr))
-					{
-						isImport = true;
-						// Shove the replacement path at the front
-						relativeDepotPath = v.stream1.substr(0, v.stream1.size() - 3) + depotFile.substr(tempStr.size());
-						break;
-					}
-					if (depotFile == tempStr)
-					{
-						// Map in exactly one file and nothing else.
-						relativeDepotPath = v.stream1;
-						isImport = true;
-						break;
-					}
-				}
-			}
+			// not a valid branch file.  skip it.
+			return false;
+		}
+
+		// It's a valid destination to a branch.
+		// Make sure the relative path is set.
+		cl.SetRelativePath(row, branchFilePath);
+		classified.target = branch;
+
+		if (cl.IsIntegrated(row) && cl.HasFromDepotFile(row))
+		{
+			// Only add the integration if the source is from a branch we care about.
+			PathInterner::ID fromBranchFilePath = PathInterner::Root;
+			const Branch* fromBranch = splitBranchPath(stripBasePath(cl.GetFromDepotFileID(row)), fromBranchFilePath);
+			if (
+			    fromBranch
 
-			if (!isImport)
+			    // Can't have source and target be pointing to the same branch; that's not
+			    // a branch operation in the Git sense.
+			    && fromBranch->gitAlias != branch->gitAlias)
 			{
-				continue;
+				// This is a valid integrate from a known source to a known target branch.
+				classified.source = fromBranch;
 			}
 		}
+	}
+	else
+	{
+		// It's a non-branching setup.
+		// Make sure the relative path is set.
+		cl.SetRelativePath(row, relativeDepotPath);
+	}
+	return true;
+}
 
-		// Check the file or path is not marked as excluded (There is a chance that not all of a mapped in directory is desired, so we have to check post mapping.)
-		bool discard = false;
-		for (auto const& v : m_exclusions)
+void BranchSet::classifyFiles(FileTable& cl, const size_t& begin, const size_t& end, std::vector<ClassifiedFile>& classified) const
+{
+	ClassifiedFile file;
+	for (size_t row = begin; row < end; row++)
+	{
+		if (classifyFile(cl, row, file))
 		{
-			if (STDHelpers::EndsWith(v.stream1, "..."))
-			{
-				if (STDHelpers::StartsWith(relativeDepotPath, v.stream1.substr(0, v.stream1.size() - 3)))
-				{
-					discard = true;
-					break;
-				}
-			}
-			else if (v.stream1 == relativeDepotPath)
-			{
-				discard = true;
-				break;
-			}
+			classified.push_back(file);
 		}
-		if (discard)
+	}
+}
+
+// Post condition: all the returned files (e.g. filtered for git commit) have the relativePath set.
+std::unique_ptr<ChangedFileGroups> BranchSet::ParseAffectedFiles(FileTable&& cl, const Scheduler& schedule) const
+{
+	const size_t fileCount = cl.GetSize();
+	const size_t shardCount = schedule && fileCount >= ParallelParseMinFiles
+	    ? (fileCount + ParallelParseMinFiles / 2 - 1) / (ParallelParseMinFiles / 2)
+	    : 1;
+	const size_t shardSize = (fileCount + shardCount - 1) / std::max<size_t>(1, shardCount);
+
+	// Every shard classifies its own rows, which only touches those rows of the table.
+	std::vector<std::vector<ClassifiedFile>> shards(shardCount);
+	if (shardCount > 1)
+	{
+		std::mutex mutex;
+		std::condition_variable cv;
+		size_t pending = shardCount - 1;
+		std::exception_ptr error;
+
+		for (size_t shard = 1; shard < shardCount; shard++)
 		{
-			continue;
+			schedule([this, &cl, &shards, &mutex, &cv, &pending, &error, shard, shardSize, fileCount]()
+			    {
+				    std::exception_ptr shardError;
+				    try
+				    {
+					    classifyFiles(cl, shard * shardSize, std::min(fileCount, (shard + 1) * shardSize), shards[shard]);
+				    }
+				    catch (...)
+				    {
+					    // Anything escaping would leave the describe thread waiting.
+					    shardError = std::current_exception();
+				    }
+
+				    std::lock_guard<std::mutex> lock(mutex);
+				    if (shardError && !error)
+				    {
+					    error = shardError;
+				    }
+				    pending--;
+				    cv.notify_all();
+			    });
 		}
 
-		// If we have branches, then possibly sort the file into a branch group.
-		if (HasMergeableBranch())
+		// This thread takes the first shard rather than sitting idle. Its
+		// exception waits for the other shards, which use the locals above.
+		std::exception_ptr firstShardError;
+		try
 		{
-			// [0] == branch name, [1] == relative path in the branch.
-			std::array<std::string, 2> branchPath = splitBranchPath(relativeDepotPath);
-			if (
-			    branchPath[0].empty()
-			    || branchPath[1].empty())
-			{
-				// not a valid branch file.  skip it.
-				continue;
-			}
+			classifyFiles(cl, 0, std::min(fileCount, shardSize), shards[0]);
+		}
+		catch (...)
+		{
+			firstShardError = std::current_exception();
+		}
 
-			// It's a valid destination to a branch.
-			// Make sure the relative path is set.
-			fileData.SetRelativePath(branchPath[1]);
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [&pending]()
+		    { return pending == 0; });
+		if (firstShardError && !error)
+		{
+			error = firstShardError;
+		}
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+	}
+	else
+	{
+		classifyFiles(cl, 0, fileCount, shards[0]);
+	}
 
-			bool needsHandling = true;
-			if (fileData.IsIntegrated())
+	// Merged back in row order, so that the groups and their files come out
+	// exactly as if the rows had been classified one after the other.
+	branchIntegrationMap branchMap;
+	for (const std::vector<ClassifiedFile>& shard : shards)
+	{
+		for (const ClassifiedFile& file : shard)
+		{
+			if (file.source)
 			{
-				// Only add the integration if the source is from a branch we care about.
-				// [0] == branch name, [1] == relative path in the branch.
-				std::array<std::string, 2> fromBranchPath = splitBranchPath(stripBasePath(fileData.GetFromDepotFile()));
-				if (
-				    !fromBranchPath[0].empty()
-				    && !fromBranchPath[1].empty()
-
-				    // Can't have source and target be pointing to the same branch; that's not
-				    // a branch operation in the Git sense.
-				    && fromBranchPath[0] != branchPath[0])
-				{
-					// This is a valid integrate from a known source to a known target branch.
-					branchMap.addMerge(fromBranchPath[0], branchPath[0], fileData);
-					needsHandling = false;
-				}
+				branchMap.addMerge(file.source->gitAlias, file.target->gitAlias, file.row);
 			}
-			if (needsHandling)
+			else
 			{
-				// Either not a valid integrate, or a normal operation.
-				branchMap.addTarget(branchPath[0], fileData);
+				branchMap.addTarget(file.target ? file.target->gitAlias : EMPTY_STRING, file.row);
 			}
 		}
-		else
-		{
-			// It's a non-branching setup.
-			// Make sure the relative path is set.
-			fileData.SetRelativePath(relativeDepotPath);
-			branchMap.addTarget(EMPTY_STRING, fileData);
-		}
 	}
-	return branchMap.createChangedFileGroups();
+	return branchMap.createChangedFileGroups(std::move(cl));
 }
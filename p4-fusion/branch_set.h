@@ -8,14 +8,16 @@
 
 #include <string>
 #include <vector>
-#include <array>
 #include <memory>
+#include <unordered_map>
+#include <functional>
 #include <stdexcept>
 
 #include "commands/file_map.h"
-#include "commands/file_data.h"
+#include "commands/file_table.h"
 #include "commands/stream_result.h"
 #include "utils/std_helpers.h"
+#include "utils/path_interner.h"
 
 struct BranchedFileGroup
 {
@@ -26,10 +28,12 @@ struct BranchedFileGroup
 	std::string sourceBranch;
 	std::string targetBranch;
 	bool hasSource;
-	std::vector<FileData> files;
 
-	// Get all the relative file names from each of the file data.
-	std::vector<std::string> GetRelativeFileNames();
+	// Span of the rows of the changelist's file table in this group.
+	size_t begin = 0;
+	size_t end = 0;
+
+	size_t GetFileCount() const { return end - begin; }
 };
 
 struct ChangedFileGroups
@@ -38,6 +42,8 @@ private:
 	ChangedFileGroups();
 
 public:
+	// The files of every group, stored one group after the other.
+	FileTable files;
 	std::vector<BranchedFileGroup> branchedFileGroups;
 	int totalFileCount;
 
@@ -45,7 +51,7 @@ public:
 	// only then can we safely clear out the data.
 	void Clear();
 
-	ChangedFileGroups(std::vector<BranchedFileGroup>& groups, int totalFileCount);
+	ChangedFileGroups(FileTable&& files, std::vector<BranchedFileGroup>& groups);
 
 	static std::unique_ptr<ChangedFileGroups> Empty() { return std::unique_ptr<ChangedFileGroups>(new ChangedFileGroups); };
 };
@@ -55,12 +61,31 @@ struct Branch
 public:
 	const std::string depotBranchPath;
 	const std::string gitAlias;
+	// depotBranchPath, interned relative to the base depot path.
+	const PathInterner::ID depotBranchPathID;
 
 	Branch(const std::string& branch, const std::string& alias);
 
-	// splitBranchPath If the relativeDepotPath matches, returns {branch alias, branch file path}.
-	//   Otherwise, returns {"", ""}
-	std::array<std::string, 2> SplitBranchPath(const std::string& relativeDepotPath) const;
+	// SplitBranchPath If the relativeDepotPath is in the branch, returns the path of the file in the branch.
+	//   Otherwise, returns PathInterner::Root
+	PathInterner::ID SplitBranchPath(const PathInterner::ID& relativeDepotPath) const;
+};
+
+// Finds the branch of a path by its longest matching branch path. The
+// interner already keeps the paths as a trie of their components, so the
+// branch directories are marked on its nodes and a path is resolved by
+// walking up its components once: the first marked one is the deepest
+// branch, whatever the order the branches were given in.
+struct BranchTrie
+{
+private:
+	std::unordered_map<PathInterner::ID, size_t> m_branchIndices;
+
+public:
+	explicit BranchTrie(const std::vector<Branch>& branches);
+
+	// Returns the index of the deepest branch holding the path, or -1 if none does.
+	int Find(const PathInterner::ID& relativeDepotPath) const;
 };
 
 // A singular view on the branches and a base view (acts as a filter to trim down affected files).
@@ -71,19 +96,52 @@ private:
 	// Technically, these should all be const.
 	const bool m_includeBinaries;
 	std::string m_basePath;
+	PathInterner::ID m_basePathID;
 	const std::vector<Branch> m_branches;
+	const BranchTrie m_branchTrie;
 	const std::vector<StreamResult::MappingData> m_mappings;
 	const std::vector<StreamResult::MappingData> m_exclusions;
-	FileMap m_view;
-
-	// stripBasePath remove the base path from the depot path, or "" if not in the base path.
-	std::string stripBasePath(const std::string& depotPath) const;
 
-	// splitBranchPath extract the branch name and path under the branch (no leading '/' on the path)
+	// Compiled once, and only read afterwards.
+	// The left side of the client view, matched against depot paths.
+	PathFilter m_view;
+	// The depot side of the imported stream paths, matched against depot
+	// paths out of the base path. Rule i is the mapping m_importMappings[i].
+	PathFilter m_imports;
+	std::vector<size_t> m_importMappings;
+	// The excluded stream paths, matched against relative paths.
+	PathFilter m_exclusionFilter;
+
+	// stripBasePath remove the base path from the depot path, or PathInterner::Root if not in the base path.
+	PathInterner::ID stripBasePath(const PathInterner::ID& depotPath) const;
+
+	// splitBranchPath find the branch of the file and the path of the file under the branch.
+	//    Returns nullptr if the file is in none of the branches.
 	//    relativeDepotPath - already stripped from running stripBasePath.
-	std::array<std::string, 2> splitBranchPath(const std::string& relativeDepotPath) const;
+	const Branch* splitBranchPath(const PathInterner::ID& relativeDepotPath, PathInterner::ID& branchFilePath) const;
+
+	// Where a kept file goes: its target branch, and the branch it is merged from, if any.
+	// Both are nullptr without branches.
+	struct ClassifiedFile
+	{
+		size_t row;
+		const Branch* source;
+		const Branch* target;
+	};
+
+	// classifyFile filter the file out or find its branches, and set its relative path.
+	//    Returns false if the file is filtered out.
+	bool classifyFile(FileTable& cl, const size_t& row, ClassifiedFile& classified) const;
+	void classifyFiles(FileTable& cl, const size_t& begin, const size_t& end, std::vector<ClassifiedFile>& classified) const;
 
 public:
+	// Runs a job on another thread.
+	typedef std::function<void(const std::function<void()>&)> Scheduler;
+
+	// Changelists with at least this many files are split in shards of half as many
+	// files, classified in parallel when a scheduler is given.
+	static const size_t ParallelParseMinFiles = 20000;
+
 	BranchSet(std::vector<std::string>& clientViewMapping, const std::string& baseDepotPath, const std::vector<std::string>& branches, const std::vector<StreamResult::MappingData>& mappings, const std::vector<StreamResult::MappingData>& exclusions, const bool includeBinaries);
 
 	// HasMergeableBranch is there a branch model that requires integration history?
@@ -94,8 +152,7 @@ public:
 	// ParseAffectedFiles create collections of merges and commits.
 	// Breaks up the files into those that are within the view, with each item in the
 	// list is its own target Git branch.
-	// This also has the side-effect of populating the relative path value in the file data.
-	//   ... the FileData object is copied, but it's underlying shared data is shared.  So, this
-	//       breaks the const.
-	std::unique_ptr<ChangedFileGroups> ParseAffectedFiles(const std::vector<FileData>& cl) const;
+	// This also populates the relative path of the files, and takes over the file table
+	// with the filtered out files dropped and the remaining ones sorted by group.
+	std::unique_ptr<ChangedFileGroups> ParseAffectedFiles(FileTable&& cl, const Scheduler& schedule = nullptr) const;
 };
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "change_enumerator.h"
+
+#include <algorithm>
+
+#include "p4_api.h"
+#include "thread_pool.h"
+#include "commands/changes_result.h"
+
+ChangeEnumerator::ChangeEnumerator(const std::vector<std::string>& paths, const int64_t& windowSize, const size_t& windowsInFlight, const int32_t& maxChanges)
+    : m_Paths(paths)
+    , m_WindowSize(std::max<int64_t>(1, windowSize))
+    , m_WindowsInFlight(std::max<size_t>(1, windowsInFlight))
+    , m_MaxChanges(maxChanges)
+    , m_NextFrom(0)
+    , m_Last(-1)
+    , m_IsComplete(false)
+{
+}
+
+void ChangeEnumerator::Start(P4API& p4, const std::string& resumeFromCL)
+{
+	bool hasFirst = false;
+	int64_t first = 0;
+	for (const std::string& path : m_Paths)
+	{
+		std::unique_ptr<ChangesResult> latest = p4.LatestChange(path);
+		if (latest->GetChanges().IsEmpty())
+		{
+			continue;
+		}
+		m_Last = std::max<int64_t>(m_Last, std::stoll(latest->GetChanges().GetNumber(0)));
+
+		if (resumeFromCL.empty())
+		{
+			// Skip the unused CL numbers ahead of the oldest CL
+			std::unique_ptr<ChangesResult> oldest = p4.OldestChange(path);
+			const int64_t oldestCL = std::stoll(oldest->GetChanges().GetNumber(0));
+			first = hasFirst ? std::min(first, oldestCL) : oldestCL;
+			hasFirst = true;
+		}
+	}
+
+	m_NextFrom = resumeFromCL.empty() ? first : std::stoll(resumeFromCL) + 1;
+
+	QueueWindows();
+	m_IsComplete = m_Windows.empty();
+}
+
+bool ChangeEnumerator::Poll(P4API& p4)
+{
+	int64_t last = m_Last;
+	for (const std::string& path : m_Paths)
+	{
+		std::unique_ptr<ChangesResult> latest = p4.LatestChange(path);
+		if (!latest->GetChanges().IsEmpty())
+		{
+			last = std::max<int64_t>(last, std::stoll(latest->GetChanges().GetNumber(0)));
+		}
+	}
+	if (last <= m_Last)
+	{
+		return false;
+	}
+
+	m_Last = last;
+	QueueWindows();
+	m_IsComplete = m_Windows.empty();
+	return true;
+}
+
+void ChangeEnumerator::QueueWindows()
+{
+	while (m_Windows.size() < m_WindowsInFlight && m_NextFrom <= m_Last)
+	{
+		std::shared_ptr<Window> window = std::make_shared<Window>();
+		window->from = m_NextFrom;
+		window->to = std::min(m_Last, m_NextFrom + m_WindowSize - 1);
+		window->results.resize(m_Paths.size());
+		window->pending = m_Paths.size();
+		m_NextFrom = window->to + 1;
+
+		for (size_t pathIndex = 0; pathIndex < m_Paths.size(); pathIndex++)
+		{
+			const std::string& path = m_Paths[pathIndex];
+			const int32_t maxChanges = m_MaxChanges;
+			ThreadPool::GetMetadataPool()->AddJob([window, path, pathIndex, maxChanges](P4API* p4)
+			    {
+				    ChangeHistory changes;
+				    std::exception_ptr error;
+				    try
+				    {
+					    changes = std::move(p4->ChangesInRange(path, window->from, window->to, maxChanges)->GetChanges());
+				    }
+				    catch (const std::exception& e)
+				    {
+					    error = std::current_exception();
+				    }
+
+				    std::lock_guard<std::mutex> lock(window->mutex);
+				    window->results[pathIndex] = std::move(changes);
+				    if (error)
+				    {
+					    window->error = error;
+				    }
+				    window->pending--;
+				    window->cv.notify_all();
+			    });
+		}
+
+		m_Windows.push_back(window);
+	}
+}
+
+bool ChangeEnumerator::WaitFor(const size_t& index)
+{
+	while (index >= m_Changes.GetSize())
+	{
+		if (m_Windows.empty())
+		{
+			m_IsComplete = true;
+			return false;
+		}
+
+		std::shared_ptr<Window> window = m_Windows.front();
+		m_Windows.pop_front();
+		{
+			std::unique_lock<std::mutex> lock(window->mutex);
+			window->cv.wait(lock, [&window]()
+			    { return window->pending == 0; });
+		}
+		if (window->error)
+		{
+			std::rethrow_exception(window->error);
+		}
+
+		m_Changes.AppendMerged(window->results);
+
+		if (m_MaxChanges > -1 && m_Changes.GetSize() >= (size_t)m_MaxChanges)
+		{
+			// Windows still in flight finish on their own and are dropped
+			m_Changes.Truncate(m_MaxChanges);
+			m_Windows.clear();
+			m_NextFrom = m_Last + 1;
+		}
+
+		QueueWindows();
+	}
+
+	m_IsComplete = m_Windows.empty();
+	return true;
+}
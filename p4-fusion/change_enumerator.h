@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstdint>
+
+#include "common.h"
+#include "commands/change_history.h"
+
+class P4API;
+
+// Enumerates the changelists submitted to a set of depot paths in windows
+// of consecutive CL numbers. A few windows are queried ahead of the
+// conversion on the metadata pool, with a `p4 changes` range query per
+// path, and the paths of each window are combined with a k-way merge.
+class ChangeEnumerator
+{
+	struct Window
+	{
+		int64_t from;
+		int64_t to;
+		std::vector<ChangeHistory> results; // One per path
+		size_t pending;
+		std::exception_ptr error;
+		std::mutex mutex;
+		std::condition_variable cv;
+	};
+
+	const std::vector<std::string> m_Paths;
+	const int64_t m_WindowSize;
+	const size_t m_WindowsInFlight;
+	const int32_t m_MaxChanges;
+
+	int64_t m_NextFrom;
+	int64_t m_Last;
+	std::deque<std::shared_ptr<Window>> m_Windows;
+	ChangeHistory m_Changes;
+	bool m_IsComplete;
+
+	void QueueWindows();
+
+public:
+	ChangeEnumerator(const std::vector<std::string>& paths, const int64_t& windowSize, const size_t& windowsInFlight, const int32_t& maxChanges);
+
+	// Finds the range of CL numbers to enumerate, after `resumeFromCL`
+	// if it is given, and queues the first windows.
+	void Start(P4API& p4, const std::string& resumeFromCL);
+	// Blocks until the changelist at `index` is enumerated. Returns false
+	// if the enumeration ends before it.
+	bool WaitFor(const size_t& index);
+	// Extends the enumeration to the changelists submitted since the
+	// last look. Returns false if there are none.
+	bool Poll(P4API& p4);
+
+	bool IsComplete() const { return m_IsComplete; }
+	// The changelists enumerated so far, in chronological order. Only
+	// grows from within WaitFor.
+	const ChangeHistory& GetChanges() const { return m_Changes; }
+};
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "change_history.h"
+
+#include <algorithm>
+#include <queue>
+#include <functional>
+#include <cstdlib>
+
+uint32_t ChangeHistory::AddUser(const std::string& user)
+{
+	auto found = m_UserIndices.find(user);
+	if (found != m_UserIndices.end())
+	{
+		return found->second;
+	}
+
+	const uint32_t index = m_Users.size();
+	m_Users.push_back(user);
+	m_UserIndices.insert({ user, index });
+	return index;
+}
+
+void ChangeHistory::Add(const std::string& number, const std::string& description, const std::string& user, const int64_t& timestamp)
+{
+	Record record;
+	record.timestamp = timestamp;
+	record.descriptionOffset = m_Descriptions.size();
+	record.descriptionSize = description.size();
+	record.number = std::strtoul(number.c_str(), nullptr, 10);
+	record.user = AddUser(user);
+	m_Records.push_back(record);
+
+	m_Descriptions += description;
+}
+
+void ChangeHistory::Append(const ChangeHistory& other)
+{
+	m_Records.reserve(m_Records.size() + other.m_Records.size());
+	for (size_t i = 0; i < other.GetSize(); i++)
+	{
+		Add(other.GetNumber(i), other.GetDescription(i), other.GetUser(i), other.GetTimestamp(i));
+	}
+}
+
+void ChangeHistory::AppendMerged(const std::vector<ChangeHistory>& sources)
+{
+	typedef std::pair<uint32_t, size_t> Head; // CL number, source index
+	std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+	std::vector<size_t> positions(sources.size(), 0);
+
+	for (size_t source = 0; source < sources.size(); source++)
+	{
+		if (!sources[source].IsEmpty())
+		{
+			heads.push({ sources[source].m_Records.front().number, source });
+		}
+	}
+
+	bool hasLast = false;
+	uint32_t last = 0;
+	while (!heads.empty())
+	{
+		const Head head = heads.top();
+		heads.pop();
+
+		const ChangeHistory& source = sources[head.second];
+		const size_t position = positions[head.second]++;
+		if (!hasLast || head.first != last)
+		{
+			Record record = source.m_Records[position];
+			record.descriptionOffset = m_Descriptions.size();
+			record.descriptionSize = 0;
+			record.user = AddUser(source.m_Users[record.user]);
+			m_Records.push_back(record);
+
+			hasLast = true;
+			last = head.first;
+		}
+
+		if (position + 1 < source.m_Records.size())
+		{
+			heads.push({ source.m_Records[position + 1].number, head.second });
+		}
+	}
+}
+
+void ChangeHistory::Sort()
+{
+	std::stable_sort(m_Records.begin(), m_Records.end(), [](const Record& a, const Record& b)
+	    { return a.timestamp < b.timestamp; });
+}
+
+void ChangeHistory::Truncate(const size_t& size)
+{
+	if (size < m_Records.size())
+	{
+		// The descriptions of the dropped records are left in the buffer.
+		m_Records.resize(size);
+	}
+}
+
+std::string ChangeHistory::GetDescription(const size_t& index) const
+{
+	const Record& record = m_Records[index];
+	return m_Descriptions.substr(record.descriptionOffset, record.descriptionSize);
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// The changelists to convert, held as fixed size records with the users
+// deduplicated and the descriptions packed into a single buffer. Only
+// the changelists in flight are expanded into a ChangeList.
+class ChangeHistory
+{
+	struct Record
+	{
+		int64_t timestamp;
+		uint64_t descriptionOffset;
+		uint32_t descriptionSize;
+		uint32_t number;
+		uint32_t user; // Index into m_Users
+	};
+
+	std::vector<Record> m_Records;
+	std::string m_Descriptions;
+	std::vector<std::string> m_Users;
+	std::unordered_map<std::string, uint32_t> m_UserIndices;
+
+	uint32_t AddUser(const std::string& user);
+
+public:
+	void Add(const std::string& number, const std::string& description, const std::string& user, const int64_t& timestamp);
+	void Append(const ChangeHistory& other);
+	// Appends the union of the sources, each listed in ascending CL number
+	// order, in ascending CL number order. A changelist listed by several
+	// sources is appended once. Descriptions are left out since they are
+	// read by describing each changelist.
+	void AppendMerged(const std::vector<ChangeHistory>& sources);
+	// Sorts the changelists in chronological order.
+	void Sort();
+	void Truncate(const size_t& size);
+
+	size_t GetSize() const { return m_Records.size(); }
+	bool IsEmpty() const { return m_Records.empty(); }
+
+	std::string GetNumber(const size_t& index) const { return std::to_string(m_Records[index].number); }
+	std::string GetDescription(const size_t& index) const;
+	const std::string& GetUser(const size_t& index) const { return m_Users[m_Records[index].user]; }
+	int64_t GetTimestamp(const size_t& index) const { return m_Records[index].timestamp; }
+};
@@ -9,31 +9,68 @@
 #include "p4_api.h"
 #include "describe_result.h"
 #include "filelog_result.h"
+#include "files_result.h"
 #include "print_result.h"
 #include "utils/std_helpers.h"
+#include "utils/download_cache.h"
+#include "../metadata_cache.h"
+#include "../blob_table.h"
 
 #include "thread_pool.h"
 
-ChangeList::ChangeList(const std::string& clNumber, const std::string& clDescription, const std::string& userID, const int64_t& clTimestamp)
-    : number(clNumber)
-    , user(userID)
-    , description(clDescription)
-    , timestamp(clTimestamp)
-    , changedFileGroups(ChangedFileGroups::Empty())
-    , stateCV(new std::condition_variable())
-    , stateMutex(new std::mutex())
-    , filesDownloaded(-1)
-    , state(Initialized)
+LatencyTracker ChangeList::PrintLatency;
+bool ChangeList::HedgeStalledDownloads = true;
+int64_t ChangeList::HedgeMinDelayMs = 10 * 1000;
+
+static int64_t NowMs()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(Timer::Now().time_since_epoch()).count();
+}
+
+// Lets the files of very large changelists be sorted into branches on several cores.
+static void ScheduleOnCPUPool(const std::function<void()>& job)
+{
+	ThreadPool::GetCPUPool()->AddJob([job](P4API*)
+	    { job(); });
+}
+
+PrintBatch::PrintBatch()
+    : isComplete(false)
+    , attempts(0)
+    , lastAttemptAtMs(0)
+{
+}
+
+void ChangeList::Reset(const std::string& clNumber, const std::string& clDescription, const std::string& userID, const int64_t& clTimestamp)
 {
+	std::lock_guard<std::mutex> lock(stateMutex);
+	number = clNumber;
+	user = userID;
+	description = clDescription;
+	timestamp = clTimestamp;
+	changedFileGroups = ChangedFileGroups::Empty();
+	filesDownloaded = -1;
+	printBatch = 0;
+	state = Initialized;
+	isCancelled = false;
 }
 
 void ChangeList::PrepareDownload(const BranchSet& branchSet)
 {
 	ChangeList& cl = *this;
 
-	ThreadPool::GetSingleton()->AddJob([&cl, &branchSet](P4API* p4)
+	ThreadPool::GetMetadataPool()->AddJob([&cl, &branchSet](P4API* p4)
 	    {
-		    std::vector<FileData> changedFiles;
+		    if (cl.isCancelled)
+		    {
+			    // Done with no files.
+			    cl.OnDescribed();
+			    return;
+		    }
+
+		    MetadataCache* cache = MetadataCache::GetSingleton();
+		    FileTable files;
+		    std::string description;
 		    if (branchSet.HasMergeableBranch())
 		    {
 			    // If we care about branches, we need to run filelog to get where the file came from.
@@ -42,116 +79,377 @@ void ChangeList::PrepareDownload(const BranchSet& branchSet)
 			    // copy will have the target files listing the from-file with
 			    // different changelists than the point-in-time source branch's
 			    // changelist.
-			    std::unique_ptr<FileLogResult> filelog = p4->FileLog(cl.number);
-			    cl.changedFileGroups = branchSet.ParseAffectedFiles(filelog->GetFileData());
+			    if (!cache->Get(cl.number, MetadataCache::FileLog, description, files))
+			    {
+				    std::unique_ptr<FileLogResult> filelog = p4->FileLog(cl.number);
+				    files = std::move(filelog->GetFileTable());
+				    // The changelists are enumerated without their full descriptions.
+				    description = p4->DescribeHeader(cl.number)->GetDescription();
+				    cache->Put(cl.number, MetadataCache::FileLog, description, files);
+			    }
 		    }
 		    else
 		    {
 			    // If we don't care about branches, then p4->Describe is much faster.
-			    std::unique_ptr<DescribeResult> describe = p4->Describe(cl.number);
-			    cl.changedFileGroups = branchSet.ParseAffectedFiles(describe->GetFileData());
+			    if (!cache->Get(cl.number, MetadataCache::Describe, description, files))
+			    {
+				    std::unique_ptr<DescribeResult> describe = p4->Describe(cl.number);
+				    files = std::move(describe->GetFileTable());
+				    description = describe->GetDescription();
+				    cache->Put(cl.number, MetadataCache::Describe, description, files);
+			    }
 		    }
+		    // The files are cached before they are filtered, as the filters
+		    // depend on the options of the run.
+		    cl.changedFileGroups = branchSet.ParseAffectedFiles(std::move(files), ScheduleOnCPUPool);
+		    cl.description = description;
+		    cl.OnDescribed();
+	    });
+}
+
+void ChangeList::PrepareSnapshot(const BranchSet& branchSet, const std::vector<std::string>& paths)
+{
+	ChangeList& cl = *this;
 
-		    std::unique_lock<std::mutex> lock(*cl.stateMutex);
-		    cl.state = Described;
-		    cl.stateCV->notify_all();
+	ThreadPool::GetMetadataPool()->AddJob([&cl, &branchSet, paths](P4API* p4)
+	    {
+		    std::unique_ptr<FilesResult> files = p4->Files(paths, cl.number);
+		    cl.changedFileGroups = branchSet.ParseAffectedFiles(std::move(files->GetFileTable()), ScheduleOnCPUPool);
+		    cl.OnDescribed();
 	    });
 }
 
-void ChangeList::StartDownload(const int& printBatch)
+void ChangeList::OnDescribed()
+{
+	bool isDownloadRequested = false;
+	{
+		std::unique_lock<std::mutex> lock(stateMutex);
+		state = Described;
+		isDownloadRequested = printBatch > 0;
+		stateCV.notify_all();
+	}
+
+	if (isDownloadRequested)
+	{
+		ScheduleBatches();
+	}
+}
+
+void ChangeList::StartDownload(const int& printBatchSize)
+{
+	bool isDescribed = false;
+	{
+		std::unique_lock<std::mutex> lock(stateMutex);
+		printBatch = printBatchSize;
+		isDescribed = state == Described;
+	}
+
+	// Otherwise the describe job schedules the batches once it finishes,
+	// so that no worker sits blocked waiting on the metadata pool.
+	if (isDescribed)
+	{
+		ScheduleBatches();
+	}
+}
+
+void ChangeList::ScheduleBatches()
 {
 	ChangeList& cl = *this;
 
-	ThreadPool::GetSingleton()->AddJob([&cl, printBatch](P4API* p4)
+	ThreadPool::GetCPUPool()->AddJob([&cl](P4API* p4)
 	    {
-		    // Wait for describe to finish, if it is still running
+		    const int printBatch = cl.printBatch;
+
+		    cl.filesDownloaded = 0;
+
+		    const FileTable& files = cl.changedFileGroups->files;
+		    std::vector<BranchedFileGroup>& branchedFileGroups = cl.changedFileGroups->branchedFileGroups;
 		    {
-			    std::unique_lock<std::mutex> lock(*cl.stateMutex);
-			    cl.stateCV->wait(lock, [&cl]()
-			        { return cl.state == Described; });
+			    std::lock_guard<std::mutex> lock(cl.stateMutex);
+			    cl.downloadedFiles.resize(branchedFileGroups.size());
 		    }
+		    cl.deduplicatedFiles.assign(files.GetSize(), false);
 
-		    cl.filesDownloaded = 0;
+		    BlobTable* blobs = cl.blobTable;
+		    std::vector<size_t> deduplicatedRows;
+		    std::vector<size_t> deduplicatedGroups;
 
-		    std::shared_ptr<std::vector<std::string>> printBatchFiles = std::make_shared<std::vector<std::string>>();
-		    std::shared_ptr<std::vector<FileData*>> printBatchFileData = std::make_shared<std::vector<FileData*>>();
+		    std::shared_ptr<PrintBatch> batch = std::make_shared<PrintBatch>();
 		    // Only perform the group inspection if there are files.
 		    if (cl.changedFileGroups->totalFileCount > 0)
 		    {
-			    for (auto& branchedFileGroup : cl.changedFileGroups->branchedFileGroups)
+			    for (size_t groupIndex = 0; groupIndex < branchedFileGroups.size(); groupIndex++)
 			    {
 				    // Note: the files at this point have already been filtered.
-				    for (auto& fileData : branchedFileGroup.files)
+				    const BranchedFileGroup& branchedFileGroup = branchedFileGroups[groupIndex];
+				    for (size_t row = branchedFileGroup.begin; row < branchedFileGroup.end; row++)
 				    {
-					    if (fileData.IsDownloadNeeded())
+					    if (blobs && blobs->Claim(files, row, cl.number))
 					    {
-						    fileData.SetPendingDownload();
-						    printBatchFiles->push_back(fileData.GetDepotFile() + "#" + fileData.GetRevision());
-						    printBatchFileData->push_back(&fileData);
-
-						    // Clear the batches if it fits
-						    if (printBatchFiles->size() == printBatch)
-						    {
-							    cl.Flush(printBatchFiles, printBatchFileData);
-
-							    // We let go of the refs held by us and create new ones to queue the next batch
-							    printBatchFiles = std::make_shared<std::vector<std::string>>();
-							    printBatchFileData = std::make_shared<std::vector<FileData*>>();
-							    // Now only the thread job has access to the older batch
-						    }
+						    cl.deduplicatedFiles[row] = true;
+						    deduplicatedRows.push_back(row);
+						    deduplicatedGroups.push_back(groupIndex);
+						    continue;
+					    }
+
+					    batch->files.push_back(files.GetDepotFileRevision(row));
+					    batch->fileRows.push_back(row);
+					    batch->fileGroups.push_back(groupIndex);
+
+					    // Clear the batches if it fits
+					    if (batch->files.size() == printBatch)
+					    {
+						    cl.Flush(batch);
+
+						    // We let go of the ref held by us and create a new one to queue the next batch
+						    batch = std::make_shared<PrintBatch>();
+						    // Now only the thread job has access to the older batch
 					    }
 				    }
 			    }
 		    }
 
-		    // Flush any remaining files that were smaller in number than the total batch size.
-		    // Additionally, signal the batch processing end.
-		    cl.Flush(printBatchFiles, printBatchFileData);
+		    // Flush any remaining files that were smaller in number than the total batch size,
+		    // along with the files which need no print. Additionally, signal the batch processing end.
+		    batch->fileRows.insert(batch->fileRows.end(), deduplicatedRows.begin(), deduplicatedRows.end());
+		    batch->fileGroups.insert(batch->fileGroups.end(), deduplicatedGroups.begin(), deduplicatedGroups.end());
+		    cl.Flush(batch);
 	    });
 }
 
-void ChangeList::Flush(std::shared_ptr<std::vector<std::string>> printBatchFiles, std::shared_ptr<std::vector<FileData*>> printBatchFileData)
+void ChangeList::Flush(std::shared_ptr<PrintBatch> batch)
 {
+	DownloadCache* cache = DownloadCache::GetSingleton();
+	if (cache->IsEnabled() && !batch->files.empty())
+	{
+		FileTable& files = changedFileGroups->files;
+
+		// The cached files stay in the batch, so that they are handed over
+		// along with the printed ones, as do the files already needing no print.
+		std::vector<std::string> printedFiles;
+		std::vector<size_t> printedRows;
+		std::vector<size_t> printedGroups;
+		std::vector<size_t> cachedRows(batch->fileRows.begin() + batch->files.size(), batch->fileRows.end());
+		std::vector<size_t> cachedGroups(batch->fileGroups.begin() + batch->files.size(), batch->fileGroups.end());
+		for (size_t i = 0; i < batch->files.size(); i++)
+		{
+			const size_t row = batch->fileRows[i];
+			const std::string key = DownloadCache::GetKey(P4API::P4PORT, batch->files[i], files.GetDigest(row));
+
+			ContentBuffer contents;
+			if (cache->Get(key, contents))
+			{
+				files.SetContents(row, std::move(contents));
+				cachedRows.push_back(row);
+				cachedGroups.push_back(batch->fileGroups[i]);
+			}
+			else
+			{
+				printedFiles.push_back(std::move(batch->files[i]));
+				printedRows.push_back(row);
+				printedGroups.push_back(batch->fileGroups[i]);
+				batch->cacheKeys.push_back(key);
+			}
+		}
+
+		batch->files = std::move(printedFiles);
+		batch->fileRows = std::move(printedRows);
+		batch->fileRows.insert(batch->fileRows.end(), cachedRows.begin(), cachedRows.end());
+		batch->fileGroups = std::move(printedGroups);
+		batch->fileGroups.insert(batch->fileGroups.end(), cachedGroups.begin(), cachedGroups.end());
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		printBatches.push_back(batch);
+	}
+
 	// Share ownership of this batch with the thread job
-	ThreadPool::GetSingleton()->AddJob([this, printBatchFiles, printBatchFileData](P4API* p4)
-	    {
-		    // Only perform the batch processing when there are files to process.
-		    if (!printBatchFileData->empty())
-		    {
-			    std::unique_ptr<PrintResult> printData = p4->PrintFiles(*printBatchFiles);
+	batch->attempts++;
+	ThreadPool::GetContentPool()->AddJob([this, batch](P4API* p4)
+	    { RunPrintBatch(batch, p4); });
+}
 
-			    for (int i = 0; i < printBatchFiles->size(); i++)
-			    {
-				    printBatchFileData->at(i)->MoveContentsOnceFrom(printData->GetPrintData().at(i).contents);
-			    }
-		    }
+void ChangeList::RunPrintBatch(std::shared_ptr<PrintBatch> batch, P4API* p4)
+{
+	if (batch->isComplete)
+	{
+		// Another attempt already won before this one started.
+		return;
+	}
 
-		    std::lock_guard<std::mutex> lock(*stateMutex);
-		    filesDownloaded += printBatchFiles->size();
-		    if (filesDownloaded == changedFileGroups->totalFileCount)
-		    {
-			    state = Downloaded;
-			    stateCV->notify_all();
-		    }
-	    });
+	if (isCancelled)
+	{
+		// The files are handed over without contents, for the changelist to
+		// be done with.
+		if (!batch->isComplete.exchange(true))
+		{
+			AddDownloadedFiles(batch->fileRows, batch->fileGroups);
+		}
+		return;
+	}
+
+	const int64_t startedAtMs = NowMs();
+	batch->lastAttemptAtMs = startedAtMs;
+
+	std::unique_ptr<PrintResult> printData;
+	// Only perform the batch processing when there are files to process.
+	if (!batch->files.empty())
+	{
+		printData = p4->PrintFiles(batch->files, batch.get());
+	}
+
+	if (batch->isComplete.exchange(true))
+	{
+		// Lost the race against another attempt of this batch, which
+		// owns the results. The changelist may already be cleared by now.
+		return;
+	}
+
+	// Shares the bytes of the printed contents, to be written to the download cache.
+	std::vector<ContentBuffer> cacheContents;
+	if (printData)
+	{
+		PrintLatency.Record(NowMs() - startedAtMs);
+
+		for (int i = 0; i < batch->files.size(); i++)
+		{
+			if (!batch->cacheKeys.empty())
+			{
+				cacheContents.push_back(printData->GetPrintData().at(i).contents);
+			}
+			changedFileGroups->files.SetContents(batch->fileRows.at(i), std::move(printData->GetPrintData().at(i).contents));
+		}
+	}
+
+	// Before the handover, as the commit thread lets go of the contents.
+	if (blobTable && blobTable->IsVerifyingDigests())
+	{
+		for (const size_t& row : batch->fileRows)
+		{
+			if (!deduplicatedFiles.at(row))
+			{
+				blobTable->Verify(changedFileGroups->files, row);
+			}
+		}
+	}
+
+	AddDownloadedFiles(batch->fileRows, batch->fileGroups);
+
+	// Only once the files are handed over, so that the commit does not wait
+	// on the disk. The changelist may already be cleared by now.
+	for (size_t i = 0; i < cacheContents.size(); i++)
+	{
+		DownloadCache::GetSingleton()->Put(batch->cacheKeys.at(i), cacheContents[i]);
+	}
+}
+
+void ChangeList::AddDownloadedFiles(const std::vector<size_t>& fileRows, const std::vector<size_t>& fileGroups)
+{
+	std::lock_guard<std::mutex> lock(stateMutex);
+	for (size_t i = 0; i < fileRows.size(); i++)
+	{
+		downloadedFiles.at(fileGroups.at(i)).push_back(fileRows.at(i));
+	}
+	filesDownloaded += fileRows.size();
+	if (filesDownloaded == changedFileGroups->totalFileCount)
+	{
+		state = Downloaded;
+	}
+	stateCV.notify_all();
+}
+
+int64_t ChangeList::GetStallDeadlineMs() const
+{
+	return std::max(HedgeMinDelayMs, HedgeLatencyFactor * PrintLatency.GetPercentile(99.0));
+}
+
+// Expects the stateMutex to be held.
+void ChangeList::HedgeStalledBatches()
+{
+	const int64_t nowMs = NowMs();
+	const int64_t deadlineMs = GetStallDeadlineMs();
+
+	for (auto& batch : printBatches)
+	{
+		const int64_t lastAttemptAtMs = batch->lastAttemptAtMs;
+		if (batch->isComplete
+		    || lastAttemptAtMs == 0 // Still waiting for a free connection
+		    || nowMs - lastAttemptAtMs < deadlineMs
+		    || batch->attempts >= MaxPrintAttempts)
+		{
+			continue;
+		}
+
+		WARN("CL " << number << ": p4 print of " << batch->files.size() << " files stalled for "
+		           << (nowMs - lastAttemptAtMs) / 1000 << "s (deadline " << deadlineMs / 1000
+		           << "s), re-issuing it on another connection");
+
+		// The new attempt resets the stall timer, so that it gets the same deadline.
+		batch->lastAttemptAtMs = 0;
+		batch->attempts++;
+		std::shared_ptr<PrintBatch> hedgedBatch = batch;
+		ThreadPool::GetContentPool()->AddPriorityJob([this, hedgedBatch](P4API* p4)
+		    { RunPrintBatch(hedgedBatch, p4); });
+	}
+}
+
+void ChangeList::WaitWhileHedging(std::unique_lock<std::mutex>& lock, const std::function<bool()>& isDone)
+{
+	if (!HedgeStalledDownloads)
+	{
+		stateCV.wait(lock, isDone);
+		return;
+	}
+
+	// Acts as a watchdog over the batches blocking the commit of this CL.
+	while (!stateCV.wait_for(lock, std::chrono::seconds(1), isDone))
+	{
+		HedgeStalledBatches();
+	}
+}
+
+void ChangeList::WaitForDescribe()
+{
+	std::unique_lock<std::mutex> lock(stateMutex);
+	stateCV.wait(lock, [this]()
+	    { return state != Initialized; });
+}
+
+void ChangeList::TakeDownloadedFiles(const size_t& groupIndex, std::vector<size_t>& fileRows)
+{
+	std::unique_lock<std::mutex> lock(stateMutex);
+	WaitWhileHedging(lock, [this, &groupIndex]()
+	    { return groupIndex < downloadedFiles.size() && !downloadedFiles[groupIndex].empty(); });
+
+	std::vector<size_t>& groupFiles = downloadedFiles[groupIndex];
+	fileRows.insert(fileRows.end(), groupFiles.begin(), groupFiles.end());
+	groupFiles.clear();
 }
 
 void ChangeList::WaitForDownload()
 {
-	std::unique_lock<std::mutex> lock(*stateMutex);
-	stateCV->wait(lock, [this]()
+	std::unique_lock<std::mutex> lock(stateMutex);
+	WaitWhileHedging(lock, [this]()
 	    { return state == Downloaded; });
 }
 
+void ChangeList::Cancel()
+{
+	isCancelled = true;
+}
+
 void ChangeList::Clear()
 {
 	number.clear();
 	user.clear();
 	description.clear();
 	changedFileGroups->Clear();
+	printBatches.clear();
+	downloadedFiles.clear();
+	deduplicatedFiles.clear();
 
-	stateCV.reset();
-	stateMutex.reset();
 	filesDownloaded = -1;
+	printBatch = 0;
 	state = Freed;
 }
@@ -10,10 +10,41 @@
 #include <condition_variable>
 #include <atomic>
 #include <mutex>
+#include <functional>
 
 #include "common.h"
 #include "../branch_set.h"
+#include "utils/latency_tracker.h"
+#include "utils/timer.h"
 
+class P4API;
+class BlobTable;
+
+// A set of file revisions downloaded with a single `p4 print`.
+// The same batch may be issued more than once when it stalls; the
+// first attempt to finish wins and the others are aborted through
+// the KeepAlive callback or discarded.
+struct PrintBatch : public KeepAlive
+{
+	std::vector<std::string> files; // Revisions to print
+	// Row of each file in the changelist's file table. The rows past the
+	// revisions to print are of files found in the download cache, or
+	// committed from the blob of an earlier changelist.
+	std::vector<size_t> fileRows;
+	std::vector<size_t> fileGroups; // Index of the branch group of each file
+	std::vector<std::string> cacheKeys; // Download cache key of each revision to print, if the cache is enabled
+
+	std::atomic<bool> isComplete;
+	std::atomic<int> attempts;
+	std::atomic<int64_t> lastAttemptAtMs; // 0 while still queued
+
+	PrintBatch();
+
+	int IsAlive() override { return !isComplete; }
+};
+
+// A slot of the ring of changelists in flight, reused for the changelist
+// `lookAhead` positions later once its commit is done.
 struct ChangeList
 {
 	enum State
@@ -30,53 +61,67 @@ struct ChangeList
 	int64_t timestamp = 0;
 	std::unique_ptr<ChangedFileGroups> changedFileGroups = ChangedFileGroups::Empty();
 
-	std::unique_ptr<std::condition_variable> stateCV;
-	std::unique_ptr<std::mutex> stateMutex;
-	int filesDownloaded;
-	State state;
+	std::condition_variable stateCV;
+	std::mutex stateMutex;
+	int filesDownloaded = -1;
+	int printBatch = 0; // Non-zero once StartDownload() has been requested
+	State state = Initialized;
+	std::vector<std::shared_ptr<PrintBatch>> printBatches;
+	// Rows of the downloaded files of each branch group, not yet taken by the commit thread.
+	std::vector<std::vector<size_t>> downloadedFiles;
+	// By row, whether the file is not printed but committed from the blob
+	// of an earlier changelist with the same contents.
+	std::vector<bool> deduplicatedFiles;
+	// The contents already committed to the repository of the changelist,
+	// if they are deduplicated.
+	BlobTable* blobTable = nullptr;
+	// Set when the changelist is not going to be committed.
+	std::atomic<bool> isCancelled { false };
+
+	// Print latencies observed so far, used to detect stalled downloads.
+	static LatencyTracker PrintLatency;
+	// Re-issue a stalled print batch blocking the commit on another connection.
+	static bool HedgeStalledDownloads;
+	// Never consider a batch stalled before it has run for this long.
+	static int64_t HedgeMinDelayMs;
+	// A stalled batch is considered lost after running this many times the p99 print latency.
+	static const int HedgeLatencyFactor = 4;
+	// Upper bound on the concurrent attempts of a single batch.
+	static const int MaxPrintAttempts = 3;
 
-	ChangeList() = default; // Defaulted so that vector<ChangeList>::resize() can be used.
-	ChangeList(const std::string& number, const std::string& description, const std::string& user, const int64_t& timestamp);
+	ChangeList() = default;
 
 	ChangeList(const ChangeList& other) = delete;
 	ChangeList& operator=(const ChangeList&) = delete;
-	ChangeList(ChangeList&&) = default;
-	ChangeList& operator=(ChangeList&&) = default;
 	~ChangeList() = default;
 
+	// Takes the slot over for the next changelist. Expects the slot to be cleared.
+	void Reset(const std::string& number, const std::string& description, const std::string& user, const int64_t& timestamp);
+
 	void PrepareDownload(const BranchSet& branchSet);
-	void StartDownload(const int& printBatch);
-	void Flush(std::shared_ptr<std::vector<std::string>> printBatchFiles, std::shared_ptr<std::vector<FileData*>> printBatchFileData);
+	// Lists all the files of `paths` at the changelist instead of the files
+	// it changed, so that its commit has the whole tree at that point.
+	void PrepareSnapshot(const BranchSet& branchSet, const std::vector<std::string>& paths);
+	// Starts the download if it was requested before the files were known.
+	void OnDescribed();
+	void StartDownload(const int& printBatchSize);
+	void ScheduleBatches();
+	// Reads the files found in the download cache, and queues the batch
+	// to print the rest.
+	void Flush(std::shared_ptr<PrintBatch> batch);
+	void RunPrintBatch(std::shared_ptr<PrintBatch> batch, P4API* p4);
+	// Hands the files over to the commit thread.
+	void AddDownloadedFiles(const std::vector<size_t>& fileRows, const std::vector<size_t>& fileGroups);
+	int64_t GetStallDeadlineMs() const;
+	void HedgeStalledBatches();
+	void WaitWhileHedging(std::unique_lock<std::mutex>& lock, const std::function<bool()>& isDone);
+	void WaitForDescribe();
+	// Blocks until more files of the branch group are downloaded, in whichever
+	// order their batches finish, and moves them into `files`.
+	void TakeDownloadedFiles(const size_t& groupIndex, std::vector<size_t>& fileRows);
 	void WaitForDownload();
+	// Lets the describe and the print batches not started yet finish without
+	// running, so that the changelist is soon downloaded and can be cleared.
+	void Cancel();
 	void Clear();
-
-	friend bool operator==(ChangeList const& cl1, ChangeList const& cl2)
-	{
-		return cl1.timestamp == cl2.timestamp;
-	}
-
-	friend bool operator!=(ChangeList const& cl1, ChangeList const& cl2)
-	{
-		return !(cl1 == cl2);
-	}
-
-	friend bool operator<(ChangeList const& cl1, ChangeList const& cl2)
-	{
-		return cl1.timestamp < cl2.timestamp;
-	}
-
-	friend bool operator<=(ChangeList const& cl1, ChangeList const& cl2)
-	{
-		return (cl1 < cl2) || (cl1 == cl2);
-	}
-
-	friend bool operator>(ChangeList const& cl1, ChangeList const& cl2)
-	{
-		return cl2 < cl1;
-	}
-
-	friend bool operator>=(ChangeList const& cl1, ChangeList const& cl2)
-	{
-		return (cl1 > cl2) || (cl1 == cl2);
-	}
 };
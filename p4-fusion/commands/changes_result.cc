@@ -8,7 +8,7 @@
 
 void ChangesResult::OutputStat(StrDict* varList)
 {
-	m_Changes.emplace_back(
+	m_Changes.Add(
 	    varList->GetVar("change")->Text(),
 	    varList->GetVar("desc")->Text(),
 	    varList->GetVar("user")->Text(),
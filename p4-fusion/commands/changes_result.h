@@ -10,16 +10,16 @@
 
 #include "common.h"
 
-#include "change_list.h"
+#include "change_history.h"
 #include "result.h"
 
 class ChangesResult : public Result
 {
 private:
-	std::vector<ChangeList> m_Changes;
+	ChangeHistory m_Changes;
 
 public:
-	std::vector<ChangeList>& GetChanges() { return m_Changes; }
+	ChangeHistory& GetChanges() { return m_Changes; }
 
 	void OutputStat(StrDict* varList) override;
 };
@@ -6,18 +6,17 @@
  */
 #include "client_result.h"
 
+#include "tag_keys.h"
+
 void ClientResult::OutputStat(StrDict* varList)
 {
 	m_Data.client = varList->GetVar("Client")->Text();
 
-	int i = 0;
-	StrPtr* view = nullptr;
+	static thread_local TagKeys viewKeys("View");
 
-	while (true)
+	for (size_t i = 0;; i++)
 	{
-		std::string indexString = std::to_string(i++);
-		view = varList->GetVar(("View" + indexString).c_str());
-
+		StrPtr* view = varList->GetVar(viewKeys.Get(i));
 		if (!view)
 		{
 			break;
@@ -6,26 +6,69 @@
  */
 #include "describe_result.h"
 
+#include "tag_keys.h"
+
+void DescribeResult::ReadDescription(StrDict* varList)
+{
+	if (m_HasDescription)
+	{
+		return;
+	}
+
+	// The description arrives ahead of the files, so it is read from
+	// whichever of the partial or final dictionaries holds it first.
+	StrPtr* description = varList->GetVar("desc");
+	if (description)
+	{
+		m_Description = description->Text();
+		m_HasDescription = true;
+	}
+}
+
 void DescribeResult::OutputStat(StrDict* varList)
 {
+	ReadDescription(varList);
 }
 
 int DescribeResult::OutputStatPartial(StrDict* varList)
 {
-	std::string indexString = std::to_string(m_FileData.size());
+	ReadDescription(varList);
+
+	static thread_local TagKeys depotFileKeys("depotFile");
+	static thread_local TagKeys typeKeys("type");
+	static thread_local TagKeys revisionKeys("rev");
+	static thread_local TagKeys actionKeys("action");
+	static thread_local TagKeys digestKeys("digest");
+	static thread_local TagKeys fileSizeKeys("fileSize");
 
-	StrPtr* depotFile = varList->GetVar(("depotFile" + indexString).c_str());
+	const size_t index = m_Files.GetSize();
+
+	StrPtr* depotFile = varList->GetVar(depotFileKeys.Get(index));
 	if (!depotFile)
 	{
 		// Quick exit if the object returned is not a file
 		return 0;
 	}
-	std::string depotFileStr = depotFile->Text();
-	std::string type = varList->GetVar(("type" + indexString).c_str())->Text();
-	std::string revision = varList->GetVar(("rev" + indexString).c_str())->Text();
-	std::string action = varList->GetVar(("action" + indexString).c_str())->Text();
+	StrPtr* type = varList->GetVar(typeKeys.Get(index));
+	StrPtr* revision = varList->GetVar(revisionKeys.Get(index));
+	StrPtr* action = varList->GetVar(actionKeys.Get(index));
+
+	const size_t row = m_Files.AddFile(depotFile->Text(), depotFile->Length(),
+	    revision->Atoi(),
+	    FileTable::ParseAction(action->Text(), action->Length()),
+	    FileTable::ParseTypeFlags(type->Text(), type->Length()));
 
-	m_FileData.push_back(FileData(depotFileStr, revision, action, type));
+	// Not reported for deleted revisions.
+	StrPtr* digest = varList->GetVar(digestKeys.Get(index));
+	if (digest)
+	{
+		m_Files.SetDigest(row, digest->Text(), digest->Length());
+	}
+	StrPtr* fileSize = varList->GetVar(fileSizeKeys.Get(index));
+	if (fileSize)
+	{
+		m_Files.SetFileSize(row, fileSize->Atoi64());
+	}
 
 	return 1;
 }
@@ -10,16 +10,21 @@
 #include <string>
 
 #include "common.h"
-#include "file_data.h"
+#include "file_table.h"
 #include "result.h"
 
 class DescribeResult : public Result
 {
 private:
-	std::vector<FileData> m_FileData;
+	FileTable m_Files;
+	std::string m_Description;
+	bool m_HasDescription = false;
+
+	void ReadDescription(StrDict* varList);
 
 public:
-	const std::vector<FileData>& GetFileData() const { return m_FileData; }
+	FileTable& GetFileTable() { return m_Files; }
+	const std::string& GetDescription() const { return m_Description; }
 
 	void OutputStat(StrDict* varList) override;
 	int OutputStatPartial(StrDict* varList) override;
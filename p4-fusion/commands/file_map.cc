@@ -31,6 +31,20 @@ bool FileMap::IsInLeft(const std::string fileRevision) const
 	return joinResult != nullptr;
 }
 
+PathFilter FileMap::CompileLeft() const
+{
+	// MapAPI is poorly written and doesn't declare things as const when it should.
+	MapApi* ref = const_cast<MapApi*>(&m_map);
+
+	PathFilter filter(m_sensitivity == MapCase::Sensitive);
+	for (int i = 0; i < ref->Count(); i++)
+	{
+		// Overlay and one-to-many mappings include their paths just as well.
+		filter.AddRule(ref->GetLeft(i)->Text(), ref->GetType(i) == MapType::MapExclude ? PathFilter::Exclude : PathFilter::Include);
+	}
+	return filter;
+}
+
 bool FileMap::IsInRight(const std::string fileRevision) const
 {
 	StrBuf to;
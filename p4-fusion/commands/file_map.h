@@ -11,6 +11,7 @@
 #include <string>
 
 #include "common.h"
+#include "path_filter.h"
 
 struct FileMap
 {
@@ -26,6 +27,9 @@ public:
 	FileMap(const FileMap& src);
 
 	bool IsInLeft(const std::string fileRevision) const;
+	// Compiles the left side of the mapping into a filter answering
+	// IsInLeft for plain paths, without a MapApi join per path.
+	PathFilter CompileLeft() const;
 	bool IsInRight(const std::string fileRevision) const;
 
 	void SetCaseSensitivity(const MapCase mode);
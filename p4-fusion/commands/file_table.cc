@@ -0,0 +1,398 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "file_table.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "utils/std_helpers.h"
+
+const FileTable::PathID FileTable::NoPath;
+
+size_t FileTable::AddFile(const std::string& depotFile, const std::string& revision, const std::string& action, const std::string& type)
+{
+	return AddFile(depotFile.data(), depotFile.size(), std::atoi(revision.c_str()), ParseAction(action), ParseTypeFlags(type));
+}
+
+size_t FileTable::AddFile(const char* depotFile, const size_t& depotFileSize, const int& revision, const FileAction& action, const uint8_t& typeFlags)
+{
+	m_DepotFiles.push_back(PathInterner::GetSingleton()->Intern(depotFile, depotFileSize));
+	m_Revisions.push_back(revision);
+	m_Actions.push_back(action);
+	m_TypeFlags.push_back(typeFlags);
+	m_Digests.push_back(Digest {});
+	m_FileSizes.push_back(-1);
+	m_FromDepotFiles.push_back(NoPath);
+	m_FromRevisions.push_back(0);
+	m_RelativePaths.push_back(NoPath);
+	m_Contents.push_back(ContentBuffer());
+	return m_DepotFiles.size() - 1;
+}
+
+void FileTable::SetFromDepotFile(const size_t& row, const std::string& fromDepotFile, const std::string& fromRevision)
+{
+	// The revision may come as "#3"
+	const char* revision = fromRevision.c_str();
+	SetFromDepotFile(row, fromDepotFile.data(), fromDepotFile.size(), std::atoi(revision[0] == '#' ? revision + 1 : revision));
+}
+
+void FileTable::SetDigest(const size_t& row, const char* digest, const size_t& size)
+{
+	if (size != 2 * sizeof(Digest::bytes))
+	{
+		return;
+	}
+
+	Digest parsed = {};
+	for (size_t i = 0; i < size; i++)
+	{
+		const char c = digest[i];
+		int nibble;
+		if (c >= '0' && c <= '9')
+		{
+			nibble = c - '0';
+		}
+		else if (c >= 'A' && c <= 'F')
+		{
+			nibble = c - 'A' + 10;
+		}
+		else if (c >= 'a' && c <= 'f')
+		{
+			nibble = c - 'a' + 10;
+		}
+		else
+		{
+			return;
+		}
+		parsed.bytes[i / 2] |= nibble << (i % 2 == 0 ? 4 : 0);
+	}
+	m_Digests[row] = parsed;
+}
+
+void FileTable::SetFromDepotFile(const size_t& row, const char* fromDepotFile, const size_t& fromDepotFileSize, const int& fromRevision)
+{
+	m_FromDepotFiles[row] = PathInterner::GetSingleton()->Intern(fromDepotFile, fromDepotFileSize);
+	m_FromRevisions[row] = fromRevision;
+}
+
+template <typename T>
+static void ReorderColumn(std::vector<T>& column, const std::vector<size_t>& rows)
+{
+	std::vector<T> reordered;
+	reordered.reserve(rows.size());
+	for (const size_t& row : rows)
+	{
+		reordered.push_back(std::move(column[row]));
+	}
+	column = std::move(reordered);
+}
+
+void FileTable::Reorder(const std::vector<size_t>& rows)
+{
+	ReorderColumn(m_DepotFiles, rows);
+	ReorderColumn(m_Revisions, rows);
+	ReorderColumn(m_Actions, rows);
+	ReorderColumn(m_TypeFlags, rows);
+	ReorderColumn(m_Digests, rows);
+	ReorderColumn(m_FileSizes, rows);
+	ReorderColumn(m_FromDepotFiles, rows);
+	ReorderColumn(m_FromRevisions, rows);
+	ReorderColumn(m_RelativePaths, rows);
+	ReorderColumn(m_Contents, rows);
+}
+
+void FileTable::Clear()
+{
+	// Swap with empty columns to actually give the memory back.
+	std::vector<PathID>().swap(m_DepotFiles);
+	std::vector<int>().swap(m_Revisions);
+	std::vector<FileAction>().swap(m_Actions);
+	std::vector<uint8_t>().swap(m_TypeFlags);
+	std::vector<Digest>().swap(m_Digests);
+	std::vector<int64_t>().swap(m_FileSizes);
+	std::vector<PathID>().swap(m_FromDepotFiles);
+	std::vector<int>().swap(m_FromRevisions);
+	std::vector<PathID>().swap(m_RelativePaths);
+	std::vector<ContentBuffer>().swap(m_Contents);
+}
+
+std::string FileTable::GetDepotFileRevision(const size_t& row) const
+{
+	return GetDepotFile(row) + "#" + std::to_string(m_Revisions[row]);
+}
+
+bool FileTable::HasDigest(const size_t& row) const
+{
+	static const Digest unknown = {};
+	return std::memcmp(m_Digests[row].bytes, unknown.bytes, sizeof(unknown.bytes)) != 0;
+}
+
+std::string FileTable::GetDigest(const size_t& row) const
+{
+	static const char* digits = "0123456789ABCDEF";
+
+	if (!HasDigest(row))
+	{
+		return "";
+	}
+
+	std::string digest(2 * sizeof(Digest::bytes), '0');
+	for (size_t i = 0; i < sizeof(Digest::bytes); i++)
+	{
+		digest[2 * i] = digits[m_Digests[row].bytes[i] >> 4];
+		digest[2 * i + 1] = digits[m_Digests[row].bytes[i] & 0xf];
+	}
+	return digest;
+}
+
+std::string FileTable::GetFromDepotFile(const size_t& row) const
+{
+	return HasFromDepotFile(row) ? PathInterner::GetSingleton()->GetPath(m_FromDepotFiles[row]) : "";
+}
+
+std::string FileTable::GetRelativePath(const size_t& row) const
+{
+	return m_RelativePaths[row] != NoPath ? PathInterner::GetSingleton()->GetPath(m_RelativePaths[row]) : "";
+}
+
+bool FileTable::IsDeleted(const size_t& row) const
+{
+	switch (m_Actions[row])
+	{
+	case FileAction::FileDelete:
+	case FileAction::FileMoveDelete:
+	case FileAction::FilePurge:
+		// Note: not including FileAction::FileArchive
+		return true;
+
+	case FileAction::FileIntegrateDelete:
+		// This is the source of the integration,
+		//   so even though this causes a delete to happen,
+		//   as a source, there isn't something merging into this
+		//   change.
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+bool FileTable::IsIntegrated(const size_t& row) const
+{
+	switch (m_Actions[row])
+	{
+	case FileAction::FileBranch:
+	case FileAction::FileMoveAdd:
+	case FileAction::FileIntegrate:
+	case FileAction::FileImport:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+struct NamedAction
+{
+	const char* name;
+	FileAction action;
+};
+
+struct NamedType
+{
+	const char* name;
+	uint8_t flags;
+};
+
+// Perfect hashes of the known names, checked at compile time to place
+// every name in its own slot of the tables below. A name is recognized
+// after a single comparison with the entry of its slot.
+static constexpr size_t ActionSlots = 17;
+static constexpr size_t TypeSlots = 41;
+
+static constexpr size_t HashAction(const char* name, const size_t size)
+{
+	return ((unsigned char)name[0] + (unsigned char)name[size - 1]) % ActionSlots;
+}
+
+static constexpr size_t HashType(const char* name, const size_t size)
+{
+	return (4 * size + 2 * (unsigned char)name[0] + (unsigned char)name[size - 1]) % TypeSlots;
+}
+
+#define ACTION_SLOT(name, slot) static_assert(HashAction(name, sizeof(name) - 1) == slot, "Action " name " is not in its hash slot")
+ACTION_SLOT("import", 0);
+ACTION_SLOT(FAKE_INTEGRATION_DELETE_ACTION_NAME, 1);
+ACTION_SLOT("integrate", 2);
+ACTION_SLOT("move/add", 5);
+ACTION_SLOT("move/delete", 6);
+ACTION_SLOT("purge", 9);
+ACTION_SLOT("add", 10);
+ACTION_SLOT("archive", 11);
+ACTION_SLOT("edit", 13);
+ACTION_SLOT("delete", 14);
+ACTION_SLOT("branch", 15);
+#undef ACTION_SLOT
+
+static const NamedAction Actions[ActionSlots] = {
+	{ "import", FileAction::FileImport },
+	{ FAKE_INTEGRATION_DELETE_ACTION_NAME, FileAction::FileIntegrateDelete },
+	{ "integrate", FileAction::FileIntegrate },
+	{ nullptr, FileAction::FileEdit },
+	{ nullptr, FileAction::FileEdit },
+	{ "move/add", FileAction::FileMoveAdd },
+	{ "move/delete", FileAction::FileMoveDelete },
+	{ nullptr, FileAction::FileEdit },
+	{ nullptr, FileAction::FileEdit },
+	{ "purge", FileAction::FilePurge },
+	{ "add", FileAction::FileAdd },
+	{ "archive", FileAction::FileArchive },
+	{ nullptr, FileAction::FileEdit },
+	{ "edit", FileAction::FileEdit },
+	{ "delete", FileAction::FileDelete },
+	{ "branch", FileAction::FileBranch },
+	{ nullptr, FileAction::FileEdit },
+};
+
+// Base file types, current and from before the type modifiers were introduced.
+#define TYPE_SLOT(name, slot) static_assert(HashType(name, sizeof(name) - 1) == slot, "Type " name " is not in its hash slot")
+TYPE_SLOT("unicode", 35);
+TYPE_SLOT("utf16", 21);
+TYPE_SLOT("utf8", 19);
+TYPE_SLOT("text", 36);
+TYPE_SLOT("binary", 13);
+TYPE_SLOT("symlink", 37);
+TYPE_SLOT("apple", 28);
+TYPE_SLOT("resource", 33);
+TYPE_SLOT("xtext", 7);
+TYPE_SLOT("ktext", 22);
+TYPE_SLOT("kxtext", 26);
+TYPE_SLOT("xbinary", 20);
+TYPE_SLOT("ubinary", 14);
+TYPE_SLOT("uxbinary", 18);
+TYPE_SLOT("ctext", 6);
+TYPE_SLOT("cxtext", 10);
+TYPE_SLOT("ltext", 24);
+TYPE_SLOT("xltext", 11);
+TYPE_SLOT("tempobj", 38);
+TYPE_SLOT("ctempobj", 8);
+TYPE_SLOT("xtempobj", 9);
+TYPE_SLOT("xunicode", 4);
+#undef TYPE_SLOT
+
+static const NamedType Types[TypeSlots] = {
+	{ nullptr, 0 }, // 0
+	{ nullptr, 0 },
+	{ nullptr, 0 },
+	{ nullptr, 0 },
+	{ "xunicode", FileTable::TypeTranslated },
+	{ nullptr, 0 }, // 5
+	{ "ctext", 0 },
+	{ "xtext", 0 },
+	{ "ctempobj", 0 },
+	{ "xtempobj", 0 },
+	{ "cxtext", 0 }, // 10
+	{ "xltext", 0 },
+	{ nullptr, 0 },
+	{ "binary", FileTable::TypeBinary },
+	{ "ubinary", FileTable::TypeBinary },
+	{ nullptr, 0 }, // 15
+	{ nullptr, 0 },
+	{ nullptr, 0 },
+	{ "uxbinary", FileTable::TypeBinary },
+	{ "utf8", 0 },
+	{ "xbinary", FileTable::TypeBinary }, // 20
+	{ "utf16", FileTable::TypeTranslated },
+	{ "ktext", FileTable::TypeTranslated },
+	{ nullptr, 0 },
+	{ "ltext", 0 },
+	{ nullptr, 0 }, // 25
+	{ "kxtext", FileTable::TypeTranslated },
+	{ nullptr, 0 },
+	{ "apple", 0 },
+	{ nullptr, 0 },
+	{ nullptr, 0 }, // 30
+	{ nullptr, 0 },
+	{ nullptr, 0 },
+	{ "resource", 0 },
+	{ nullptr, 0 },
+	{ "unicode", FileTable::TypeTranslated }, // 35
+	{ "text", 0 },
+	{ "symlink", 0 },
+	{ "tempobj", 0 },
+	{ nullptr, 0 },
+	{ nullptr, 0 }, // 40
+};
+
+static bool IsNamed(const char* entry, const char* name, const size_t& size)
+{
+	return entry && std::strncmp(entry, name, size) == 0 && entry[size] == '\0';
+}
+
+uint8_t FileTable::ParseTypeFlags(const char* type, const size_t& size)
+{
+	// The type is a base type with optional modifiers, as in "text+kx".
+	const char* modifiers = (const char*)std::memchr(type, '+', size);
+	const size_t baseSize = modifiers ? modifiers - type : size;
+
+	uint8_t flags = 0;
+	if (baseSize > 0)
+	{
+		const NamedType& entry = Types[HashType(type, baseSize)];
+		if (IsNamed(entry.name, type, baseSize))
+		{
+			flags = entry.flags;
+		}
+		else if (STDHelpers::Contains(std::string(type, baseSize), "binary"))
+		{
+			flags = TypeBinary;
+		}
+	}
+	if (modifiers && modifiers + 1 < type + size && modifiers[1] == 'x')
+	{
+		flags |= TypeExecutable;
+	}
+	// Keyword expansion, as in "+k", "+ko" or "+kx".
+	if (modifiers && std::memchr(modifiers, 'k', type + size - modifiers))
+	{
+		flags |= TypeTranslated;
+	}
+	return flags;
+}
+
+FileAction FileTable::ParseAction(const char* name, const size_t& size)
+{
+	if (size > 0)
+	{
+		const NamedAction& entry = Actions[HashAction(name, size)];
+		if (IsNamed(entry.name, name, size))
+		{
+			return entry.action;
+		}
+	}
+
+	const std::string action(name, size);
+
+	// That's all the actions known at the time of writing.
+	// An unknown type, probably some future Perforce version with a new kind of action.
+	if (STDHelpers::Contains(action, "delete"))
+	{
+		// Looks like a delete.
+		WARN("Found an unsupported action " << action << "; assuming delete");
+		return FileAction::FileDelete;
+	}
+	if (STDHelpers::Contains(action, "move/"))
+	{
+		// Looks like a new kind of integrate.
+		WARN("Found an unsupported action " << action << "; assuming move/add");
+		return FileAction::FileMoveAdd;
+	}
+
+	// assume an edit, as it's the safe bet.
+	WARN("Found an unsupported action " << action << "; assuming edit");
+	return FileAction::FileEdit;
+}
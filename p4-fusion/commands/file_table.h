@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "common.h"
+#include "utils/content_buffer.h"
+#include "utils/path_interner.h"
+
+#define FAKE_INTEGRATION_DELETE_ACTION_NAME "FAKE merge delete"
+
+// See https://www.perforce.com/manuals/cmdref/Content/CmdRef/p4_fstat.html
+// for a list of actions.
+enum FileAction : uint8_t
+{
+	FileAdd, // add
+	FileEdit, // edit
+	FileDelete, // delete
+	FileBranch, // branch
+	FileMoveAdd, // move/add
+	FileMoveDelete, // move/delete
+	FileIntegrate, // integrate
+	FileImport, // import
+	FilePurge, // purge
+	FileArchive, // archive
+
+	FileIntegrateDelete, // artificial action to reflect an integration that happened that caused a delete
+};
+
+// The files affected by a changelist, stored column by column, so that
+// a changelist with hundreds of thousands of files takes a handful of
+// allocations instead of several per file. Files are addressed by row.
+// Different rows can be written to from different threads, as long as
+// no rows are added or removed meanwhile. Paths are held as ids of the
+// PathInterner.
+class FileTable
+{
+public:
+	typedef PathInterner::ID PathID;
+	static const PathID NoPath = UINT32_MAX;
+
+	enum TypeFlags : uint8_t
+	{
+		TypeBinary = 1 << 0,
+		TypeExecutable = 1 << 1,
+		// Printed differently than stored, so the digest is not of the
+		// printed contents, as with keyword expansion or UTF-16.
+		TypeTranslated = 1 << 2,
+	};
+
+	// MD5 of the file revision as reported by the server, all zeroes if unknown.
+	struct Digest
+	{
+		uint8_t bytes[16];
+	};
+
+private:
+	std::vector<PathID> m_DepotFiles;
+	std::vector<int> m_Revisions;
+	std::vector<FileAction> m_Actions;
+	std::vector<uint8_t> m_TypeFlags;
+	std::vector<Digest> m_Digests;
+	std::vector<int64_t> m_FileSizes; // -1 if unknown
+
+	// Only set for integration style changes, read from filelog.
+	std::vector<PathID> m_FromDepotFiles;
+	std::vector<int> m_FromRevisions;
+
+	// Path of the file in the Git repository.
+	std::vector<PathID> m_RelativePaths;
+
+	std::vector<ContentBuffer> m_Contents;
+
+public:
+	// Looked up in perfect hash tables of the names known to Perforce.
+	static FileAction ParseAction(const char* action, const size_t& size);
+	static FileAction ParseAction(const std::string& action) { return ParseAction(action.data(), action.size()); }
+	static uint8_t ParseTypeFlags(const char* type, const size_t& size);
+	static uint8_t ParseTypeFlags(const std::string& type) { return ParseTypeFlags(type.data(), type.size()); }
+
+	// Returns the row of the new file.
+	size_t AddFile(const std::string& depotFile, const std::string& revision, const std::string& action, const std::string& type);
+	// Adds a file from already decoded fields, without copying the depot path.
+	size_t AddFile(const char* depotFile, const size_t& depotFileSize, const int& revision, const FileAction& action, const uint8_t& typeFlags);
+	void SetFromDepotFile(const size_t& row, const std::string& fromDepotFile, const std::string& fromRevision);
+	void SetFromDepotFile(const size_t& row, const char* fromDepotFile, const size_t& fromDepotFileSize, const int& fromRevision);
+	// Takes the 32 hex digits reported by the server, and ignores anything else.
+	void SetDigest(const size_t& row, const char* digest, const size_t& size);
+	void SetFileSize(const size_t& row, const int64_t& fileSize) { m_FileSizes[row] = fileSize; }
+	void SetFakeIntegrationDeleteAction(const size_t& row) { m_Actions[row] = FileAction::FileIntegrateDelete; }
+	void SetRelativePath(const size_t& row, const PathID& relativePath) { m_RelativePaths[row] = relativePath; }
+	void SetContents(const size_t& row, ContentBuffer&& contents) { m_Contents[row] = std::move(contents); }
+	// No use for keeping the contents in memory once they are written to Git.
+	void ClearContents(const size_t& row) { m_Contents[row].Clear(); }
+
+	// Keeps only the given rows, in the given order.
+	void Reorder(const std::vector<size_t>& rows);
+	void Clear();
+
+	size_t GetSize() const { return m_DepotFiles.size(); }
+
+	PathID GetDepotFileID(const size_t& row) const { return m_DepotFiles[row]; }
+	std::string GetDepotFile(const size_t& row) const { return PathInterner::GetSingleton()->GetPath(m_DepotFiles[row]); }
+	int GetRevision(const size_t& row) const { return m_Revisions[row]; }
+	// The file revision in the "//depot/file#rev" format taken by p4 commands.
+	std::string GetDepotFileRevision(const size_t& row) const;
+	FileAction GetAction(const size_t& row) const { return m_Actions[row]; }
+	bool IsDeleted(const size_t& row) const;
+	bool IsIntegrated(const size_t& row) const; // ... or copied, or moved, or ...
+	bool IsBinary(const size_t& row) const { return m_TypeFlags[row] & TypeBinary; }
+	bool IsExecutable(const size_t& row) const { return m_TypeFlags[row] & TypeExecutable; }
+	bool IsTranslated(const size_t& row) const { return m_TypeFlags[row] & TypeTranslated; }
+	uint8_t GetTypeFlags(const size_t& row) const { return m_TypeFlags[row]; }
+	bool HasDigest(const size_t& row) const;
+	// In the uppercase hex format of the server, empty if unknown.
+	std::string GetDigest(const size_t& row) const;
+	const Digest& GetDigestBytes(const size_t& row) const { return m_Digests[row]; }
+	int64_t GetFileSize(const size_t& row) const { return m_FileSizes[row]; }
+
+	bool HasFromDepotFile(const size_t& row) const { return m_FromDepotFiles[row] != NoPath; }
+	PathID GetFromDepotFileID(const size_t& row) const { return m_FromDepotFiles[row]; }
+	std::string GetFromDepotFile(const size_t& row) const;
+	int GetFromRevision(const size_t& row) const { return m_FromRevisions[row]; }
+
+	PathID GetRelativePathID(const size_t& row) const { return m_RelativePaths[row]; }
+	std::string GetRelativePath(const size_t& row) const;
+	const ContentBuffer& GetContents(const size_t& row) const { return m_Contents[row]; }
+};
@@ -6,6 +6,11 @@
  */
 #include "filelog_result.h"
 
+#include <cstring>
+#include <cstdlib>
+
+#include "tag_keys.h"
+
 // Should be called once per varlist.  Each filelog file
 //   is its own entry.
 void FileLogResult::OutputStat(StrDict* varList)
@@ -16,32 +21,45 @@ void FileLogResult::OutputStat(StrDict* varList)
 		// Quick exit if the object returned is not a file
 		return;
 	}
-	std::string depotFileStr = depotFile->Text();
 	// Only get the first record...
 	// std::string changelist = varList->GetVar(("change0").c_str())->Text();
-	std::string type = varList->GetVar("type0")->Text();
-	std::string revision = varList->GetVar("rev0")->Text();
-	std::string action = varList->GetVar("action0")->Text();
+	StrPtr* type = varList->GetVar("type0");
+	StrPtr* revision = varList->GetVar("rev0");
+	StrPtr* action = varList->GetVar("action0");
 
-	m_FileData.push_back(FileData(depotFileStr, revision, action, type));
-	FileData& fileData = m_FileData.back();
+	const size_t row = m_Files.AddFile(depotFile->Text(), depotFile->Length(),
+	    revision->Atoi(),
+	    FileTable::ParseAction(action->Text(), action->Length()),
+	    FileTable::ParseTypeFlags(type->Text(), type->Length()));
+
+	StrPtr* digest = varList->GetVar("digest0");
+	if (digest)
+	{
+		m_Files.SetDigest(row, digest->Text(), digest->Length());
+	}
+	StrPtr* fileSize = varList->GetVar("fileSize0");
+	if (fileSize)
+	{
+		m_Files.SetFileSize(row, fileSize->Atoi64());
+	}
+
+	static thread_local TagKeys howKeys("how0,");
+	static thread_local TagKeys fileKeys("file0,");
+	static thread_local TagKeys endRevisionKeys("erev0,");
 
 	// Could optimize here by only performing this loop if the action type is
 	//   an integration style action (entry->isIntegration == true).
 	//   That needs testing, though.
-	int i = 0;
-	StrPtr* how = nullptr;
-	while (true)
+	for (size_t i = 0;; i++)
 	{
-		std::string indexString = std::to_string(i++);
-		how = varList->GetVar(("how0," + indexString).c_str());
-
+		StrPtr* how = varList->GetVar(howKeys.Get(i));
 		if (!how)
 		{
 			break;
 		}
 
-		std::string howStr = how->Text();
+		const char* howStr = how->Text();
+		const size_t howSize = how->Length();
 
 		// How text values listed at:
 		// https://www.perforce.com/manuals/cmdref/Content/CmdRef/p4_integrated.html
@@ -59,19 +77,20 @@ void FileLogResult::OutputStat(StrDict* varList)
 		// "undone by" - the "* into" concept for "undid" (source of p4 undo)
 		// "Undone w/Edit"
 
-		if (howStr == "delete from")
+		if (std::strcmp(howStr, "delete from") == 0)
 		{
 			// The action needs to be marked as something very clearly a delete.
-			// See file_data.h and file_data.cc for this special replaced action.
-			fileData.SetFakeIntegrationDeleteAction();
+			// See file_table.h and file_table.cc for this special replaced action.
+			m_Files.SetFakeIntegrationDeleteAction(row);
 		}
 
-		if (STDHelpers::EndsWith(howStr, " from"))
+		if (howSize >= 5 && std::strcmp(howStr + howSize - 5, " from") == 0)
 		{
 			// copy or integrate or branch or move or archive from a location.
-			std::string fromDepotFile = varList->GetVar(("file0," + indexString).c_str())->Text();
-			std::string fromRev = varList->GetVar(("erev0," + indexString).c_str())->Text();
-			fileData.SetFromDepotFile(fromDepotFile, fromRev);
+			StrPtr* fromDepotFile = varList->GetVar(fileKeys.Get(i));
+			// The revision comes as "#3"
+			const char* fromRevision = varList->GetVar(endRevisionKeys.Get(i))->Text();
+			m_Files.SetFromDepotFile(row, fromDepotFile->Text(), fromDepotFile->Length(), std::atoi(fromRevision[0] == '#' ? fromRevision + 1 : fromRevision));
 
 			// Don't look for any other integration history; there can (should?) be at most one.
 			break;
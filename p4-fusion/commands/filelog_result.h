@@ -11,17 +11,17 @@
 
 #include "common.h"
 #include "result.h"
-#include "file_data.h"
+#include "file_table.h"
 #include "utils/std_helpers.h"
 
 // Very limited to just a single file log entry per file.
 class FileLogResult : public Result
 {
 private:
-	std::vector<FileData> m_FileData;
+	FileTable m_Files;
 
 public:
-	const std::vector<FileData>& GetFileData() const { return m_FileData; }
+	FileTable& GetFileTable() { return m_Files; }
 
 	void OutputStat(StrDict* varList) override;
 	// int OutputStatPartial(StrDict* varList) override;
@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "files_result.h"
+
+void FilesResult::OutputStat(StrDict* varList)
+{
+	StrPtr* depotFile = varList->GetVar("depotFile");
+	if (!depotFile)
+	{
+		// Quick exit if the object returned is not a file
+		return;
+	}
+	StrPtr* type = varList->GetVar("type");
+	StrPtr* revision = varList->GetVar("rev");
+	StrPtr* action = varList->GetVar("action");
+
+	m_Files.AddFile(depotFile->Text(), depotFile->Length(),
+	    revision->Atoi(),
+	    FileTable::ParseAction(action->Text(), action->Length()),
+	    FileTable::ParseTypeFlags(type->Text(), type->Length()));
+}
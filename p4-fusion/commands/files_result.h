@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "common.h"
+#include "result.h"
+#include "file_table.h"
+
+// The revisions of the files present at a changelist.
+class FilesResult : public Result
+{
+private:
+	FileTable m_Files;
+
+public:
+	FileTable& GetFileTable() { return m_Files; }
+
+	void OutputStat(StrDict* varList) override;
+};
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "path_filter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+const int PathFilter::NoRule;
+
+static const uint32_t NoNode = UINT32_MAX;
+
+PathFilter::PathFilter(const bool caseSensitive)
+    : m_CaseSensitive(caseSensitive)
+{
+	// The root of the trie.
+	m_Nodes.push_back(Node());
+}
+
+char PathFilter::Fold(const char& c) const
+{
+	return m_CaseSensitive ? c : (char)std::tolower((unsigned char)c);
+}
+
+uint32_t PathFilter::FindChild(const uint32_t& node, const char& c) const
+{
+	const std::vector<std::pair<char, uint32_t>>& children = m_Nodes[node].children;
+	auto found = std::lower_bound(children.begin(), children.end(), c, [](const std::pair<char, uint32_t>& child, const char& value)
+	    { return child.first < value; });
+	if (found == children.end() || found->first != c)
+	{
+		return NoNode;
+	}
+	return found->second;
+}
+
+void PathFilter::AddRule(const std::string& pattern, const RuleType& type)
+{
+	const int ruleIndex = m_Rules.size();
+	m_Rules.push_back(Rule());
+	Rule& rule = m_Rules.back();
+	rule.type = type;
+
+	// Walk down the literal prefix, up to the first wildcard.
+	uint32_t node = 0;
+	size_t i = 0;
+	for (; i < pattern.size(); i++)
+	{
+		const char c = pattern[i];
+		if (c == '*' || pattern.compare(i, 3, "...") == 0 || pattern.compare(i, 2, "%%") == 0)
+		{
+			break;
+		}
+
+		const char folded = Fold(c);
+		uint32_t child = FindChild(node, folded);
+		if (child == NoNode)
+		{
+			child = m_Nodes.size();
+			std::vector<std::pair<char, uint32_t>>& children = m_Nodes[node].children;
+			children.insert(std::upper_bound(children.begin(), children.end(), std::make_pair(folded, (uint32_t)0), [](const std::pair<char, uint32_t>& value, const std::pair<char, uint32_t>& existing)
+			                    { return value.first < existing.first; }),
+			    std::make_pair(folded, child));
+			// Only push after the insertion, since it may move the nodes.
+			m_Nodes.push_back(Node());
+		}
+		node = child;
+	}
+
+	// The rest of the pattern becomes tokens.
+	while (i < pattern.size())
+	{
+		if (pattern.compare(i, 3, "...") == 0)
+		{
+			rule.tokens.push_back(Token { Ellipsis, "" });
+			i += 3;
+		}
+		else if (pattern[i] == '*')
+		{
+			rule.tokens.push_back(Token { Star, "" });
+			i++;
+		}
+		else if (pattern.compare(i, 2, "%%") == 0 && i + 2 < pattern.size() && std::isdigit((unsigned char)pattern[i + 2]))
+		{
+			rule.tokens.push_back(Token { Star, "" });
+			i += 3;
+		}
+		else
+		{
+			if (rule.tokens.empty() || rule.tokens.back().type != Literal)
+			{
+				rule.tokens.push_back(Token { Literal, "" });
+			}
+			rule.tokens.back().text += Fold(pattern[i]);
+			i++;
+		}
+	}
+	rule.isPrefix = rule.tokens.size() == 1 && rule.tokens.front().type == Ellipsis;
+
+	// Latest first, which is the order the rules are tried in.
+	std::vector<int>& rules = m_Nodes[node].rules;
+	rules.insert(rules.begin(), ruleIndex);
+}
+
+bool PathFilter::MatchTokens(const std::vector<Token>& tokens, const size_t& token, const char* path, const size_t& size) const
+{
+	if (token == tokens.size())
+	{
+		return size == 0;
+	}
+
+	const Token& current = tokens[token];
+	switch (current.type)
+	{
+	case Literal:
+	{
+		if (size < current.text.size())
+		{
+			return false;
+		}
+		for (size_t i = 0; i < current.text.size(); i++)
+		{
+			if (Fold(path[i]) != current.text[i])
+			{
+				return false;
+			}
+		}
+		return MatchTokens(tokens, token + 1, path + current.text.size(), size - current.text.size());
+	}
+	case Star:
+	case Ellipsis:
+	{
+		if (token + 1 == tokens.size())
+		{
+			// A trailing wildcard takes the rest of the path.
+			return current.type == Ellipsis || std::memchr(path, '/', size) == nullptr;
+		}
+		for (size_t taken = 0; taken <= size; taken++)
+		{
+			if (MatchTokens(tokens, token + 1, path + taken, size - taken))
+			{
+				return true;
+			}
+			if (taken < size && current.type == Star && path[taken] == '/')
+			{
+				return false;
+			}
+		}
+		return false;
+	}
+	}
+	return false;
+}
+
+int PathFilter::Match(const char* path, const size_t& size) const
+{
+	int best = NoRule;
+	uint32_t node = 0;
+	for (size_t i = 0;; i++)
+	{
+		// Rules are listed latest first, so anything after a match can't beat it.
+		for (const int& rule : m_Nodes[node].rules)
+		{
+			if (rule <= best)
+			{
+				break;
+			}
+
+			const Rule& candidate = m_Rules[rule];
+			if (candidate.isPrefix || MatchTokens(candidate.tokens, 0, path + i, size - i))
+			{
+				best = rule;
+				break;
+			}
+		}
+
+		if (i == size)
+		{
+			break;
+		}
+		node = FindChild(node, Fold(path[i]));
+		if (node == NoNode)
+		{
+			break;
+		}
+	}
+	return best;
+}
+
+bool PathFilter::IsIncluded(const std::string& path) const
+{
+	const int rule = Match(path);
+	return rule != NoRule && m_Rules[rule].type == Include;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Matches paths against an ordered list of Perforce path patterns, where
+// "..." matches anything, "*" and "%%1" anything but a '/', and the last
+// matching pattern wins, as in a client view. The patterns are compiled
+// into a trie of their literal prefixes, each rule holding the tokens of
+// the rest of its pattern, so that a path is matched in one walk over its
+// characters instead of being tested against every pattern. Immutable once
+// built, and safe to share between threads.
+class PathFilter
+{
+public:
+	enum RuleType : uint8_t
+	{
+		Include,
+		Exclude,
+	};
+
+	static const int NoRule = -1;
+
+private:
+	enum TokenType : uint8_t
+	{
+		Literal,
+		Star, // "*" or "%%n", anything but a '/'
+		Ellipsis, // "...", anything
+	};
+
+	struct Token
+	{
+		TokenType type;
+		std::string text; // Only for literals
+	};
+
+	struct Rule
+	{
+		RuleType type;
+		// What is left of the pattern after its literal prefix.
+		std::vector<Token> tokens;
+		// Whether the pattern is its literal prefix followed by a "...", which
+		// makes any path reaching the end of the prefix a match.
+		bool isPrefix;
+	};
+
+	struct Node
+	{
+		// Children sorted by character.
+		std::vector<std::pair<char, uint32_t>> children;
+		// Rules with a literal prefix ending at this node, latest first.
+		std::vector<int> rules;
+	};
+
+	bool m_CaseSensitive;
+	std::vector<Rule> m_Rules;
+	std::vector<Node> m_Nodes;
+
+	char Fold(const char& c) const;
+	uint32_t FindChild(const uint32_t& node, const char& c) const;
+	bool MatchTokens(const std::vector<Token>& tokens, const size_t& token, const char* path, const size_t& size) const;
+
+public:
+	explicit PathFilter(const bool caseSensitive = true);
+
+	// Rules added later take precedence over the earlier ones.
+	void AddRule(const std::string& pattern, const RuleType& type);
+
+	// Returns the index of the last added rule matching the whole path, or NoRule.
+	int Match(const char* path, const size_t& size) const;
+	int Match(const std::string& path) const { return Match(path.data(), path.size()); }
+
+	// Is the path matched by an include rule not overridden by a later exclude rule?
+	bool IsIncluded(const std::string& path) const;
+
+	size_t GetRuleCount() const { return m_Rules.size(); }
+	bool IsEmpty() const { return m_Rules.empty(); }
+};
@@ -6,15 +6,25 @@
  */
 #include "print_result.h"
 
+#include <cstdlib>
+
 void PrintResult::OutputStat(StrDict* varList)
 {
 	m_Data.push_back(PrintData {});
+
+	// The contents arrive in chunks; size the buffer upfront so that
+	// the chunks are only copied once. The size is a hint, since text
+	// files can differ on line endings or expanded keywords.
+	StrPtr* fileSize = varList->GetVar("fileSize");
+	if (fileSize)
+	{
+		m_Data.back().contents.Reserve(std::strtoull(fileSize->Text(), nullptr, 10));
+	}
 }
 
 void PrintResult::OutputText(const char* data, int length)
 {
-	std::vector<char>& fileContent = m_Data.back().contents;
-	fileContent.insert(fileContent.end(), data, data + length);
+	m_Data.back().contents.Append(data, length);
 }
 
 void PrintResult::OutputBinary(const char* data, int length)
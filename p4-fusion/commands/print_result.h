@@ -10,13 +10,14 @@
 
 #include "common.h"
 #include "result.h"
+#include "utils/content_buffer.h"
 
 class PrintResult : public Result
 {
 public:
 	struct PrintData
 	{
-		std::vector<char> contents;
+		ContentBuffer contents;
 	};
 
 private:
@@ -24,6 +25,8 @@ private:
 
 public:
 	const std::vector<PrintData>& GetPrintData() const { return m_Data; }
+	// Lets the contents be moved out of the results.
+	std::vector<PrintData>& GetPrintData() { return m_Data; }
 
 	void OutputStat(StrDict* varList) override;
 	void OutputText(const char* data, int length) override;
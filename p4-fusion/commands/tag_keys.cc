@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "tag_keys.h"
+
+#include <cstdio>
+
+TagKeys::TagKeys(const std::string& prefix)
+    : m_Prefix(prefix)
+    , m_Buffer(prefix.size() + 24)
+{
+}
+
+const StrPtr& TagKeys::Get(const size_t& index)
+{
+	if (index >= CachedCount)
+	{
+		const int size = std::snprintf(m_Buffer.data(), m_Buffer.size(), "%s%zu", m_Prefix.c_str(), index);
+		m_BufferKey.Set(m_Buffer.data(), size);
+		return m_BufferKey;
+	}
+
+	while (m_Keys.size() <= index)
+	{
+		// Deques never move their elements, so the keys keep pointing at their names.
+		m_Names.push_back(m_Prefix + std::to_string(m_Keys.size()));
+		m_Keys.emplace_back();
+		m_Keys.back().Set(m_Names.back().c_str(), m_Names.back().size());
+	}
+	return m_Keys[index];
+}
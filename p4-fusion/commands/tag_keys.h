@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <string>
+#include <deque>
+#include <vector>
+
+#include "common.h"
+
+// Tagged output names the fields of the n-th entry of a record by
+// suffixing the index, as in "depotFile0" or "how0,1". The names of the
+// first entries are built once and looked up by index afterwards, so that
+// decoding a record builds no strings. Names past those are formatted into
+// a buffer of the table instead, so that a single huge record does not pin
+// a name per entry for as long as the thread lives. Not thread-safe, use
+// one table per thread.
+class TagKeys
+{
+	const std::string m_Prefix;
+	std::deque<std::string> m_Names;
+	std::deque<StrRef> m_Keys;
+	std::vector<char> m_Buffer;
+	StrRef m_BufferKey;
+
+public:
+	static const size_t CachedCount = 4096;
+
+	explicit TagKeys(const std::string& prefix);
+
+	TagKeys(const TagKeys&) = delete;
+	TagKeys& operator=(const TagKeys&) = delete;
+
+	// The key of the entry at `index`. Keys from CachedCount on are only
+	// valid until the next call.
+	const StrPtr& Get(const size_t& index);
+};
@@ -0,0 +1,491 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "commit_index.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static_assert(sizeof(CommitIndex::Record) == 40, "Records are read from the file as they are laid out in memory");
+
+const size_t CommitIndex::OIDsRefreshCount;
+
+bool CommitIndex::OID::operator==(const OID& other) const
+{
+	return memcmp(bytes, other.bytes, sizeof(bytes)) == 0;
+}
+
+size_t CommitIndex::OIDHash::operator()(const OID& oid) const
+{
+	// The OID is already well distributed.
+	size_t hash = 0;
+	memcpy(&hash, oid.bytes, sizeof(hash));
+	return hash;
+}
+
+static bool ParseOID(const std::string& hex, uint8_t* oid)
+{
+	if (hex.size() != 40)
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < 20; i++)
+	{
+		int byte = 0;
+		for (size_t j = 0; j < 2; j++)
+		{
+			const char c = hex[2 * i + j];
+			int nibble;
+			if (c >= '0' && c <= '9')
+			{
+				nibble = c - '0';
+			}
+			else if (c >= 'a' && c <= 'f')
+			{
+				nibble = c - 'a' + 10;
+			}
+			else if (c >= 'A' && c <= 'F')
+			{
+				nibble = c - 'A' + 10;
+			}
+			else
+			{
+				return false;
+			}
+			byte = (byte << 4) | nibble;
+		}
+		oid[i] = byte;
+	}
+	return true;
+}
+
+static std::string FormatOID(const uint8_t* oid)
+{
+	static const char* digits = "0123456789abcdef";
+
+	std::string hex(40, '0');
+	for (size_t i = 0; i < 20; i++)
+	{
+		hex[2 * i] = digits[oid[i] >> 4];
+		hex[2 * i + 1] = digits[oid[i] & 0xf];
+	}
+	return hex;
+}
+
+static bool WriteAll(const int& fd, const void* data, const size_t& size)
+{
+	size_t written = 0;
+	while (written < size)
+	{
+		const ssize_t result = write(fd, (const char*)data + written, size - written);
+		if (result < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return false;
+		}
+		written += result;
+	}
+	return true;
+}
+
+// Maps the first `size` bytes of the file, which must not be empty.
+static const void* MapFile(const int& fd, const size_t& size)
+{
+	void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	return data == MAP_FAILED ? nullptr : data;
+}
+
+std::string CommitIndex::GetCommitsPath(const std::string& repoPath)
+{
+	return repoPath + (repoPath.back() == '/' ? "" : "/") + "p4-fusion-commits";
+}
+
+std::string CommitIndex::GetBranchesPath(const std::string& repoPath)
+{
+	return repoPath + (repoPath.back() == '/' ? "" : "/") + "p4-fusion-branches";
+}
+
+std::string CommitIndex::GetOIDsPath(const std::string& repoPath)
+{
+	return repoPath + (repoPath.back() == '/' ? "" : "/") + "p4-fusion-oids";
+}
+
+CommitIndex::CommitIndex()
+    : m_IsWritable(false)
+    , m_FsyncEnable(false)
+    , m_CommitsFd(-1)
+    , m_MappedRecords(nullptr)
+    , m_MappedRecordsSize(0)
+    , m_MappedCount(0)
+    , m_MappedOIDs(nullptr)
+    , m_MappedOIDCount(0)
+{
+}
+
+CommitIndex::~CommitIndex()
+{
+	Close();
+}
+
+bool CommitIndex::Open(const std::string& repoPath, const bool writable, const bool fsyncEnable)
+{
+	Close();
+
+	m_RepoPath = repoPath;
+	m_IsWritable = writable;
+	m_FsyncEnable = fsyncEnable;
+
+	// Only branch names completed by a newline were fully written.
+	const std::string branchesPath = GetBranchesPath(repoPath);
+	std::ifstream branchesFile(branchesPath, std::ios::binary);
+	const std::string branches((std::istreambuf_iterator<char>(branchesFile)), std::istreambuf_iterator<char>());
+	size_t branchStart = 0;
+	for (size_t branchEnd = branches.find('\n'); branchEnd != std::string::npos; branchEnd = branches.find('\n', branchStart))
+	{
+		const std::string branch = branches.substr(branchStart, branchEnd - branchStart);
+		m_BranchIDs[branch] = m_Branches.size();
+		m_Branches.push_back(branch);
+		branchStart = branchEnd + 1;
+	}
+	if (writable && branchStart != branches.size() && truncate(branchesPath.c_str(), branchStart) != 0)
+	{
+		ERR("Could not truncate " << branchesPath << ": " << strerror(errno));
+		return false;
+	}
+
+	const std::string commitsPath = GetCommitsPath(repoPath);
+	m_CommitsFd = open(commitsPath.c_str(), writable ? (O_RDWR | O_CREAT | O_APPEND) : O_RDONLY, 0644);
+	if (m_CommitsFd < 0)
+	{
+		if (writable)
+		{
+			ERR("Could not open " << commitsPath << ": " << strerror(errno));
+		}
+		return false;
+	}
+
+	struct stat commitsStat;
+	if (fstat(m_CommitsFd, &commitsStat) != 0)
+	{
+		ERR("Could not read the size of " << commitsPath << ": " << strerror(errno));
+		Close();
+		return false;
+	}
+
+	// A crash while appending can leave a partial record at the end, and
+	// a record can only refer to a branch written out before it.
+	size_t count = commitsStat.st_size / sizeof(Record);
+	if (count > 0)
+	{
+		m_MappedRecords = (const Record*)MapFile(m_CommitsFd, count * sizeof(Record));
+		if (!m_MappedRecords)
+		{
+			ERR("Could not map " << commitsPath << ": " << strerror(errno));
+			Close();
+			return false;
+		}
+		m_MappedRecordsSize = count * sizeof(Record);
+		while (count > 0 && m_MappedRecords[count - 1].branch >= m_Branches.size())
+		{
+			count--;
+		}
+	}
+	m_MappedCount = count;
+
+	if (writable && (size_t)commitsStat.st_size != count * sizeof(Record))
+	{
+		WARN("Dropping an incomplete record at the end of " << commitsPath);
+		if (ftruncate(m_CommitsFd, count * sizeof(Record)) != 0)
+		{
+			ERR("Could not truncate " << commitsPath << ": " << strerror(errno));
+			Close();
+			return false;
+		}
+	}
+
+	// The sorted OIDs cover the records as of the last Close, so they
+	// never cover more records than there are.
+	const std::string oidsPath = GetOIDsPath(repoPath);
+	const int oidsFd = open(oidsPath.c_str(), O_RDONLY);
+	if (oidsFd >= 0)
+	{
+		struct stat oidsStat;
+		if (fstat(oidsFd, &oidsStat) == 0)
+		{
+			const size_t oidCount = oidsStat.st_size / sizeof(OIDEntry);
+			if (oidCount > 0 && oidCount <= m_MappedCount && (size_t)oidsStat.st_size == oidCount * sizeof(OIDEntry))
+			{
+				m_MappedOIDs = (const OIDEntry*)MapFile(oidsFd, oidCount * sizeof(OIDEntry));
+				m_MappedOIDCount = m_MappedOIDs ? oidCount : 0;
+			}
+		}
+		// The mapping stays valid after the file is closed.
+		close(oidsFd);
+	}
+
+	for (size_t i = m_MappedOIDCount; i < m_MappedCount; i++)
+	{
+		OID oid;
+		memcpy(oid.bytes, m_MappedRecords[i].oid, sizeof(oid.bytes));
+		m_UnsortedOIDs[oid] = i;
+	}
+
+	return true;
+}
+
+void CommitIndex::Close()
+{
+	if (m_CommitsFd >= 0 && m_IsWritable && m_MappedOIDCount < GetSize() && !writeOIDs())
+	{
+		WARN("Could not update " << GetOIDsPath(m_RepoPath) << ", lookups by commit will be slower on the next run");
+	}
+
+	if (m_MappedRecords)
+	{
+		munmap((void*)m_MappedRecords, m_MappedRecordsSize);
+		m_MappedRecords = nullptr;
+	}
+	if (m_MappedOIDs)
+	{
+		munmap((void*)m_MappedOIDs, m_MappedOIDCount * sizeof(OIDEntry));
+		m_MappedOIDs = nullptr;
+	}
+	if (m_CommitsFd >= 0)
+	{
+		close(m_CommitsFd);
+		m_CommitsFd = -1;
+	}
+
+	m_MappedRecordsSize = 0;
+	m_MappedCount = 0;
+	m_MappedOIDCount = 0;
+	m_AppendedRecords.clear();
+	m_UnsortedOIDs.clear();
+	m_Branches.clear();
+	m_BranchIDs.clear();
+}
+
+bool CommitIndex::Append(const std::string& cl, const std::string& branch, const std::string& oid)
+{
+	if (m_CommitsFd < 0 || !m_IsWritable)
+	{
+		return false;
+	}
+
+	Record record = {};
+	record.cl = std::stoll(cl);
+	if (!ParseOID(oid, record.oid))
+	{
+		ERR("Not a commit OID: " << oid);
+		return false;
+	}
+	if (!IsEmpty() && record.cl < getRecord(GetSize() - 1).cl)
+	{
+		ERR("CL " << cl << " was committed after CL " << getRecord(GetSize() - 1).cl << ", it cannot be added to the commit index");
+		return false;
+	}
+
+	auto branchIt = m_BranchIDs.find(branch);
+	if (branchIt == m_BranchIDs.end())
+	{
+		// The branch is written out before any record refers to it.
+		std::ofstream branches(GetBranchesPath(m_RepoPath), std::ios::app);
+		branches << branch << "\n";
+		branches.close();
+		if (!branches)
+		{
+			ERR("Could not add branch " << branch << " to " << GetBranchesPath(m_RepoPath));
+			return false;
+		}
+
+		branchIt = m_BranchIDs.insert({ branch, m_Branches.size() }).first;
+		m_Branches.push_back(branch);
+	}
+	record.branch = branchIt->second;
+
+	if (!WriteAll(m_CommitsFd, &record, sizeof(record)) || (m_FsyncEnable && fsync(m_CommitsFd) != 0))
+	{
+		ERR("Could not append to " << GetCommitsPath(m_RepoPath) << ": " << strerror(errno));
+		return false;
+	}
+
+	OID appendedOID;
+	memcpy(appendedOID.bytes, record.oid, sizeof(appendedOID.bytes));
+	m_UnsortedOIDs[appendedOID] = GetSize();
+	m_AppendedRecords.push_back(record);
+
+	// Tried again after as many records if it fails.
+	if (m_UnsortedOIDs.size() % OIDsRefreshCount == 0 && !refreshOIDs())
+	{
+		WARN("Could not update " << GetOIDsPath(m_RepoPath) << ", the commits appended since are kept in memory");
+	}
+	return true;
+}
+
+std::vector<CommitIndex::Commit> CommitIndex::FindCommits(const std::string& cl) const
+{
+	const int64_t number = std::stoll(cl);
+
+	// Lower bound of the CL over the mapped and the appended records.
+	size_t low = 0;
+	size_t high = GetSize();
+	while (low < high)
+	{
+		const size_t middle = low + (high - low) / 2;
+		if (getRecord(middle).cl < number)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	std::vector<Commit> commits;
+	for (size_t i = low; i < GetSize() && getRecord(i).cl == number; i++)
+	{
+		commits.push_back(toCommit(getRecord(i)));
+	}
+	return commits;
+}
+
+std::string CommitIndex::FindCommit(const std::string& cl, const std::string& branch) const
+{
+	for (const Commit& commit : FindCommits(cl))
+	{
+		if (commit.branch == branch)
+		{
+			return commit.oid;
+		}
+	}
+	return "";
+}
+
+bool CommitIndex::FindChange(const std::string& oid, Commit& commit) const
+{
+	OIDEntry key = {};
+	if (!ParseOID(oid, key.oid))
+	{
+		return false;
+	}
+
+	const OIDEntry* end = m_MappedOIDs + m_MappedOIDCount;
+	const OIDEntry* entry = std::lower_bound(m_MappedOIDs, end, key, [](const OIDEntry& a, const OIDEntry& b)
+	    { return memcmp(a.oid, b.oid, sizeof(a.oid)) < 0; });
+	if (m_MappedOIDs && entry != end && memcmp(entry->oid, key.oid, sizeof(key.oid)) == 0)
+	{
+		commit = toCommit(getRecord(entry->record));
+		return true;
+	}
+
+	OID unsortedKey;
+	memcpy(unsortedKey.bytes, key.oid, sizeof(unsortedKey.bytes));
+	auto unsortedIt = m_UnsortedOIDs.find(unsortedKey);
+	if (unsortedIt != m_UnsortedOIDs.end())
+	{
+		commit = toCommit(getRecord(unsortedIt->second));
+		return true;
+	}
+
+	return false;
+}
+
+const CommitIndex::Record& CommitIndex::getRecord(const size_t& index) const
+{
+	return index < m_MappedCount ? m_MappedRecords[index] : m_AppendedRecords[index - m_MappedCount];
+}
+
+CommitIndex::Commit CommitIndex::toCommit(const Record& record) const
+{
+	return Commit { std::to_string(record.cl), m_Branches.at(record.branch), FormatOID(record.oid) };
+}
+
+bool CommitIndex::writeOIDs()
+{
+	std::vector<OIDEntry> entries(GetSize());
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		memcpy(entries[i].oid, getRecord(i).oid, sizeof(entries[i].oid));
+		entries[i].record = i;
+	}
+	std::sort(entries.begin(), entries.end(), [](const OIDEntry& a, const OIDEntry& b)
+	    { return memcmp(a.oid, b.oid, sizeof(a.oid)) < 0; });
+
+	// Replaced at once, so that readers never see a partially sorted file.
+	const std::string oidsPath = GetOIDsPath(m_RepoPath);
+	const std::string tempPath = oidsPath + ".tmp";
+	const int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		return false;
+	}
+	const bool written = WriteAll(fd, entries.data(), entries.size() * sizeof(OIDEntry)) && (!m_FsyncEnable || fsync(fd) == 0);
+	close(fd);
+
+	return written && std::rename(tempPath.c_str(), oidsPath.c_str()) == 0;
+}
+
+bool CommitIndex::refreshOIDs()
+{
+	if (!writeOIDs())
+	{
+		return false;
+	}
+
+	// The records file holds exactly the records of the index while it is writable.
+	const size_t count = GetSize();
+	const Record* records = (const Record*)MapFile(m_CommitsFd, count * sizeof(Record));
+	const OIDEntry* oids = nullptr;
+	const int oidsFd = open(GetOIDsPath(m_RepoPath).c_str(), O_RDONLY);
+	if (oidsFd >= 0)
+	{
+		oids = (const OIDEntry*)MapFile(oidsFd, count * sizeof(OIDEntry));
+		close(oidsFd);
+	}
+	if (!records || !oids)
+	{
+		if (records)
+		{
+			munmap((void*)records, count * sizeof(Record));
+		}
+		if (oids)
+		{
+			munmap((void*)oids, count * sizeof(OIDEntry));
+		}
+		return false;
+	}
+
+	if (m_MappedRecords)
+	{
+		munmap((void*)m_MappedRecords, m_MappedRecordsSize);
+	}
+	if (m_MappedOIDs)
+	{
+		munmap((void*)m_MappedOIDs, m_MappedOIDCount * sizeof(OIDEntry));
+	}
+	m_MappedRecords = records;
+	m_MappedRecordsSize = count * sizeof(Record);
+	m_MappedCount = count;
+	m_MappedOIDs = oids;
+	m_MappedOIDCount = count;
+	m_AppendedRecords.clear();
+	m_UnsortedOIDs.clear();
+	return true;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "common.h"
+
+// Maps changelists to the commits created for them and back, in files
+// kept inside the Git repository next to the conversion state.
+//
+// `p4-fusion-commits` holds fixed size records in commit order, which is
+// also CL order, so it is sorted by CL and only ever appended to.
+// `p4-fusion-branches` lists the full reference names the records point
+// into, one per line. `p4-fusion-oids` holds the records sorted by commit
+// OID, and is rewritten on Close for the records appended since, as well
+// as every `OIDsRefreshCount` records for indexes that stay open, like in
+// daemon mode. Both binary files are memory mapped for lookups, and the
+// records appended since they were last mapped are kept in memory.
+class CommitIndex
+{
+public:
+	struct Record
+	{
+		int64_t cl;
+		uint32_t branch; // Line in `p4-fusion-branches`
+		uint32_t reserved;
+		uint8_t oid[20];
+		uint8_t padding[4];
+	};
+
+	struct Commit
+	{
+		std::string cl;
+		std::string branch;
+		std::string oid;
+	};
+
+private:
+	struct OIDEntry
+	{
+		uint8_t oid[20];
+		uint32_t record;
+	};
+
+	struct OID
+	{
+		uint8_t bytes[20];
+
+		bool operator==(const OID& other) const;
+	};
+
+	struct OIDHash
+	{
+		size_t operator()(const OID& oid) const;
+	};
+
+	std::string m_RepoPath;
+	bool m_IsWritable;
+	bool m_FsyncEnable;
+
+	int m_CommitsFd;
+	const Record* m_MappedRecords;
+	size_t m_MappedRecordsSize;
+	size_t m_MappedCount; // Excluding records cut short or of unknown branches
+	std::vector<Record> m_AppendedRecords;
+
+	const OIDEntry* m_MappedOIDs;
+	size_t m_MappedOIDCount;
+	// Records not covered by `p4-fusion-oids` yet.
+	std::unordered_map<OID, uint32_t, OIDHash> m_UnsortedOIDs;
+
+	std::vector<std::string> m_Branches;
+	std::unordered_map<std::string, uint32_t> m_BranchIDs;
+
+	const Record& getRecord(const size_t& index) const;
+	Commit toCommit(const Record& record) const;
+	bool writeOIDs();
+	// Writes the sorted OIDs and maps the records appended so far.
+	bool refreshOIDs();
+
+public:
+	static const size_t OIDsRefreshCount = 4096;
+
+	static std::string GetCommitsPath(const std::string& repoPath);
+	static std::string GetBranchesPath(const std::string& repoPath);
+	static std::string GetOIDsPath(const std::string& repoPath);
+
+	CommitIndex();
+	~CommitIndex();
+
+	// Opens the index of the repository, creating it if writable. A
+	// record cut short by a crash is dropped.
+	bool Open(const std::string& repoPath, const bool writable, const bool fsyncEnable);
+	void Close();
+
+	// Commits need to be appended in CL order. Returns false otherwise.
+	bool Append(const std::string& cl, const std::string& branch, const std::string& oid);
+
+	size_t GetSize() const { return m_MappedCount + m_AppendedRecords.size(); }
+	bool IsEmpty() const { return GetSize() == 0; }
+	// -1 for an empty index.
+	int64_t GetLastCL() const { return IsEmpty() ? -1 : getRecord(GetSize() - 1).cl; }
+	// Commits created for the CL, one per branch it was committed to.
+	std::vector<Commit> FindCommits(const std::string& cl) const;
+	// Empty if the CL was not committed to the branch.
+	std::string FindCommit(const std::string& cl, const std::string& branch) const;
+	bool FindChange(const std::string& oid, Commit& commit) const;
+};
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "conversion_state.h"
+
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char* StateVersion = "p4-fusion-state 1";
+
+std::string ConversionState::GetPath(const std::string& repoPath)
+{
+	return repoPath + (repoPath.back() == '/' ? "" : "/") + "p4-fusion-state";
+}
+
+bool ConversionState::Load(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		return false;
+	}
+
+	std::string line;
+	if (!std::getline(file, line) || line != StateVersion)
+	{
+		return false;
+	}
+
+	ConversionState loaded;
+	size_t tipCount = 0;
+	while (std::getline(file, line))
+	{
+		const size_t space = line.find(' ');
+		const std::string key = line.substr(0, space);
+		const std::string value = space == std::string::npos ? "" : line.substr(space + 1);
+
+		if (key == "depot-path")
+		{
+			loaded.depotPath = value;
+		}
+		else if (key == "last-cl")
+		{
+			loaded.lastCL = value;
+		}
+		else if (key == "next-cl")
+		{
+			loaded.nextCL = value;
+		}
+		else if (key == "root")
+		{
+			loaded.rootCommit = value;
+		}
+		else if (key == "tip")
+		{
+			const size_t separator = value.rfind(' ');
+			if (separator == std::string::npos)
+			{
+				return false;
+			}
+			loaded.branchTips[value.substr(0, separator)] = value.substr(separator + 1);
+			tipCount++;
+		}
+		else if (key == "end")
+		{
+			// Only a completely written file is trusted.
+			if (value != std::to_string(tipCount) || loaded.depotPath.empty() || loaded.lastCL.empty())
+			{
+				return false;
+			}
+			*this = loaded;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool ConversionState::Save(const std::string& path, const bool fsyncEnable) const
+{
+	std::ostringstream contents;
+	contents << StateVersion << "\n"
+	         << "depot-path " << depotPath << "\n"
+	         << "last-cl " << lastCL << "\n"
+	         << "next-cl " << nextCL << "\n"
+	         << "root " << rootCommit << "\n";
+	for (auto const& tip : branchTips)
+	{
+		contents << "tip " << tip.first << " " << tip.second << "\n";
+	}
+	contents << "end " << branchTips.size() << "\n";
+	const std::string data = contents.str();
+
+	const std::string tempPath = path + ".tmp";
+	const int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		ERR("Could not open " << tempPath << ": " << strerror(errno));
+		return false;
+	}
+
+	size_t written = 0;
+	while (written < data.size())
+	{
+		const ssize_t result = write(fd, data.data() + written, data.size() - written);
+		if (result < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			ERR("Could not write " << tempPath << ": " << strerror(errno));
+			close(fd);
+			return false;
+		}
+		written += result;
+	}
+
+	// The rename alone is atomic against a crash of the process. Surviving
+	// a crash of the machine also needs the data on disk before the rename.
+	if (fsyncEnable && fsync(fd) != 0)
+	{
+		ERR("Could not fsync " << tempPath << ": " << strerror(errno));
+		close(fd);
+		return false;
+	}
+	close(fd);
+
+	if (std::rename(tempPath.c_str(), path.c_str()) != 0)
+	{
+		ERR("Could not rename " << tempPath << " to " << path << ": " << strerror(errno));
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <string>
+#include <map>
+
+#include "common.h"
+
+// Progress of a conversion, kept in a sidecar file inside the Git
+// repository so that a restart does not need to inspect the history.
+// The file is rewritten after every changelist into a temporary file
+// that is renamed over the previous one, so it is either the old or the
+// new state after a crash, never a mix of both.
+struct ConversionState
+{
+	std::string depotPath;
+	std::string lastCL;
+	// The changelist enumerated after `lastCL`, if it was known.
+	std::string nextCL;
+	// The empty commit all branches start from.
+	std::string rootCommit;
+	// Full reference names to commit OIDs.
+	std::map<std::string, std::string> branchTips;
+
+	static std::string GetPath(const std::string& repoPath);
+
+	// Returns false if the file is missing, from another version or incomplete.
+	bool Load(const std::string& path);
+	bool Save(const std::string& path, const bool fsyncEnable) const;
+};
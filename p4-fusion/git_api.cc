@@ -152,27 +152,110 @@ git_oid GitAPI::CreateBlob(const std::vector<char>& data)
 	return oid;
 }
 
+// Returns the CL in the change message generated from the Commit method,
+// or an empty string for commits not created from a changelist.
+static std::string ParseCommitCL(const std::string& message)
+{
+	// Note that extra branching information can be added after it.
+	// ": change = " is 11 characters long.
+	const size_t marker = message.rfind(": change = ");
+	if (marker == std::string::npos)
+	{
+		return "";
+	}
+	const size_t clStart = marker + 11;
+	const size_t clEnd = message.find(']', clStart);
+	return message.substr(clStart, clEnd - clStart);
+}
+
 std::string GitAPI::DetectLatestCL()
 {
-	git_oid oid;
-	GIT2(git_reference_name_to_id(&oid, m_Repo, "HEAD"));
+	// HEAD is only the branch that was committed to last, which need not
+	// have the latest CL in branch mode, so every branch tip is looked at.
+	std::string latestCL;
+	for (auto const& tip : GetBranchTips())
+	{
+		const std::string cl = GetCommitCL(tip.second);
+		if (!cl.empty() && (latestCL.empty() || std::stoll(cl) > std::stoll(latestCL)))
+		{
+			latestCL = cl;
+		}
+	}
 
-	git_commit* headCommit = nullptr;
-	GIT2(git_commit_lookup(&headCommit, m_Repo, &oid));
+	return latestCL;
+}
 
-	std::string message = git_commit_message(headCommit);
-	// Look for the specific change message generated from the Commit method.
-	// Note that extra branching information can be added after it.
-	// ": change = " is 11 characters long.
-	size_t clStart = message.rfind(": change = ") + 11;
-	size_t clEnd = message.find(']', clStart);
-	std::string cl(message, clStart, clEnd - clStart);
+std::string GitAPI::GetCommitCL(const std::string& commitOid)
+{
+	git_oid oid;
+	GIT2(git_oid_fromstr(&oid, commitOid.c_str()));
 
-	git_commit_free(headCommit);
+	git_commit* commit = nullptr;
+	GIT2(git_commit_lookup(&commit, m_Repo, &oid));
+	const std::string cl = ParseCommitCL(git_commit_message(commit));
+	git_commit_free(commit);
 
 	return cl;
 }
 
+std::map<std::string, std::string> GitAPI::GetBranchTips()
+{
+	std::map<std::string, std::string> tips;
+
+	git_reference_iterator* iterator = nullptr;
+	GIT2(git_reference_iterator_glob_new(&iterator, m_Repo, "refs/heads/*"));
+
+	git_reference* ref = nullptr;
+	while (git_reference_next(&ref, iterator) == 0)
+	{
+		const git_oid* oid = git_reference_target(ref);
+		if (oid)
+		{
+			tips[git_reference_name(ref)] = git_oid_tostr_s(oid);
+		}
+		git_reference_free(ref);
+	}
+	git_reference_iterator_free(iterator);
+
+	return tips;
+}
+
+std::string GitAPI::GetHeadBranchRef()
+{
+	git_reference* head = nullptr;
+	GIT2(git_reference_lookup(&head, m_Repo, "HEAD"));
+	const char* target = git_reference_symbolic_target(head);
+	const std::string headRef = target ? target : "HEAD";
+	git_reference_free(head);
+
+	return headRef;
+}
+
+bool GitAPI::SetFirstCommit(const std::string& oid)
+{
+	git_oid firstCommitOid;
+	if (git_oid_fromstr(&firstCommitOid, oid.c_str()) != 0)
+	{
+		return false;
+	}
+
+	git_commit* firstCommit = nullptr;
+	if (git_commit_lookup(&firstCommit, m_Repo, &firstCommitOid) != 0)
+	{
+		return false;
+	}
+	git_commit_free(firstCommit);
+
+	m_FirstCommitOid = firstCommitOid;
+	m_HasFirstCommit = true;
+	return true;
+}
+
+std::string GitAPI::GetFirstCommit() const
+{
+	return git_oid_tostr_s(&m_FirstCommitOid);
+}
+
 void GitAPI::CreateIndex()
 {
 	MTR_SCOPE("Git", __func__);
@@ -195,13 +278,17 @@ void GitAPI::CreateIndex()
 		git_tree_free(head_commit_tree);
 		git_commit_free(head_commit);
 
-		// Find the first commit
-		git_revwalk* walk;
-		git_revwalk_new(&walk, m_Repo);
-		git_revwalk_sorting(walk, GIT_SORT_TOPOLOGICAL);
-		git_revwalk_push_head(walk);
-		git_revwalk_next(&m_FirstCommitOid, walk);
-		git_revwalk_free(walk);
+		// Find the first commit, unless it is already known
+		if (!m_HasFirstCommit)
+		{
+			git_revwalk* walk;
+			git_revwalk_new(&walk, m_Repo);
+			git_revwalk_sorting(walk, GIT_SORT_TOPOLOGICAL);
+			git_revwalk_push_head(walk);
+			git_revwalk_next(&m_FirstCommitOid, walk);
+			git_revwalk_free(walk);
+			m_HasFirstCommit = true;
+		}
 
 		WARN("Loaded index was refreshed to match the tree of the current HEAD commit");
 	}
@@ -224,6 +311,7 @@ void GitAPI::CreateIndex()
 		git_revparse_ext(&parent, &ref, m_Repo, "HEAD");
 
 		GIT2(git_commit_create_v(&m_FirstCommitOid, m_Repo, "HEAD", author, author, "UTF-8", "Initial repository.", commitTree, parent ? 1 : 0, parent));
+		m_HasFirstCommit = true;
 
 		git_object_free(parent);
 		git_reference_free(ref);
@@ -234,7 +322,57 @@ void GitAPI::CreateIndex()
 	}
 }
 
-void GitAPI::AddFileToIndex(const std::string& relativePath, const std::vector<char>& contents, const bool plusx)
+void GitAPI::CreateDetachedIndex(const std::string& ref, const std::string& baseCommit)
+{
+	MTR_SCOPE("Git", __func__);
+
+	git_oid baseOid;
+	GIT2(git_oid_fromstr(&baseOid, baseCommit.c_str()));
+
+	git_reference* reference = nullptr;
+	GIT2(git_reference_create(&reference, m_Repo, ref.c_str(), &baseOid, 1, "p4-fusion: detached index"));
+	git_reference_free(reference);
+
+	// Blobs can only be added from buffers to an index owned by a repository.
+	GIT2(git_index_new(&m_Index));
+	GIT2(git_repository_set_index(m_Repo, m_Index));
+
+	git_commit* baseCommitObject = nullptr;
+	GIT2(git_commit_lookup(&baseCommitObject, m_Repo, &baseOid));
+
+	git_tree* baseTree = nullptr;
+	GIT2(git_commit_tree(&baseTree, baseCommitObject));
+
+	GIT2(git_index_read_tree(m_Index, baseTree));
+
+	git_tree_free(baseTree);
+	git_commit_free(baseCommitObject);
+
+	m_CommitRef = ref;
+	m_IsIndexDetached = true;
+}
+
+git_oid GitAPI::AddFileToIndex(const std::string& relativePath, const ContentBuffer& contents, const bool plusx)
+{
+	MTR_SCOPE("Git", __func__);
+
+	git_index_entry entry = {};
+	entry.mode = GIT_FILEMODE_BLOB;
+	if (plusx)
+	{
+		entry.mode = GIT_FILEMODE_BLOB_EXECUTABLE; // 0100755
+	}
+
+	entry.path = relativePath.c_str();
+
+	GIT2(git_index_add_from_buffer(m_Index, &entry, contents.GetData(), contents.GetSize()));
+
+	// The blob is only handed out through the index entry.
+	const git_index_entry* added = git_index_get_bypath(m_Index, entry.path, 0);
+	return added->id;
+}
+
+void GitAPI::AddBlobToIndex(const std::string& relativePath, const git_oid& blob, const bool plusx)
 {
 	MTR_SCOPE("Git", __func__);
 
@@ -246,8 +384,9 @@ void GitAPI::AddFileToIndex(const std::string& relativePath, const std::vector<c
 	}
 
 	entry.path = relativePath.c_str();
+	entry.id = blob;
 
-	GIT2(git_index_add_from_buffer(m_Index, &entry, contents.data(), contents.size()));
+	GIT2(git_index_add(m_Index, &entry));
 }
 
 void GitAPI::RemoveFileFromIndex(const std::string& relativePath)
@@ -288,7 +427,7 @@ std::string GitAPI::Commit(
 
 	// Find the parent commits.
 	// Order is very important.
-	std::vector<std::string> parentRefs = { "HEAD" };
+	std::vector<std::string> parentRefs = { m_CommitRef };
 	if (!mergeFromStream.empty())
 	{
 		parentRefs.push_back("refs/heads/" + mergeFromStream);
@@ -321,7 +460,7 @@ std::string GitAPI::Commit(
 	}
 
 	git_oid commitID;
-	GIT2(git_commit_create(&commitID, m_Repo, "HEAD", author, author, "UTF-8", commitMsg.c_str(), commitTree, parentCount, (const git_commit**)parents));
+	GIT2(git_commit_create(&commitID, m_Repo, m_CommitRef.c_str(), author, author, "UTF-8", commitMsg.c_str(), commitTree, parentCount, (const git_commit**)parents));
 
 	for (int i = 0; i < parentCount; i++)
 	{
@@ -336,6 +475,102 @@ std::string GitAPI::Commit(
 
 void GitAPI::CloseIndex()
 {
-	GIT2(git_index_write(m_Index));
+	if (!m_IsIndexDetached)
+	{
+		GIT2(git_index_write(m_Index));
+	}
 	git_index_free(m_Index);
 }
+
+std::string GitAPI::GetCommitTree(const std::string& commitOid)
+{
+	git_oid oid;
+	GIT2(git_oid_fromstr(&oid, commitOid.c_str()));
+
+	git_commit* commit = nullptr;
+	GIT2(git_commit_lookup(&commit, m_Repo, &oid));
+	const std::string tree = git_oid_tostr_s(git_commit_tree_id(commit));
+	git_commit_free(commit);
+
+	return tree;
+}
+
+std::string GitAPI::RewriteCommit(const std::string& commitOid, const std::string& parentOid)
+{
+	MTR_SCOPE("Git", __func__);
+
+	git_oid oid;
+	GIT2(git_oid_fromstr(&oid, commitOid.c_str()));
+	git_commit* commit = nullptr;
+	GIT2(git_commit_lookup(&commit, m_Repo, &oid));
+
+	GIT2(git_oid_fromstr(&oid, parentOid.c_str()));
+	git_commit* parent = nullptr;
+	GIT2(git_commit_lookup(&parent, m_Repo, &oid));
+
+	git_tree* tree = nullptr;
+	GIT2(git_commit_tree(&tree, commit));
+
+	// Everything but the parent is taken over as is, so the copy is the
+	// commit that would have been made on top of the parent.
+	git_oid rewrittenID;
+	GIT2(git_commit_create(&rewrittenID, m_Repo, nullptr,
+	    git_commit_author(commit),
+	    git_commit_committer(commit),
+	    git_commit_message_encoding(commit),
+	    git_commit_message_raw(commit),
+	    tree,
+	    1,
+	    (const git_commit**)&parent));
+
+	git_tree_free(tree);
+	git_commit_free(parent);
+	git_commit_free(commit);
+
+	return git_oid_tostr_s(&rewrittenID);
+}
+
+void GitAPI::SetReference(const std::string& ref, const std::string& commitOid)
+{
+	git_oid oid;
+	GIT2(git_oid_fromstr(&oid, commitOid.c_str()));
+
+	git_reference* reference = nullptr;
+	GIT2(git_reference_create(&reference, m_Repo, ref.c_str(), &oid, 1, "p4-fusion: set reference"));
+	git_reference_free(reference);
+}
+
+void GitAPI::DeleteReference(const std::string& ref)
+{
+	git_reference* reference = nullptr;
+	const int errorCode = git_reference_lookup(&reference, m_Repo, ref.c_str());
+	if (errorCode == GIT_ENOTFOUND)
+	{
+		return;
+	}
+	GIT2(errorCode);
+	GIT2(git_reference_delete(reference));
+	git_reference_free(reference);
+}
+
+int GitAPI::DeleteReferences(const std::string& prefix)
+{
+	// Listed first, as deleting would change what the iterator walks.
+	std::vector<std::string> refs;
+	git_reference_iterator* iterator = nullptr;
+	GIT2(git_reference_iterator_glob_new(&iterator, m_Repo, (prefix + "*").c_str()));
+
+	git_reference* ref = nullptr;
+	while (git_reference_next(&ref, iterator) == 0)
+	{
+		refs.push_back(git_reference_name(ref));
+		git_reference_free(ref);
+	}
+	git_reference_iterator_free(iterator);
+
+	for (const std::string& name : refs)
+	{
+		DeleteReference(name);
+	}
+	return refs.size();
+}
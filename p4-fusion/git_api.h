@@ -8,9 +8,11 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <utility>
 
 #include "common.h"
+#include "utils/content_buffer.h"
 #include "git2/oid.h"
 
 struct git_repository;
@@ -20,8 +22,12 @@ class GitAPI
 	git_repository* m_Repo = nullptr;
 	git_index* m_Index = nullptr;
 	git_oid m_FirstCommitOid;
+	bool m_HasFirstCommit = false;
 
 	std::string m_CurrentBranch = "";
+	// The reference committed to, only other than HEAD with a detached index.
+	std::string m_CommitRef = "HEAD";
+	bool m_IsIndexDetached = false;
 
 public:
 	GitAPI(bool fsyncEnable);
@@ -32,13 +38,32 @@ public:
 
 	bool IsHEADExists();
 	bool IsRepositoryClonedFrom(const std::string& depotPath);
+	// The highest CL committed to any of the branches.
 	std::string DetectLatestCL();
+	// Empty for commits not created from a changelist.
+	std::string GetCommitCL(const std::string& commitOid);
+	// Full reference names of the branches and the commits they point at.
+	std::map<std::string, std::string> GetBranchTips();
+	// Full reference name of the branch HEAD points at.
+	std::string GetHeadBranchRef();
+
+	// Reuses a previously created first commit, instead of walking the
+	// history for it in CreateIndex. Returns false if it does not exist.
+	bool SetFirstCommit(const std::string& oid);
+	std::string GetFirstCommit() const;
 
 	git_oid CreateBlob(const std::vector<char>& data);
 
 	void CreateIndex();
+	// Creates an index of the tree of `baseCommit` which is never written to
+	// the repository, and makes Commit() advance `ref` instead of HEAD. This
+	// lets several instances commit to the same repository at the same time.
+	void CreateDetachedIndex(const std::string& ref, const std::string& baseCommit);
 	void SetActiveBranch(const std::string& branchName);
-	void AddFileToIndex(const std::string& relativePath, const std::vector<char>& contents, const bool plusx);
+	// Returns the blob written for the contents.
+	git_oid AddFileToIndex(const std::string& relativePath, const ContentBuffer& contents, const bool plusx);
+	// Adds a file with the contents of a blob already in the repository.
+	void AddBlobToIndex(const std::string& relativePath, const git_oid& blob, const bool plusx);
 	void RemoveFileFromIndex(const std::string& relativePath);
 
 	std::string Commit(
@@ -51,4 +76,12 @@ public:
 	    const int64_t& timestamp,
 	    const std::string& mergeFromStream);
 	void CloseIndex();
+
+	std::string GetCommitTree(const std::string& commitOid);
+	// Creates a copy of the commit with `parentOid` as its only parent.
+	std::string RewriteCommit(const std::string& commitOid, const std::string& parentOid);
+	void SetReference(const std::string& ref, const std::string& commitOid);
+	void DeleteReference(const std::string& ref);
+	// Deletes every reference whose name starts with `prefix`, returning how many.
+	int DeleteReferences(const std::string& prefix);
 };
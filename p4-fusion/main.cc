@@ -5,21 +5,38 @@
  * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
  */
 #include <algorithm>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <thread>
 #include <typeinfo>
 #include <csignal>
 #include <iterator>
+#include <stdexcept>
+#include <cerrno>
+
+#include <unistd.h>
 
 #include "common.h"
 
 #include "utils/std_helpers.h"
 #include "utils/timer.h"
 #include "utils/arguments.h"
+#include "utils/buffer_pool.h"
+#include "utils/download_cache.h"
 
 #include "thread_pool.h"
 #include "p4_api.h"
 #include "git_api.h"
 #include "branch_set.h"
+#include "change_enumerator.h"
+#include "conversion_state.h"
+#include "commit_index.h"
+#include "metadata_cache.h"
+#include "blob_table.h"
+#include "manifest.h"
+#include "commands/change_list.h"
 
 #include "p4/p4libs.h"
 #include "minitrace.h"
@@ -27,29 +44,641 @@
 #define P4_FUSION_VERSION "v1.13.0"
 
 void SignalHandler(sig_atomic_t s);
+static void StopOnSecondSignal();
+// The first interrupt signal received. The conversions stop once they are
+// done committing their current CL.
+static std::atomic<int> InterruptSignal(0);
+// A second signal is written here by the handler, for StopOnSecondSignal()
+// to stop the process at once from a normal thread.
+static int InterruptPipe[2] = { -1, -1 };
+
+// Reports the interrupt once, from the first thread to notice it, as the
+// signal handler cannot safely do so.
+static bool IsInterrupted()
+{
+	static std::atomic<bool> isReported(false);
+	const int received = InterruptSignal;
+	if (received != 0 && !isReported.exchange(true))
+	{
+		WARN("Signal Received: " << strsignal(received) << ", stopping once the CLs being committed are done. Send it again to stop at once.");
+	}
+	return received != 0;
+}
+
+// The settings of a run, which apply to every depot path converted in it.
+struct ConversionOptions
+{
+	bool noMerge;
+	bool fsyncEnable;
+	bool includeBinaries;
+	int maxChanges;
+	int changesWindow;
+	int flushRate;
+	bool streamMappings;
+	int metadataThreads;
+	int printBatch;
+	int lookAhead;
+	bool dedupContents;
+	bool verifyDigests;
+	bool daemon;
+	int pollInterval;
+	int segments;
+	std::string baselineCL;
+	int timezoneMinutes;
+	// Otherwise a single trace file covers all the conversions of the run.
+	bool traceToRepository;
+};
+
+// Maps usernames to emails, for all the conversions running at the same time.
+struct UserDirectory
+{
+	std::mutex mutex;
+	std::unordered_map<UsersResult::UserID, UsersResult::UserData> users;
+	// Users created after the user list was received only show up with new changelists.
+	bool isStale = false;
+
+	void MarkStale()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isStale = true;
+	}
+
+	void GetAuthor(P4API& p4, const UsersResult::UserID& user, std::string& fullName, std::string& email)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (isStale && users.find(user) == users.end())
+		{
+			users = std::move(p4.Users()->GetUserEmails());
+			isStale = false;
+		}
+
+		fullName = user;
+		email = "deleted@user";
+		auto userIt = users.find(user);
+		if (userIt != users.end())
+		{
+			fullName = userIt->second.fullName;
+			email = userIt->second.email;
+		}
+	}
+};
+
+static void PrintStats()
+{
+	ThreadPool::PrintAllStats();
+	PRINT(BufferPool::GetSingleton()->GetStats());
+	if (DownloadCache::GetSingleton()->IsEnabled())
+	{
+		PRINT(DownloadCache::GetSingleton()->GetStats());
+	}
+	if (MetadataCache::GetSingleton()->IsEnabled())
+	{
+		PRINT(MetadataCache::GetSingleton()->GetStats());
+	}
+}
+
+// Prints the rows again on a connection of the content pool, for
+// deduplicated rows which have no blob to be committed with. Blocks until
+// the contents are set.
+static void ReprintFiles(FileTable& files, const std::vector<size_t>& rows, BlobTable& blobTable)
+{
+	std::vector<std::string> fileRevisions;
+	for (const size_t& row : rows)
+	{
+		fileRevisions.push_back(files.GetDepotFileRevision(row));
+	}
+
+	// Shared with the job, so that a job dropped by a shutdown breaks the
+	// promise instead of leaving the commit thread waiting.
+	std::shared_ptr<std::promise<void>> printed = std::make_shared<std::promise<void>>();
+	std::future<void> isPrinted = printed->get_future();
+	ThreadPool::GetContentPool()->AddPriorityJob([&files, &rows, &blobTable, fileRevisions, printed](P4API* p4)
+	    {
+		    try
+		    {
+			    std::unique_ptr<PrintResult> printData = p4->PrintFiles(fileRevisions, nullptr);
+			    if (printData->GetPrintData().size() != rows.size())
+			    {
+				    throw std::runtime_error("Printed " + std::to_string(printData->GetPrintData().size()) + " of " + std::to_string(rows.size()) + " files reprinted for lack of a blob");
+			    }
+			    for (size_t i = 0; i < rows.size(); i++)
+			    {
+				    files.SetContents(rows[i], std::move(printData->GetPrintData().at(i).contents));
+				    blobTable.Verify(files, rows[i]);
+			    }
+			    printed->set_value();
+		    }
+		    catch (...)
+		    {
+			    printed->set_exception(std::current_exception());
+		    }
+	    });
+	isPrinted.get();
+}
+
+// Adds the files of the changelist to the index as their downloads
+// complete, and commits each of its branch groups. `onCommit` is called
+// with each commit made.
+static void CommitChangeList(GitAPI& git, ChangeList& cl, BlobTable& blobTable, const std::string& depotPath, const std::string& fullName, const std::string& email, const ConversionOptions& options, const std::function<void(const BranchedFileGroup&, const std::string&)>& onCommit)
+{
+	FileTable& files = cl.changedFileGroups->files;
+	std::vector<BranchedFileGroup>& branchGroups = cl.changedFileGroups->branchedFileGroups;
+	for (size_t groupIndex = 0; groupIndex < branchGroups.size(); groupIndex++)
+	{
+		BranchedFileGroup& branchGroup = branchGroups[groupIndex];
+		if (!branchGroup.targetBranch.empty())
+		{
+			git.SetActiveBranch(branchGroup.targetBranch);
+		}
+
+		// Files are added to the index as soon as their batch is downloaded, so
+		// that the index work overlaps with the downloads still in flight.
+		size_t filesAdded = 0;
+		std::vector<size_t> downloadedFiles;
+		std::vector<size_t> reprintedFiles;
+		std::vector<git_oid> deduplicatedBlobs;
+		while (filesAdded < branchGroup.GetFileCount())
+		{
+			downloadedFiles.clear();
+			cl.TakeDownloadedFiles(groupIndex, downloadedFiles);
+
+			// The claiming CL has not committed the contents (yet), or its print
+			// of them did not match the digest; these are printed again.
+			reprintedFiles.clear();
+			deduplicatedBlobs.resize(downloadedFiles.size());
+			for (size_t i = 0; i < downloadedFiles.size(); i++)
+			{
+				const size_t& row = downloadedFiles[i];
+				if (!files.IsDeleted(row) && cl.deduplicatedFiles.at(row) && !blobTable.GetBlob(files, row, deduplicatedBlobs[i]))
+				{
+					reprintedFiles.push_back(row);
+				}
+			}
+			if (!reprintedFiles.empty())
+			{
+				ReprintFiles(files, reprintedFiles, blobTable);
+			}
+
+			size_t reprinted = 0;
+			for (size_t i = 0; i < downloadedFiles.size(); i++)
+			{
+				const size_t& row = downloadedFiles[i];
+				if (files.IsDeleted(row))
+				{
+					git.RemoveFileFromIndex(files.GetRelativePath(row));
+				}
+				else if (!cl.deduplicatedFiles.at(row))
+				{
+					const git_oid blob = git.AddFileToIndex(files.GetRelativePath(row), files.GetContents(row), files.IsExecutable(row));
+					blobTable.SetBlob(files, row, blob);
+				}
+				else if (reprinted < reprintedFiles.size() && reprintedFiles[reprinted] == row)
+				{
+					git.AddFileToIndex(files.GetRelativePath(row), files.GetContents(row), files.IsExecutable(row));
+					reprinted++;
+				}
+				else
+				{
+					git.AddBlobToIndex(files.GetRelativePath(row), deduplicatedBlobs[i], files.IsExecutable(row));
+				}
+
+				// No use for keeping the contents in memory once it has been added
+				files.ClearContents(row);
+			}
+			filesAdded += downloadedFiles.size();
+		}
+
+		std::string mergeFrom = "";
+		if (branchGroup.hasSource && !options.noMerge)
+		{
+			// Only perform merging if the branch group explicitly declares that the change
+			// has a source, and if the user wants merging.
+			mergeFrom = branchGroup.sourceBranch;
+		}
+
+		const std::string commitSHA = git.Commit(depotPath,
+		    cl.number,
+		    fullName,
+		    email,
+		    options.timezoneMinutes,
+		    cl.description,
+		    cl.timestamp,
+		    mergeFrom);
+		onCommit(branchGroup, commitSHA);
+	}
+}
+
+static const std::string SegmentRefPrefix = "refs/p4-fusion/segments/";
+
+// A run of consecutive changelists converted on its own thread, onto a
+// reference of its own.
+struct Segment
+{
+	size_t number;
+	size_t begin; // Index of the first changelist
+	size_t end;
+	std::string ref;
+	// Index after the last changelist committed, short of `end` if interrupted.
+	size_t done;
+	// The snapshot of the tree before the first changelist.
+	std::string baseline;
+	// Changelist index and commit of each commit made.
+	std::vector<std::pair<size_t, std::string>> commits;
+};
+
+// Exits without leaving the references of the segments behind. The branch
+// stays on the empty first commit, from which the next run converts in
+// segments again.
+static void AbandonSegments(const std::string& srcPath)
+{
+	ThreadPool::ShutDownAll();
+	GitAPI git(false);
+	git.OpenRepository(srcPath);
+	git.DeleteReferences(SegmentRefPrefix);
+	std::exit(1);
+}
+
+static void ConvertSegment(Segment& segment, const size_t& segmentCount, const ChangeHistory& changes, const std::string& depotPath, const std::string& srcPath, const std::vector<std::string>& changesPaths, const BranchSet& branchSet, const ConversionOptions& options, UserDirectory& userDirectory)
+{
+	MTR_META_THREAD_NAME("Segment Thread");
+
+	P4API p4;
+	GitAPI git(options.fsyncEnable);
+	git.OpenRepository(srcPath);
+	git.CreateDetachedIndex(segment.ref, segment.baseline);
+
+	// Except for the first segment, the changelist before the segment is
+	// committed first with all of its files, to start from its tree.
+	const size_t first = segment.begin > 0 ? segment.begin - 1 : 0;
+
+	// The segments share the look ahead.
+	const size_t slotCount = std::max<size_t>(1, options.lookAhead / segmentCount);
+	std::unique_ptr<ChangeList[]> slots(new ChangeList[slotCount]);
+	auto getSlot = [&slots, &slotCount](const size_t& index) -> ChangeList&
+	{ return slots[index % slotCount]; };
+
+	// A content is claimed by the first CL printing it and picked up once
+	// that CL is committed, which only holds for the CLs of one segment.
+	BlobTable blobTable;
+	blobTable.Initialize(options.dedupContents, options.verifyDigests);
+	for (size_t slot = 0; slot < slotCount; slot++)
+	{
+		slots[slot].blobTable = &blobTable;
+	}
+	auto scheduleChange = [&](const size_t& index)
+	{
+		ChangeList& cl = getSlot(index);
+		if (index < segment.begin)
+		{
+			cl.Reset(changes.GetNumber(index), "Snapshot of " + depotPath + " at CL " + changes.GetNumber(index), changes.GetUser(index), changes.GetTimestamp(index));
+			cl.PrepareSnapshot(branchSet, changesPaths);
+		}
+		else
+		{
+			cl.Reset(changes.GetNumber(index), changes.GetDescription(index), changes.GetUser(index), changes.GetTimestamp(index));
+			cl.PrepareDownload(branchSet);
+		}
+		cl.StartDownload(options.printBatch);
+	};
+
+	size_t lastScheduled = first;
+	scheduleChange(first);
+	while (lastScheduled + 1 < segment.end && lastScheduled + 1 < first + slotCount)
+	{
+		scheduleChange(++lastScheduled);
+	}
+
+	for (size_t i = first; i < segment.end; i++)
+	{
+		if (IsInterrupted())
+		{
+			// The changelists in flight are dropped, as in the conversion one
+			// CL at a time.
+			for (size_t next = i; next <= lastScheduled; next++)
+			{
+				getSlot(next).Cancel();
+			}
+			for (size_t next = i; next <= lastScheduled; next++)
+			{
+				getSlot(next).WaitForDownload();
+				getSlot(next).Clear();
+			}
+			break;
+		}
+
+		// See if the threadpool encountered any exceptions
+		try
+		{
+			ThreadPool::RaiseAllCaughtExceptions();
+		}
+		catch (const std::exception& e)
+		{
+			// This is unrecoverable
+			ERR("Threadpool encountered an exception: " << e.what());
+			AbandonSegments(srcPath);
+		}
+
+		ChangeList& cl = getSlot(i);
+		cl.WaitForDescribe();
+
+		std::string fullName;
+		std::string email;
+		userDirectory.GetAuthor(p4, cl.user, fullName, email);
+
+		CommitChangeList(git, cl, blobTable, depotPath, fullName, email, options, [&](const BranchedFileGroup&, const std::string& commitSHA)
+		    {
+			    if (i < segment.begin)
+			    {
+				    segment.baseline = commitSHA;
+			    }
+			    else
+			    {
+				    segment.commits.push_back({ i, commitSHA });
+			    }
+		    });
+		segment.done = std::max(segment.done, i + 1);
+		SUCCESS(
+		    "CL " << cl.number << " with " << cl.changedFileGroups->totalFileCount << " files"
+		          << (i < segment.begin ? " as a snapshot" : "")
+		          << " (segment " << segment.number + 1 << "/" << segmentCount
+		          << ", " << i + 1 - first << "/" << segment.end - first << ")");
+
+		// Clear out finished changelist, once no print job can touch it anymore.
+		cl.WaitForDownload();
+		cl.Clear();
+
+		if (lastScheduled + 1 < segment.end)
+		{
+			scheduleChange(++lastScheduled);
+		}
+	}
+
+	git.CloseIndex();
+
+	if (blobTable.IsEnabled())
+	{
+		PRINT("Segment " << segment.number + 1 << ": " << blobTable.GetStats());
+	}
+}
+
+// Converts the history of a new repository in `options.segments` parts at
+// the same time. Each part starts from a snapshot of the tree it starts
+// at, and once all are done, their commits are copied onto the end of the
+// previous part. The copies are the commits converting one changelist
+// after the other makes, as long as the snapshots match the trees
+// converted up to them, which is checked for each. Returns how many
+// changelists were committed, to be continued from.
+static int ConvertInSegments(GitAPI& git, const std::string& depotPath, const std::string& srcPath, const std::vector<std::string>& changesPaths, const BranchSet& branchSet, const ConversionOptions& options, UserDirectory& userDirectory, const int& maxChanges)
+{
+	Timer segmentsTimer;
+
+	P4API p4;
+	ChangeEnumerator enumerator(changesPaths, options.changesWindow, options.metadataThreads, maxChanges);
+	enumerator.Start(p4, "");
+	size_t changeCount = 0;
+	while (!IsInterrupted() && enumerator.WaitFor(changeCount))
+	{
+		changeCount++;
+	}
+	if (IsInterrupted())
+	{
+		return 0;
+	}
+	const ChangeHistory& changes = enumerator.GetChanges();
+
+	const size_t segmentCount = std::min<size_t>(options.segments, changeCount);
+	if (segmentCount < 2)
+	{
+		return 0;
+	}
+
+	CommitIndex commitIndex;
+	if (!commitIndex.Open(srcPath, true, options.fsyncEnable))
+	{
+		// Reported by the conversion that follows.
+		return 0;
+	}
+
+	// The empty first commit all conversions start from.
+	std::string rootCommit;
+	{
+		GitAPI rootGit(options.fsyncEnable);
+		rootGit.OpenRepository(srcPath);
+		rootGit.CreateIndex();
+		rootCommit = rootGit.GetFirstCommit();
+		rootGit.CloseIndex();
+	}
+
+	std::vector<Segment> segments(segmentCount);
+	for (size_t k = 0; k < segmentCount; k++)
+	{
+		segments[k].number = k;
+		segments[k].begin = changeCount * k / segmentCount;
+		segments[k].end = changeCount * (k + 1) / segmentCount;
+		segments[k].ref = SegmentRefPrefix + std::to_string(k);
+		segments[k].done = segments[k].begin;
+		segments[k].baseline = rootCommit;
+	}
+
+	SUCCESS("Converting " << changeCount << " CLs in " << segmentCount << " segments");
+	std::vector<std::thread> segmentThreads;
+	for (size_t k = 0; k < segmentCount; k++)
+	{
+		segmentThreads.emplace_back([&, k]()
+		    {
+			    try
+			    {
+				    ConvertSegment(segments[k], segmentCount, changes, depotPath, srcPath, changesPaths, branchSet, options, userDirectory);
+			    }
+			    catch (const std::exception& e)
+			    {
+				    // The downloads in flight still refer to the segment.
+				    ERR("Exception occurred while converting segment " << k + 1 << ": " << typeid(e).name() << ": " << e.what());
+				    AbandonSegments(srcPath);
+			    }
+		    });
+	}
+	for (std::thread& segmentThread : segmentThreads)
+	{
+		segmentThread.join();
+	}
+
+	const std::string branchRef = git.GetHeadBranchRef();
+	std::string tip = rootCommit;
+	size_t committedCount = 0;
+	for (const Segment& segment : segments)
+	{
+		if (segment.done == segment.begin)
+		{
+			// Interrupted before its first changelist.
+			break;
+		}
+		if (segment.begin > 0 && git.GetCommitTree(tip) != git.GetCommitTree(segment.baseline))
+		{
+			WARN("The snapshot at CL " << changes.GetNumber(segment.begin - 1) << " does not match the tree converted up to it, converting the CLs after it one by one");
+			break;
+		}
+
+		for (const std::pair<size_t, std::string>& commit : segment.commits)
+		{
+			tip = segment.begin == 0 ? commit.second : git.RewriteCommit(commit.second, tip);
+
+			const std::string& cl = changes.GetNumber(commit.first);
+			if (!commitIndex.Append(cl, branchRef, tip))
+			{
+				WARN("Could not add commit " << tip << " of CL " << cl << " to the commit index");
+			}
+			// For scripting/testing purposes...
+			PRINT("COMMIT:" << tip << ":" << cl << "::");
+		}
+		committedCount = segment.done;
+		if (segment.done < segment.end)
+		{
+			break;
+		}
+	}
+
+	git.SetReference(branchRef, tip);
+	git.DeleteReferences(SegmentRefPrefix);
+	commitIndex.Close();
+
+	if (IsInterrupted())
+	{
+		WARN("Stopped converting in segments on interrupt after " << committedCount << " of " << changeCount << " CLs, the next run resumes from there");
+		return committedCount;
+	}
+	SUCCESS("Committed " << committedCount << " of " << changeCount << " CLs in segments in " << segmentsTimer.GetTimeS() / 60.0f << " minutes");
+	return committedCount;
+}
+
+// Commits all the files of the depot path as of `baselineCL` at once, on
+// the branches they map to, for the history of a new repository to start
+// from there. The commit is made as the latest CL up to the baseline, which
+// the conversion then continues after.
+static bool ImportBaseline(const std::string& depotPath, const std::string& srcPath, const std::vector<std::string>& changesPaths, const BranchSet& branchSet, BlobTable& blobTable, const ConversionOptions& options, UserDirectory& userDirectory)
+{
+	Timer baselineTimer;
+
+	P4API p4;
+	std::vector<ChangeHistory> latestChanges;
+	for (const std::string& path : changesPaths)
+	{
+		latestChanges.push_back(p4.LatestChange(path + "@" + options.baselineCL)->GetChanges());
+	}
+	// The baseline is the last of the latest CLs of each path.
+	ChangeHistory changes;
+	changes.AppendMerged(latestChanges);
+	if (changes.IsEmpty())
+	{
+		ERR("No CL was submitted to " << depotPath << " up to the baseline CL " << options.baselineCL);
+		return false;
+	}
+	const size_t baseline = changes.GetSize() - 1;
+
+	CommitIndex commitIndex;
+	if (!commitIndex.Open(srcPath, true, options.fsyncEnable))
+	{
+		ERR("Could not open the commit index in " << srcPath);
+		return false;
+	}
+
+	GitAPI git(options.fsyncEnable);
+	git.OpenRepository(srcPath);
+	git.CreateIndex();
+
+	ChangeList cl;
+	cl.blobTable = &blobTable;
+	cl.Reset(changes.GetNumber(baseline), "Snapshot of " + depotPath + " at CL " + options.baselineCL, changes.GetUser(baseline), changes.GetTimestamp(baseline));
+	cl.PrepareSnapshot(branchSet, changesPaths);
+	cl.StartDownload(options.printBatch);
+	cl.WaitForDescribe();
+	if (IsInterrupted())
+	{
+		// Once the download runs, it is only stopped at once by another signal.
+		cl.Cancel();
+		cl.WaitForDownload();
+		cl.Clear();
+		git.CloseIndex();
+		commitIndex.Close();
+		WARN("Stopped importing the baseline on interrupt, the next run imports it again");
+		return true;
+	}
+
+	std::string fullName;
+	std::string email;
+	userDirectory.GetAuthor(p4, cl.user, fullName, email);
+
+	CommitChangeList(git, cl, blobTable, depotPath, fullName, email, options, [&](const BranchedFileGroup& branchGroup, const std::string& commitSHA)
+	    {
+		    const std::string branchRef = git.GetHeadBranchRef();
+		    if (!commitIndex.Append(cl.number, branchRef, commitSHA))
+		    {
+			    WARN("Could not add commit " << commitSHA << " of CL " << cl.number << " to the commit index");
+		    }
+
+		    // For scripting/testing purposes...
+		    PRINT("COMMIT:" << commitSHA << ":" << cl.number << ":" << branchGroup.targetBranch << ":");
+		    SUCCESS(
+		        "Baseline at CL " << cl.number << " --> Commit " << commitSHA
+		                          << " with " << branchGroup.GetFileCount() << " files"
+		                          << (branchGroup.targetBranch.empty()
+		                                     ? ""
+		                                     : (" to branch " + branchGroup.targetBranch))
+		                          << ".");
+	    });
+
+	cl.WaitForDownload();
+	cl.Clear();
+	git.CloseIndex();
+	commitIndex.Close();
+
+	SUCCESS("Imported the baseline in " << baselineTimer.GetTimeS() << " seconds");
+	return true;
+}
+
+// Converts a depot path into a Git repository, or keeps converting it in
+// daemon mode. The thread pools need to be running.
+int ConvertDepotPath(const Manifest::Job& job, const ConversionOptions& options, UserDirectory& userDirectory);
 
 int Main(int argc, char** argv)
 {
 	Timer programTimer;
 
-	Arguments::GetSingleton()->RequiredParameter("--path", "P4 depot path to convert to a Git repo.  If used with '--branch', this is the base path for the branches.");
-	Arguments::GetSingleton()->RequiredParameter("--src", "Relative path where the git repository should be created. This path should be empty before running p4-fusion for the first time in a directory.");
+	Arguments::GetSingleton()->OptionalParameter("--path", "", "P4 depot path to convert to a Git repo.  If used with '--branch', this is the base path for the branches.  Required unless '--manifest' is given.");
+	Arguments::GetSingleton()->OptionalParameter("--src", "", "Relative path where the git repository should be created. This path should be empty before running p4-fusion for the first time in a directory.  Required unless '--manifest' is given.");
 	Arguments::GetSingleton()->RequiredParameter("--port", "Specify which P4PORT to use.");
 	Arguments::GetSingleton()->RequiredParameter("--user", "Specify which P4USER to use. Please ensure that the user is logged in.");
 	Arguments::GetSingleton()->RequiredParameter("--client", "Name/path of the client workspace specification.");
 	Arguments::GetSingleton()->RequiredParameter("--lookAhead", "How many CLs in the future, at most, shall we keep downloaded by the time it is to commit them?");
 	Arguments::GetSingleton()->OptionalParameterList("--branch", "A branch to migrate under the depot path.  May be specified more than once.  If at least one is given and the noMerge option is false, then the Git repository will include merges between branches in the history.  You may use the formatting 'depot/path:git-alias', separating the Perforce branch sub-path from the git alias name by a ':'; if the depot path contains a ':', then you must provide the git branch alias.");
 	Arguments::GetSingleton()->OptionalParameter("--noMerge", "false", "Disable performing a Git merge when a Perforce branch integrates (or copies, etc) into another branch.");
-	Arguments::GetSingleton()->OptionalParameter("--networkThreads", std::to_string(std::thread::hardware_concurrency()), "Specify the number of threads in the threadpool for running network calls. Defaults to the number of logical CPUs.");
+	Arguments::GetSingleton()->OptionalParameter("--networkThreads", std::to_string(std::thread::hardware_concurrency()), "Specify the number of threads in the threadpool for downloading file contents with p4 print. Each thread holds its own Perforce connection. Defaults to the number of logical CPUs.");
+	Arguments::GetSingleton()->OptionalParameter("--metadataThreads", std::to_string(std::thread::hardware_concurrency()), "Specify the number of threads in the threadpool for running metadata calls such as p4 describe and p4 filelog. These run separately from the p4 print calls so that large downloads never block them. Each thread holds its own Perforce connection. Defaults to the number of logical CPUs.");
+	Arguments::GetSingleton()->OptionalParameter("--cpuThreads", std::to_string(std::thread::hardware_concurrency()), "Specify the number of threads in the threadpool for CPU-bound work which needs no Perforce connection. Defaults to the number of logical CPUs.");
+	Arguments::GetSingleton()->OptionalParameter("--parallelConnects", "1", "Specify how many Perforce connections can be established at the same time while the thread pools start up and connections are refreshed. The Helix Core C++ API has been seen to crash while connecting in parallel, so connections are made one at a time unless this is raised.");
 	Arguments::GetSingleton()->OptionalParameter("--printBatch", "1", "Specify the p4 print batch size.");
+	Arguments::GetSingleton()->OptionalParameter("--changesWindow", "10000", "Specify how many consecutive CL numbers each p4 changes query spans while the changelists to convert are enumerated.");
 	Arguments::GetSingleton()->OptionalParameter("--maxChanges", "-1", "Specify the max number of changelists which should be processed in a single run. -1 signifies unlimited range.");
 	Arguments::GetSingleton()->OptionalParameter("--retries", "10", "Specify how many times a command should be retried before the process exits in a failure.");
-	Arguments::GetSingleton()->OptionalParameter("--refresh", "100", "Specify how many times a connection should be reused before it is refreshed.");
+	Arguments::GetSingleton()->OptionalParameter("--refresh", "100", "Specify how many times a connection should be reused before it is refreshed. The replacement connection is established in the background ahead of time, and the refresh points of the connections are staggered.");
 	Arguments::GetSingleton()->OptionalParameter("--fsyncEnable", "false", "Enable fsync() while writing objects to disk to ensure they get written to permanent storage immediately instead of being cached. This is to mitigate data loss in events of hardware failure.");
 	Arguments::GetSingleton()->OptionalParameter("--includeBinaries", "false", "Do not discard binary files while downloading changelists.");
 	Arguments::GetSingleton()->OptionalParameter("--flushRate", "1000", "Rate at which profiling data is flushed on the disk.");
 	Arguments::GetSingleton()->OptionalParameter("--noColor", "false", "Disable colored output.");
 	Arguments::GetSingleton()->OptionalParameter("--streamMappings", "false", "Use Mappings defined by Perforce Stream Spec for a given stream");
+	Arguments::GetSingleton()->OptionalParameter("--hedgeDownloads", "true", "Re-issue a p4 print which blocks the next commit on another connection once it runs well past the observed print latencies. The first attempt to finish is used and the others are aborted.");
+	Arguments::GetSingleton()->OptionalParameter("--hedgeMinDelay", "10", "Specify the minimum number of seconds a p4 print has to run before it can be considered stalled.");
+	Arguments::GetSingleton()->OptionalParameter("--downloadCache", "", "Specify a directory to keep the printed file revisions in, and to read them back from instead of printing them again. The directory can be shared by several p4-fusion processes on the same host. Disabled if empty.");
+	Arguments::GetSingleton()->OptionalParameter("--downloadCacheSize", "10240", "Specify the size in MB the download cache can grow to, before the least recently used revisions are removed from it.");
+	Arguments::GetSingleton()->OptionalParameter("--dedupContents", "true", "Print the contents of file revisions only once, and commit revisions with the same digest and size as an earlier one from the blob written for it. Keyword expanded and UTF-16 files are always printed.");
+	Arguments::GetSingleton()->OptionalParameter("--verifyDigests", "true", "Check the printed contents against their digest before committing other revisions from them with --dedupContents. Revisions of mismatching contents are printed again instead.");
+	Arguments::GetSingleton()->OptionalParameter("--daemon", "false", "Keep running once the depot path is converted, and convert the changelists submitted later as they come in. The connections, the Git index, the user list and the caches stay loaded in between.");
+	Arguments::GetSingleton()->OptionalParameter("--pollInterval", "10", "Specify how many seconds to wait between looking for newly submitted changelists with --daemon.");
+	Arguments::GetSingleton()->OptionalParameter("--baselineCL", "", "Specify a changelist to start the history of a new repository at. All the files of the depot path as of this CL are committed at once, and the CLs after it are converted one by one. Disabled if empty.");
+	Arguments::GetSingleton()->OptionalParameter("--segments", "1", "Specify in how many parts the history of a new repository is converted at the same time, each starting from a snapshot of the files at its first CL. The parts are then joined into the commits converting one CL after the other makes. Not supported with '--branch'.");
+	Arguments::GetSingleton()->OptionalParameter("--manifest", "", "Specify a file listing depot paths to convert into separate Git repositories in this process, instead of '--path' and '--src'. Each line holds a depot path, the path of its Git repository and optionally its branches, separated by whitespace. The conversions share the Perforce connections, the thread pools, the caches and the user list, and each one commits on its own thread.");
+	Arguments::GetSingleton()->OptionalParameter("--manifestJobs", "4", "Specify how many depot paths of the manifest are converted at the same time. All of them are with --daemon.");
+	Arguments::GetSingleton()->OptionalParameter("--metadataCache", "", "Specify a file to keep the files and descriptions of the described changelists in, and to read them back from instead of describing them again. The file can be shared by several p4-fusion processes converting from the same server. Disabled if empty.");
 
 	PRINT("p4-fusion " P4_FUSION_VERSION);
 
@@ -60,6 +689,14 @@ int Main(int argc, char** argv)
 		return 0;
 	}
 
+	const std::string manifestPath = Arguments::GetSingleton()->GetManifest();
+	if (manifestPath.empty() && (Arguments::GetSingleton()->GetDepotPath().empty() || Arguments::GetSingleton()->GetSourcePath().empty()))
+	{
+		ERR("Either '--path' and '--src', or '--manifest' are required.");
+		PRINT("Usage:" + Arguments::GetSingleton()->Help());
+		return 1;
+	}
+
 	const bool noColor = Arguments::GetSingleton()->GetNoColor() != "false";
 	if (noColor)
 	{
@@ -68,22 +705,38 @@ int Main(int argc, char** argv)
 
 	const bool noMerge = Arguments::GetSingleton()->GetNoMerge() != "false";
 
-	const std::string depotPath = Arguments::GetSingleton()->GetDepotPath();
-	const std::string srcPath = Arguments::GetSingleton()->GetSourcePath();
 	const bool fsyncEnable = Arguments::GetSingleton()->GetFsyncEnable() != "false";
 	const bool includeBinaries = Arguments::GetSingleton()->GetIncludeBinaries() != "false";
 	const int maxChanges = std::atoi(Arguments::GetSingleton()->GetMaxChanges().c_str());
+	const int changesWindow = std::atoi(Arguments::GetSingleton()->GetChangesWindow().c_str());
 	const int flushRate = std::atoi(Arguments::GetSingleton()->GetFlushRate().c_str());
-	const std::vector<std::string> branchNames = Arguments::GetSingleton()->GetBranches();
 	const bool streamMappings = Arguments::GetSingleton()->GetStreamMappings() != "false";
+	const bool hedgeDownloads = Arguments::GetSingleton()->GetHedgeDownloads() != "false";
+	const std::string downloadCache = Arguments::GetSingleton()->GetDownloadCache();
+	const std::string metadataCache = Arguments::GetSingleton()->GetMetadataCache();
+	const bool dedupContents = Arguments::GetSingleton()->GetDedupContents() != "false";
+	const bool verifyDigests = Arguments::GetSingleton()->GetVerifyDigests() != "false";
+	const bool daemon = Arguments::GetSingleton()->GetDaemon() != "false";
+	const int pollInterval = std::max(1, std::atoi(Arguments::GetSingleton()->GetPollInterval().c_str()));
+	const int segments = std::max(1, std::atoi(Arguments::GetSingleton()->GetSegments().c_str()));
+	const std::string baselineCL = Arguments::GetSingleton()->GetBaselineCL();
+	const int manifestJobs = std::max(1, std::atoi(Arguments::GetSingleton()->GetManifestJobs().c_str()));
+	const uint64_t downloadCacheSize = std::strtoull(Arguments::GetSingleton()->GetDownloadCacheSize().c_str(), nullptr, 10) * 1024 * 1024;
 
 	PRINT("Running p4-fusion from: " << argv[0]);
 
+	if (!baselineCL.empty() && baselineCL.find_first_not_of("0123456789") != std::string::npos)
+	{
+		ERR("The baseline CL should be a changelist number, got " << baselineCL);
+		return 1;
+	}
+
 	if (!P4API::InitializeLibraries())
 	{
 		return 1;
 	}
 	// Set the signal here because it gets reset after P4API library is initialized
+	StopOnSecondSignal();
 	std::signal(SIGINT, SignalHandler);
 	std::signal(SIGTERM, SignalHandler);
 
@@ -111,25 +764,25 @@ int Main(int argc, char** argv)
 
 	PRINT("Updated client workspace view " << P4API::ClientSpec.client << " with " << P4API::ClientSpec.mapping.size() << " mappings");
 
-	P4API p4;
-
-	if (!p4.IsDepotPathValid(depotPath))
+	int networkThreads = 1;
+	std::string networkThreadsStr = Arguments::GetSingleton()->GetNetworkThreads();
+	if (!networkThreadsStr.empty())
 	{
-		ERR("Depot path should begin with \"//\" and end with \"/...\". Please pass in the proper depot path and try again.");
-		return 1;
+		networkThreads = std::atoi(networkThreadsStr.c_str());
 	}
 
-	if (!p4.IsDepotPathUnderClientSpec(depotPath))
+	int metadataThreads = 1;
+	std::string metadataThreadsStr = Arguments::GetSingleton()->GetMetadataThreads();
+	if (!metadataThreadsStr.empty())
 	{
-		ERR("The depot path specified is not under the " << P4API::ClientSpec.client << " client spec. Consider changing the client spec so that it does. Exiting.");
-		return 1;
+		metadataThreads = std::atoi(metadataThreadsStr.c_str());
 	}
 
-	int networkThreads = 1;
-	std::string networkThreadsStr = Arguments::GetSingleton()->GetNetworkThreads();
-	if (!networkThreadsStr.empty())
+	int cpuThreads = 1;
+	std::string cpuThreadsStr = Arguments::GetSingleton()->GetCPUThreads();
+	if (!cpuThreadsStr.empty())
 	{
-		networkThreads = std::atoi(networkThreadsStr.c_str());
+		cpuThreads = std::atoi(cpuThreadsStr.c_str());
 	}
 
 	int printBatch = 1;
@@ -158,6 +811,238 @@ int Main(int argc, char** argv)
 		P4API::CommandRefreshThreshold = std::atoi(refreshStr.c_str());
 	}
 
+	std::string parallelConnectsStr = Arguments::GetSingleton()->GetParallelConnects();
+	if (!parallelConnectsStr.empty())
+	{
+		P4API::ConnectionSemaphore.SetLimit(std::max(1, std::atoi(parallelConnectsStr.c_str())));
+	}
+
+	ChangeList::HedgeStalledDownloads = hedgeDownloads;
+	std::string hedgeMinDelayStr = Arguments::GetSingleton()->GetHedgeMinDelay();
+	if (!hedgeMinDelayStr.empty())
+	{
+		ChangeList::HedgeMinDelayMs = std::atoll(hedgeMinDelayStr.c_str()) * 1000;
+	}
+
+	bool profiling = false;
+#if MTR_ENABLED
+	profiling = true;
+#endif
+
+	PRINT("Perforce Port: " << P4API::P4PORT);
+	PRINT("Perforce User: " << P4API::P4USER);
+	PRINT("Perforce Client: " << P4API::P4CLIENT);
+	PRINT("Network Threads: " << networkThreads);
+	PRINT("Metadata Threads: " << metadataThreads);
+	PRINT("CPU Threads: " << cpuThreads);
+	PRINT("Print Batch: " << printBatch);
+	PRINT("Look Ahead: " << lookAhead);
+	PRINT("Max Retries: " << retriesStr);
+	PRINT("Max Changes: " << maxChanges);
+	PRINT("Changes Window: " << changesWindow);
+	PRINT("Refresh Threshold: " << refreshStr);
+	PRINT("Parallel Connects: " << P4API::ConnectionSemaphore.GetLimit());
+	PRINT("Fsync Enable: " << fsyncEnable);
+	PRINT("Hedge Downloads: " << hedgeDownloads);
+	PRINT("Hedge Min Delay: " << hedgeMinDelayStr);
+	PRINT("Download Cache: " << (downloadCache.empty() ? "disabled" : downloadCache));
+	PRINT("Download Cache Size: " << downloadCacheSize / (1024 * 1024) << " MB");
+	PRINT("Metadata Cache: " << (metadataCache.empty() ? "disabled" : metadataCache));
+	PRINT("Deduplicate Contents: " << dedupContents);
+	PRINT("Verify Digests: " << verifyDigests);
+	PRINT("Daemon: " << daemon);
+	if (daemon)
+	{
+		PRINT("Poll Interval: " << pollInterval << "s");
+	}
+	PRINT("Include Binaries: " << includeBinaries);
+	PRINT("Segments: " << segments);
+	if (!baselineCL.empty())
+	{
+		PRINT("Baseline CL: " << baselineCL);
+	}
+	if (!manifestPath.empty())
+	{
+		PRINT("Manifest: " << manifestPath);
+		PRINT("Manifest Jobs: " << manifestJobs);
+	}
+	PRINT("Profiling: " << profiling);
+	PRINT("Profiling Flush Rate: " << flushRate);
+	PRINT("No Colored Output: " << noColor);
+
+	if (!DownloadCache::GetSingleton()->Initialize(downloadCache, downloadCacheSize))
+	{
+		ERR("Could not initialize the download cache. Exiting.");
+		return 1;
+	}
+	if (!MetadataCache::GetSingleton()->Initialize(metadataCache, P4API::P4PORT))
+	{
+		ERR("Could not initialize the metadata cache. Exiting.");
+		return 1;
+	}
+
+	Manifest manifest;
+	if (manifestPath.empty())
+	{
+		manifest.jobs.push_back(Manifest::Job { Arguments::GetSingleton()->GetDepotPath(), Arguments::GetSingleton()->GetSourcePath(), Arguments::GetSingleton()->GetBranches() });
+	}
+	else if (!manifest.Load(manifestPath))
+	{
+		ERR("Could not read the manifest. Exiting.");
+		return 1;
+	}
+	else
+	{
+		PRINT("Converting " << manifest.jobs.size() << " depot paths listed in " << manifestPath);
+
+		// Setup trace file generation
+		mtr_init((manifestPath + ".trace.json").c_str());
+		MTR_META_PROCESS_NAME("p4-fusion");
+		MTR_META_THREAD_NAME("Main Thread");
+		MTR_META_THREAD_SORT_INDEX(0);
+	}
+
+	PRINT("Creating " << metadataThreads << " metadata threads, " << networkThreads << " network threads and " << cpuThreads << " CPU threads");
+	ThreadPool::GetMetadataPool()->Initialize(metadataThreads);
+	ThreadPool::GetContentPool()->Initialize(networkThreads);
+	ThreadPool::GetCPUPool()->Initialize(cpuThreads);
+	SUCCESS("Created " << ThreadPool::GetMetadataPool()->GetThreadCount() << " metadata, "
+	                   << ThreadPool::GetContentPool()->GetThreadCount() << " network and "
+	                   << ThreadPool::GetCPUPool()->GetThreadCount() << " CPU threads in thread pools");
+
+	P4API p4;
+
+	ConversionOptions options;
+	options.noMerge = noMerge;
+	options.fsyncEnable = fsyncEnable;
+	options.includeBinaries = includeBinaries;
+	options.maxChanges = maxChanges;
+	options.changesWindow = changesWindow;
+	options.flushRate = flushRate;
+	options.streamMappings = streamMappings;
+	options.metadataThreads = metadataThreads;
+	options.printBatch = printBatch;
+	options.lookAhead = lookAhead;
+	options.dedupContents = dedupContents;
+	options.verifyDigests = verifyDigests;
+	options.daemon = daemon;
+	options.pollInterval = pollInterval;
+	options.segments = segments;
+	options.baselineCL = baselineCL;
+	options.traceToRepository = manifestPath.empty();
+
+	options.timezoneMinutes = p4.Info()->GetServerTimezoneMinutes();
+	SUCCESS("Perforce server timezone is " << options.timezoneMinutes << " minutes");
+
+	UserDirectory userDirectory;
+	userDirectory.users = std::move(p4.Users()->GetUserEmails());
+	SUCCESS("Received userbase details from the Perforce server");
+
+	int exitCode = 0;
+	if (manifestPath.empty())
+	{
+		exitCode = ConvertDepotPath(manifest.jobs.front(), options, userDirectory);
+	}
+	else
+	{
+		// Each conversion commits on its own thread, while they all share the
+		// thread pools. Daemons never finish, so they all need to run.
+		const size_t runnerCount = daemon ? manifest.jobs.size() : std::min<size_t>(manifestJobs, manifest.jobs.size());
+		std::atomic<size_t> nextJob(0);
+		std::atomic<int> failedJobs(0);
+		std::vector<std::thread> runners;
+		for (size_t r = 0; r < runnerCount; r++)
+		{
+			runners.emplace_back([&]()
+			    {
+				    MTR_META_THREAD_NAME("Conversion Thread");
+				    for (size_t j = nextJob++; j < manifest.jobs.size() && !IsInterrupted(); j = nextJob++)
+				    {
+					    const Manifest::Job& job = manifest.jobs.at(j);
+					    try
+					    {
+						    if (ConvertDepotPath(job, options, userDirectory) != 0)
+						    {
+							    ERR("Could not convert " << job.depotPath << " into " << job.srcPath);
+							    failedJobs++;
+						    }
+					    }
+					    catch (const std::exception& e)
+					    {
+						    // The downloads in flight still refer to the conversion.
+						    ERR("Exception occurred while converting " << job.depotPath << ": " << typeid(e).name() << ": " << e.what());
+						    ThreadPool::ShutDownAll();
+						    std::exit(1);
+					    }
+				    }
+			    });
+		}
+		for (std::thread& runner : runners)
+		{
+			runner.join();
+		}
+
+		if (failedJobs > 0)
+		{
+			ERR(failedJobs << " of " << manifest.jobs.size() << " depot paths could not be converted");
+			exitCode = 1;
+		}
+		else
+		{
+			SUCCESS("Completed conversion of " << manifest.jobs.size() << " depot paths in " << programTimer.GetTimeS() / 60.0f << " minutes");
+		}
+	}
+
+	if (InterruptSignal != 0 && exitCode == 0)
+	{
+		// As for the runs stopped at once.
+		exitCode = InterruptSignal;
+	}
+
+	PrintStats();
+	ThreadPool::ShutDownAll();
+
+	if (!P4API::ShutdownLibraries())
+	{
+		return 1;
+	}
+
+	mtr_flush();
+	mtr_shutdown();
+
+	return exitCode;
+}
+
+int ConvertDepotPath(const Manifest::Job& job, const ConversionOptions& options, UserDirectory& userDirectory)
+{
+	Timer conversionTimer;
+
+	const std::string& depotPath = job.depotPath;
+	const std::string& srcPath = job.srcPath;
+	const std::vector<std::string>& branchNames = job.branches;
+	const bool fsyncEnable = options.fsyncEnable;
+	const bool includeBinaries = options.includeBinaries;
+	int maxChanges = options.maxChanges;
+	const bool streamMappings = options.streamMappings;
+	const bool daemon = options.daemon;
+	const int pollInterval = options.pollInterval;
+	const int lookAhead = options.lookAhead;
+	const int printBatch = options.printBatch;
+
+	P4API p4;
+
+	if (!p4.IsDepotPathValid(depotPath))
+	{
+		ERR("Depot path should begin with \"//\" and end with \"/...\". Please pass in the proper depot path and try again.");
+		return 1;
+	}
+
+	if (!p4.IsDepotPathUnderClientSpec(depotPath))
+	{
+		ERR("The depot path specified is not under the " << P4API::ClientSpec.client << " client spec. Consider changing the client spec so that it does. Exiting.");
+		return 1;
+	}
+
 	std::vector<StreamResult::MappingData> mappings {};
 	std::vector<StreamResult::MappingData> exclusions {};
 
@@ -222,26 +1107,8 @@ int Main(int argc, char** argv)
 
 	BranchSet branchSet(P4API::ClientSpec.mapping, depotPath, branchNames, mappings, exclusions, includeBinaries);
 
-	bool profiling = false;
-#if MTR_ENABLED
-	profiling = true;
-#endif
-
-	PRINT("Perforce Port: " << P4API::P4PORT);
-	PRINT("Perforce User: " << P4API::P4USER);
-	PRINT("Perforce Client: " << P4API::P4CLIENT);
 	PRINT("Depot Path: " << depotPath);
-	PRINT("Network Threads: " << networkThreads);
-	PRINT("Print Batch: " << printBatch);
-	PRINT("Look Ahead: " << lookAhead);
-	PRINT("Max Retries: " << retriesStr);
-	PRINT("Max Changes: " << maxChanges);
-	PRINT("Refresh Threshold: " << refreshStr);
-	PRINT("Fsync Enable: " << fsyncEnable);
-	PRINT("Include Binaries: " << includeBinaries);
-	PRINT("Profiling: " << profiling);
-	PRINT("Profiling Flush Rate: " << flushRate);
-	PRINT("No Colored Output: " << noColor);
+	PRINT("Git Repository: " << srcPath);
 	PRINT("Inspecting " << branchSet.Count() << " branches");
 	PRINT("Stream Mapping " << streamMappings);
 	if (streamMappings)
@@ -250,6 +1117,10 @@ int Main(int argc, char** argv)
 		PRINT("Excluded paths: " << exclusions.size());
 	}
 
+	// Blobs of one repository are of no use to another.
+	BlobTable blobTable;
+	blobTable.Initialize(options.dedupContents, options.verifyDigests);
+
 	GitAPI git(fsyncEnable);
 
 	if (!git.InitializeRepository(srcPath))
@@ -258,66 +1129,226 @@ int Main(int argc, char** argv)
 		return 1;
 	}
 
-	// Setup trace file generation
-	mtr_init((srcPath + (srcPath.back() == '/' ? "" : "/") + "trace.json").c_str());
-	MTR_META_PROCESS_NAME("p4-fusion");
-	MTR_META_THREAD_NAME("Main Thread");
-	MTR_META_THREAD_SORT_INDEX(0);
+	if (options.traceToRepository)
+	{
+		// Setup trace file generation
+		mtr_init((srcPath + (srcPath.back() == '/' ? "" : "/") + "trace.json").c_str());
+		MTR_META_PROCESS_NAME("p4-fusion");
+		MTR_META_THREAD_NAME("Main Thread");
+		MTR_META_THREAD_SORT_INDEX(0);
+	}
+
+	// The changelists are enumerated in windows while the conversion runs,
+	// with the mapped stream paths merged in.
+	std::vector<std::string> changesPaths = { depotPath };
+	if (streamMappings)
+	{
+		for (auto const& mapped : mappings)
+		{
+			changesPaths.push_back(mapped.stream2);
+		}
+	}
+
+	if (!options.baselineCL.empty())
+	{
+		// Only the empty first commit is left by a run stopped before the baseline.
+		if (!git.DetectLatestCL().empty())
+		{
+			WARN("The repository already has commits, ignoring the baseline CL " << options.baselineCL);
+		}
+		else if (!ImportBaseline(depotPath, srcPath, changesPaths, branchSet, blobTable, options, userDirectory))
+		{
+			ERR("Could not import the baseline of " << depotPath << ". Exiting.");
+			return 1;
+		}
+	}
+
+	// Left behind by a run which did not finish converting in segments, with
+	// the branch still on the empty first commit.
+	if (git.DeleteReferences(SegmentRefPrefix) > 0)
+	{
+		WARN("Deleted the references of an unfinished conversion in segments");
+	}
+
+	if (options.segments > 1 && (!git.IsHEADExists() || git.DetectLatestCL().empty()))
+	{
+		if (!branchNames.empty())
+		{
+			// The merges between branches cannot be copied onto other parents.
+			WARN("Converting in segments is not supported with branches, converting the CLs one by one");
+		}
+		else
+		{
+			// The conversion then continues from the last CL committed.
+			const int committedCount = ConvertInSegments(git, depotPath, srcPath, changesPaths, branchSet, options, userDirectory, daemon ? -1 : maxChanges);
+			if (maxChanges != -1)
+			{
+				maxChanges = std::max(0, maxChanges - committedCount);
+			}
+		}
+	}
+
+	if (IsInterrupted())
+	{
+		WARN("Stopped the conversion into " << srcPath << " on interrupt before converting the CLs one by one");
+		return 0;
+	}
+
+	const std::string statePath = ConversionState::GetPath(srcPath);
+	ConversionState state;
+	state.depotPath = depotPath;
 
 	std::string resumeFromCL;
 	if (git.IsHEADExists())
 	{
-		if (!git.IsRepositoryClonedFrom(depotPath))
+		ConversionState savedState;
+		const bool hasSavedState = savedState.Load(statePath);
+		if (hasSavedState ? savedState.depotPath != depotPath : !git.IsRepositoryClonedFrom(depotPath))
 		{
 			ERR("Git repository at " << srcPath << " was not initially cloned with depotPath = " << depotPath << ". Exiting.");
 			return 1;
 		}
 
-		resumeFromCL = git.DetectLatestCL();
-		WARN("Detected last CL committed as CL " << resumeFromCL);
-	}
+		// The saved state is only current if no branch moved after it was
+		// written, e.g. by a crash between a commit and the state update.
+		state.branchTips = git.GetBranchTips();
+		if (hasSavedState && savedState.branchTips == state.branchTips)
+		{
+			resumeFromCL = savedState.lastCL;
+			WARN("Resuming after CL " << resumeFromCL << " from " << statePath);
+		}
+		else
+		{
+			resumeFromCL = git.DetectLatestCL();
+			WARN("Detected last CL committed as CL " << resumeFromCL);
+		}
 
-	PRINT("Requesting changelists to convert from the Perforce server");
+		// The first commit never changes, so it can be reused even from an outdated state.
+		if (hasSavedState && !git.SetFirstCommit(savedState.rootCommit))
+		{
+			WARN("First commit " << savedState.rootCommit << " in " << statePath << " was not found, looking it up in the history");
+		}
+	}
 
-	std::vector<ChangeList> changes = std::move(p4.Changes(depotPath, resumeFromCL, maxChanges)->GetChanges());
+	CommitIndex commitIndex;
+	if (!commitIndex.Open(srcPath, true, fsyncEnable))
+	{
+		ERR("Could not open the commit index in " << srcPath << ". Exiting.");
+		return 1;
+	}
 
-	if (streamMappings)
+	// A crash between a commit and its record leaves the commit at the tip
+	// of its branch. Indexes started by an older version are not filled in.
+	if (!commitIndex.IsEmpty())
 	{
-		PRINT("Path: " << depotPath << " has " << changes.size() << " changes!");
-		for (auto const& mapped : mappings)
+		std::vector<CommitIndex::Commit> missingCommits;
+		for (auto const& tip : state.branchTips)
 		{
-			std::vector<ChangeList> temp = std::move(p4.Changes(mapped.stream2, resumeFromCL, maxChanges)->GetChanges());
-			PRINT("Path: " << mapped.stream2 << " has " << temp.size() << " changes!");
-			changes.insert(changes.end(), std::make_move_iterator(temp.begin()), std::make_move_iterator(temp.end()));
+			CommitIndex::Commit indexed;
+			const std::string cl = commitIndex.FindChange(tip.second, indexed) ? "" : git.GetCommitCL(tip.second);
+			if (!cl.empty() && std::stoll(cl) >= commitIndex.GetLastCL())
+			{
+				missingCommits.push_back(CommitIndex::Commit { cl, tip.first, tip.second });
+			}
 		}
-		std::sort(changes.begin(), changes.end());
-		// Truncate excess changes
-		if ((maxChanges > -1) && (changes.size() > maxChanges))
+		std::sort(missingCommits.begin(), missingCommits.end(), [](const CommitIndex::Commit& a, const CommitIndex::Commit& b)
+		    { return std::stoll(a.cl) < std::stoll(b.cl); });
+		for (const CommitIndex::Commit& commit : missingCommits)
 		{
-			// We don't need to consider the case if this ever expands the vector.
-			changes.resize(maxChanges);
+			WARN("Adding commit " << commit.oid << " of CL " << commit.cl << " missing from the commit index");
+			commitIndex.Append(commit.cl, commit.branch, commit.oid);
 		}
 	}
 
+	PRINT("Requesting changelists to convert from the Perforce server");
+
+	if (daemon && maxChanges != -1)
+	{
+		// Stopping short of the latest changelist leaves a gap the polls would skip.
+		WARN("Ignoring --maxChanges in daemon mode");
+	}
+	ChangeEnumerator enumerator(changesPaths, options.changesWindow, options.metadataThreads, daemon ? -1 : maxChanges);
+	enumerator.Start(p4, resumeFromCL);
+	const ChangeHistory& changes = enumerator.GetChanges();
+
+	// Blocks until the changelist at `index` is submitted, in daemon mode.
+	// Returns false if interrupted before.
+	auto waitForChanges = [&](const size_t& index) -> bool
+	{
+		PRINT("Waiting for new changelists, looking every " << pollInterval << "s");
+		mtr_flush();
+		while (true)
+		{
+			std::this_thread::sleep_for(std::chrono::seconds(pollInterval));
+			if (IsInterrupted())
+			{
+				return false;
+			}
+
+			bool hasNewChanges = false;
+			try
+			{
+				hasNewChanges = enumerator.Poll(p4);
+			}
+			catch (const std::exception& e)
+			{
+				// The server may be down for a while, which is no reason to stop.
+				WARN("Could not look for new changelists: " << e.what());
+			}
+			if (hasNewChanges && enumerator.WaitFor(index))
+			{
+				break;
+			}
+		}
+		userDirectory.MarkStale();
+		SUCCESS("Found new CLs starting from CL " << changes.GetNumber(index));
+		return true;
+	};
+
 	// Return early if we have no work to do
-	if (changes.empty())
+	if (!enumerator.WaitFor(0))
 	{
-		SUCCESS("Repository is up to date. Exiting.");
-		return 0;
+		if (!daemon)
+		{
+			SUCCESS("Repository is up to date. Exiting.");
+			return 0;
+		}
+		SUCCESS("Repository is up to date");
+		if (!waitForChanges(0))
+		{
+			WARN("Stopped waiting for new changelists on interrupt");
+			return 0;
+		}
 	}
 
 	// The changes are received in chronological order
-	SUCCESS("Found " << changes.size() << " uncloned CLs starting from CL " << changes.front().number << " to CL " << changes.back().number);
-
-	PRINT("Creating " << networkThreads << " network threads");
-	ThreadPool::GetSingleton()->Initialize(networkThreads);
-	SUCCESS("Created " << ThreadPool::GetSingleton()->GetThreadCount() << " threads in thread pool");
+	SUCCESS("Found uncloned CLs starting from CL " << changes.GetNumber(0));
+
+	// Only the changelists in flight are expanded, into a ring of slots.
+	// The slot of a committed changelist is reused for the changelist
+	// `lookAhead` positions later.
+	const size_t slotCount = std::max(1, lookAhead);
+	std::unique_ptr<ChangeList[]> slots(new ChangeList[slotCount]);
+	auto getSlot = [&slots, &slotCount](const size_t& index) -> ChangeList&
+	{ return slots[index % slotCount]; };
+	for (size_t slot = 0; slot < slotCount; slot++)
+	{
+		slots[slot].blobTable = &blobTable;
+	}
+	auto scheduleChange = [&](const size_t& index)
+	{
+		ChangeList& cl = getSlot(index);
+		cl.Reset(changes.GetNumber(index), changes.GetDescription(index), changes.GetUser(index), changes.GetTimestamp(index));
+		cl.PrepareDownload(branchSet);
+		cl.StartDownload(printBatch);
+	};
 
 	// Go in the chronological order
 	size_t lastDownloadedCL = 0;
-	for (size_t currentCL = 0; currentCL < changes.size() && currentCL < lookAhead; currentCL++)
+	for (size_t currentCL = 0; currentCL < slotCount && enumerator.WaitFor(currentCL); currentCL++)
 	{
-		ChangeList& cl = changes.at(currentCL);
+		ChangeList& cl = getSlot(currentCL);
+		cl.Reset(changes.GetNumber(currentCL), changes.GetDescription(currentCL), changes.GetUser(currentCL), changes.GetTimestamp(currentCL));
 
 		// Start gathering changed files with `p4 describe` or `p4 filelog`
 		cl.PrepareDownload(branchSet);
@@ -327,171 +1358,210 @@ int Main(int argc, char** argv)
 
 	// This is intentionally put in a separate loop.
 	// We want to submit `p4 describe` commands before sending any of the `p4 print` commands.
-	// Gives ~15% perf boost.
+	// The downloads only start once the describe of their CL has finished.
 	int startupDownloadsCount = 0;
 	for (size_t currentCL = 0; currentCL <= lastDownloadedCL; currentCL++)
 	{
-		ChangeList& cl = changes.at(currentCL);
+		ChangeList& cl = getSlot(currentCL);
 
 		// Start running `p4 print` on changed files when the describe is finished
 		cl.StartDownload(printBatch);
 		startupDownloadsCount++;
 	}
 
-	SUCCESS("Queued first " << startupDownloadsCount << " CLs up until CL " << changes.at(lastDownloadedCL).number << " for downloading");
-
-	int timezoneMinutes = p4.Info()->GetServerTimezoneMinutes();
-	SUCCESS("Perforce server timezone is " << timezoneMinutes << " minutes");
-
-	// Map usernames to emails
-	const std::unordered_map<UsersResult::UserID, UsersResult::UserData> users = std::move(p4.Users()->GetUserEmails());
-	SUCCESS("Received userbase details from the Perforce server");
+	SUCCESS("Queued first " << startupDownloadsCount << " CLs up until CL " << changes.GetNumber(lastDownloadedCL) << " for downloading");
 
 	// Commit procedure start
 	Timer commitTimer;
 
-	PRINT("Last CL to start downloading is CL " << changes.at(lastDownloadedCL).number);
+	PRINT("Last CL to start downloading is CL " << changes.GetNumber(lastDownloadedCL));
 
 	git.CreateIndex();
-	for (size_t i = 0; i < changes.size(); i++)
+	state.rootCommit = git.GetFirstCommit();
+	// Includes the branch of the first commit on a new repository, which
+	// the commits of branch groups never move.
+	state.branchTips = git.GetBranchTips();
+	bool isInterrupted = false;
+	for (size_t i = 0;; i++)
 	{
+		if (!enumerator.WaitFor(i))
+		{
+			if (!daemon)
+			{
+				break;
+			}
+			if (!waitForChanges(i))
+			{
+				isInterrupted = true;
+				break;
+			}
+
+			// The changelists before were all committed, so every slot is free.
+			scheduleChange(i);
+			lastDownloadedCL = i;
+			while (lastDownloadedCL + 1 < i + slotCount && enumerator.WaitFor(lastDownloadedCL + 1))
+			{
+				lastDownloadedCL++;
+				scheduleChange(lastDownloadedCL);
+			}
+		}
+
 		// See if the threadpool encountered any exceptions
 		try
 		{
-			ThreadPool::GetSingleton()->RaiseCaughtExceptions();
+			ThreadPool::RaiseAllCaughtExceptions();
 		}
 		catch (const std::exception& e)
 		{
 			// This is unrecoverable
 			ERR("Threadpool encountered an exception: " << e.what());
-			ThreadPool::GetSingleton()->ShutDown();
+			ThreadPool::ShutDownAll();
 			std::exit(1);
 		}
 
-		ChangeList& cl = changes.at(i);
-
-		// Ensure the files are downloaded before committing them to the repository
-		cl.WaitForDownload();
-
-		std::string fullName = cl.user;
-		std::string email = "deleted@user";
-		if (users.find(cl.user) != users.end())
+		ChangeList& cl = getSlot(i);
+
+		// The branch groups are only known once the changelist is described
+		cl.WaitForDescribe();
+
+		std::string fullName;
+		std::string email;
+		userDirectory.GetAuthor(p4, cl.user, fullName, email);
+
+		CommitChangeList(git, cl, blobTable, depotPath, fullName, email, options, [&](const BranchedFileGroup& branchGroup, const std::string& commitSHA)
+		    {
+			    const std::string branchRef = git.GetHeadBranchRef();
+			    state.branchTips[branchRef] = commitSHA;
+			    if (!commitIndex.Append(cl.number, branchRef, commitSHA))
+			    {
+				    WARN("Could not add commit " << commitSHA << " of CL " << cl.number << " to the commit index");
+			    }
+
+			    // For scripting/testing purposes...
+			    PRINT("COMMIT:" << commitSHA << ":" << cl.number << ":" << branchGroup.targetBranch << ":");
+			    SUCCESS(
+			        "CL " << cl.number << " --> Commit " << commitSHA
+			              << " with " << branchGroup.GetFileCount() << " files"
+			              << (branchGroup.targetBranch.empty()
+			                         ? ""
+			                         : (" to branch " + branchGroup.targetBranch))
+			              << (branchGroup.sourceBranch.empty()
+			                         ? ""
+			                         : (" from branch " + branchGroup.sourceBranch))
+			              << ".");
+		    });
+		SUCCESS(
+		    "CL " << cl.number << " with "
+		          << cl.changedFileGroups->totalFileCount << " files (" << i + 1 << "/" << changes.GetSize() << (enumerator.IsComplete() ? "" : "+")
+		          << "|" << lastDownloadedCL - (long long)i
+		          << "). Elapsed " << commitTimer.GetTimeS() / 60.0f << " mins. "
+		          << ((commitTimer.GetTimeS() / 60.0f) / (float)(i + 1)) * (changes.GetSize() - i - 1) << " mins left.");
+		// A failed update only costs a look at the branch tips on the next run.
+		state.lastCL = cl.number;
+		state.nextCL = i + 1 < changes.GetSize() ? changes.GetNumber(i + 1) : "";
+		if (!state.Save(statePath, fsyncEnable))
 		{
-			fullName = users.at(cl.user).fullName;
-			email = users.at(cl.user).email;
+			WARN("Could not update the conversion state after CL " << cl.number);
 		}
 
-		for (auto& branchGroup : cl.changedFileGroups->branchedFileGroups)
+		// Clear out finished changelist, once no print job can touch it anymore.
+		cl.WaitForDownload();
+		cl.Clear();
+
+		if (IsInterrupted())
 		{
-			if (!branchGroup.targetBranch.empty())
+			// The changelists in flight are converted by the next run. The print
+			// jobs already running still finish, so that what they download is
+			// kept in the download cache, and the others are dropped.
+			for (size_t next = i + 1; next <= lastDownloadedCL; next++)
 			{
-				git.SetActiveBranch(branchGroup.targetBranch);
+				getSlot(next).Cancel();
 			}
-
-			for (auto& file : branchGroup.files)
+			for (size_t next = i + 1; next <= lastDownloadedCL; next++)
 			{
-				if (file.IsDeleted())
-				{
-					git.RemoveFileFromIndex(file.GetRelativePath());
-				}
-				else
-				{
-					git.AddFileToIndex(file.GetRelativePath(), file.GetContents(), file.IsExecutable());
-				}
-
-				// No use for keeping the contents in memory once it has been added
-				file.Clear();
+				getSlot(next).WaitForDownload();
+				getSlot(next).Clear();
 			}
-
-			std::string mergeFrom = "";
-			if (branchGroup.hasSource && !noMerge)
-			{
-				// Only perform merging if the branch group explicitly declares that the change
-				// has a source, and if the user wants merging.
-				mergeFrom = branchGroup.sourceBranch;
-			}
-
-			std::string commitSHA = git.Commit(depotPath,
-			    cl.number,
-			    fullName,
-			    email,
-			    timezoneMinutes,
-			    cl.description,
-			    cl.timestamp,
-			    mergeFrom);
-
-			// For scripting/testing purposes...
-			PRINT("COMMIT:" << commitSHA << ":" << cl.number << ":" << branchGroup.targetBranch << ":");
-			SUCCESS(
-			    "CL " << cl.number << " --> Commit " << commitSHA
-			          << " with " << branchGroup.files.size() << " files"
-			          << (branchGroup.targetBranch.empty()
-			                     ? ""
-			                     : (" to branch " + branchGroup.targetBranch))
-			          << (branchGroup.sourceBranch.empty()
-			                     ? ""
-			                     : (" from branch " + branchGroup.sourceBranch))
-			          << ".");
+			isInterrupted = true;
+			break;
 		}
-		SUCCESS(
-		    "CL " << cl.number << " with "
-		          << cl.changedFileGroups->totalFileCount << " files (" << i + 1 << "/" << changes.size()
-		          << "|" << lastDownloadedCL - (long long)i
-		          << "). Elapsed " << commitTimer.GetTimeS() / 60.0f << " mins. "
-		          << ((commitTimer.GetTimeS() / 60.0f) / (float)(i + 1)) * (changes.size() - i - 1) << " mins left.");
-		// Clear out finished changelist.
-		cl.Clear();
 
 		// Start downloading the CL chronologically after the last CL that was previously downloaded, if there's still some left
-		if (lastDownloadedCL + 1 < changes.size())
+		if (enumerator.WaitFor(lastDownloadedCL + 1))
 		{
 			lastDownloadedCL++;
-			ChangeList& downloadCL = changes.at(lastDownloadedCL);
-			downloadCL.PrepareDownload(branchSet);
-			downloadCL.StartDownload(printBatch);
+			scheduleChange(lastDownloadedCL);
 		}
 
 		// Occasionally flush the profiling data
-		if ((i % flushRate) == 0)
+		if ((i % options.flushRate) == 0)
 		{
 			mtr_flush();
+			PrintStats();
+			if (blobTable.IsEnabled())
+			{
+				PRINT(blobTable.GetStats());
+			}
 		}
-
-		// Deallocate this CL's metadata from memory
-		cl.Clear();
 	}
 	git.CloseIndex();
+	commitIndex.Close();
 
-	SUCCESS("Completed conversion of " << changes.size() << " CLs in " << programTimer.GetTimeS() / 60.0f << " minutes, taking " << commitTimer.GetTimeS() / 60.0f << " to commit CLs");
-
-	ThreadPool::GetSingleton()->ShutDown();
-
-	if (!P4API::ShutdownLibraries())
+	if (isInterrupted)
 	{
-		return 1;
+		WARN("Stopped the conversion into " << srcPath << " on interrupt after CL " << state.lastCL << ", the next run resumes from there");
+		return 0;
 	}
 
-	mtr_flush();
-	mtr_shutdown();
+	SUCCESS("Completed conversion of " << changes.GetSize() << " CLs into " << srcPath << " in " << conversionTimer.GetTimeS() / 60.0f << " minutes, taking " << commitTimer.GetTimeS() / 60.0f << " to commit CLs");
+	if (blobTable.IsEnabled())
+	{
+		PRINT(blobTable.GetStats());
+	}
 
 	return 0;
 }
 
 void SignalHandler(sig_atomic_t s)
 {
-	static bool called = false;
-	if (called)
+	int expected = 0;
+	if (InterruptSignal.compare_exchange_strong(expected, s))
 	{
-		WARN("Already received an interrupt signal, waiting for threads to shutdown.");
+		// Reported by IsInterrupted().
 		return;
 	}
-	called = true;
 
-	ERR("Signal Received: " << strsignal(s));
+	// Only write(2) is safe to call here.
+	const char received = (char)s;
+	const ssize_t written = write(InterruptPipe[1], &received, 1);
+	(void)written;
+}
 
-	ThreadPool::GetSingleton()->ShutDown();
+static void StopOnSecondSignal()
+{
+	if (pipe(InterruptPipe) != 0)
+	{
+		WARN("Could not create the interrupt pipe, a second signal will not stop the process at once");
+		return;
+	}
 
-	std::exit(s);
+	std::thread([]()
+	    {
+		    char received = 0;
+		    ssize_t count = 0;
+		    while ((count = read(InterruptPipe[0], &received, 1)) != 1)
+		    {
+			    if (count == 0 || errno != EINTR)
+			    {
+				    return;
+			    }
+		    }
+
+		    ERR("Signal Received: " << strsignal(received) << ", stopping at once");
+		    ThreadPool::ShutDownAll();
+		    std::exit(received);
+	    })
+	    .detach();
 }
 
 int main(int argc, char** argv)
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "manifest.h"
+
+#include <fstream>
+#include <sstream>
+#include <set>
+
+bool Manifest::Load(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		ERR("Could not open the manifest " << path);
+		return false;
+	}
+	return Parse(file, path);
+}
+
+bool Manifest::Parse(std::istream& input, const std::string& name)
+{
+	std::vector<Job> parsed;
+	std::set<std::string> srcPaths;
+
+	std::string line;
+	for (int lineNumber = 1; std::getline(input, line); lineNumber++)
+	{
+		std::istringstream fields(line);
+		Job job;
+		if (!(fields >> job.depotPath) || job.depotPath[0] == '#')
+		{
+			continue;
+		}
+		if (!(fields >> job.srcPath))
+		{
+			ERR(name << ":" << lineNumber << ": Expected a Git repository path after " << job.depotPath);
+			return false;
+		}
+		std::string branch;
+		while (fields >> branch)
+		{
+			job.branches.push_back(branch);
+		}
+
+		// Two conversions into the same repository would overwrite each other.
+		if (!srcPaths.insert(job.srcPath).second)
+		{
+			ERR(name << ":" << lineNumber << ": The Git repository " << job.srcPath << " is already converted into by an earlier line");
+			return false;
+		}
+		parsed.push_back(job);
+	}
+
+	jobs = std::move(parsed);
+	return true;
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+// The conversions to run in a single process, one per line of a file:
+//
+//     <depot path> <git repository path> [branch ...]
+//
+// Separated by whitespace, where the branches take the form of '--branch'.
+// Empty lines and lines starting with '#' are skipped.
+struct Manifest
+{
+	struct Job
+	{
+		std::string depotPath;
+		std::string srcPath;
+		std::vector<std::string> branches;
+	};
+
+	std::vector<Job> jobs;
+
+	// Returns false if the file cannot be read or has a malformed line.
+	bool Load(const std::string& path);
+	bool Parse(std::istream& input, const std::string& name);
+};
@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "metadata_cache.h"
+
+#include <sstream>
+#include <iomanip>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const uint32_t RecordMagic = 0x4d463450; // "P4FM"
+
+static uint32_t Checksum(const char* data, const size_t& size)
+{
+	// FNV-1a
+	uint32_t hash = 0x811c9dc5;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= (unsigned char)data[i];
+		hash *= 0x01000193;
+	}
+	return hash;
+}
+
+namespace
+{
+struct PayloadWriter
+{
+	std::string data;
+
+	void PutU32(const uint32_t& value) { data.append((const char*)&value, sizeof(value)); }
+	void PutI32(const int32_t& value) { data.append((const char*)&value, sizeof(value)); }
+	void PutI64(const int64_t& value) { data.append((const char*)&value, sizeof(value)); }
+	void PutU8(const uint8_t& value) { data.push_back((char)value); }
+	void PutString(const std::string& value)
+	{
+		PutU32(value.size());
+		data.append(value);
+	}
+};
+
+// Reads from the mapped file, failing instead of reading past the payload.
+struct PayloadReader
+{
+	const char* data;
+	const char* end;
+	bool isValid;
+
+	template <typename T>
+	T Get()
+	{
+		T value = 0;
+		if (end - data < (ptrdiff_t)sizeof(T))
+		{
+			isValid = false;
+			return value;
+		}
+		std::memcpy(&value, data, sizeof(T));
+		data += sizeof(T);
+		return value;
+	}
+
+	const char* GetBytes(uint32_t& size)
+	{
+		size = Get<uint32_t>();
+		if (!isValid || (size_t)(end - data) < size)
+		{
+			isValid = false;
+			size = 0;
+			return data;
+		}
+		const char* bytes = data;
+		data += size;
+		return bytes;
+	}
+};
+}
+
+MetadataCache* MetadataCache::GetSingleton()
+{
+	static MetadataCache singleton;
+	return &singleton;
+}
+
+MetadataCache::MetadataCache()
+    : m_Fd(-1)
+    , m_Mapped(nullptr)
+    , m_MappedSize(0)
+    , m_Hits(0)
+    , m_Misses(0)
+    , m_Stores(0)
+{
+}
+
+MetadataCache::~MetadataCache()
+{
+	Close();
+}
+
+bool MetadataCache::Initialize(const std::string& path, const std::string& server)
+{
+	Close();
+	if (path.empty())
+	{
+		return true;
+	}
+
+	m_Fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+	if (m_Fd < 0)
+	{
+		ERR("Could not open the metadata cache " << path << ": " << strerror(errno));
+		return false;
+	}
+	m_Path = path;
+
+	// Keeps other processes from appending while the records are checked.
+	flock(m_Fd, LOCK_EX);
+
+	struct stat fileStat;
+	if (fstat(m_Fd, &fileStat) != 0)
+	{
+		ERR("Could not read the size of " << path << ": " << strerror(errno));
+		Close();
+		return false;
+	}
+	if (fileStat.st_size > 0)
+	{
+		void* mapped = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_SHARED, m_Fd, 0);
+		if (mapped == MAP_FAILED)
+		{
+			ERR("Could not map " << path << ": " << strerror(errno));
+			Close();
+			return false;
+		}
+		m_Mapped = (const char*)mapped;
+		m_MappedSize = fileStat.st_size;
+	}
+
+	std::string cachedServer;
+	size_t offset = 0;
+	while (offset + sizeof(RecordHeader) <= m_MappedSize)
+	{
+		RecordHeader header;
+		std::memcpy(&header, m_Mapped + offset, sizeof(header));
+		const size_t payloadOffset = offset + sizeof(header);
+		if (header.magic != RecordMagic
+		    || header.kind > FileLog
+		    || header.size > m_MappedSize - payloadOffset
+		    || header.checksum != Checksum(m_Mapped + payloadOffset, header.size))
+		{
+			break;
+		}
+
+		if (header.kind == Server)
+		{
+			cachedServer.assign(m_Mapped + payloadOffset, header.size);
+		}
+		else
+		{
+			m_Offsets[header.kind][header.cl] = payloadOffset;
+		}
+		offset = payloadOffset + header.size;
+	}
+
+	if (offset != m_MappedSize)
+	{
+		WARN("Dropping an incomplete record at the end of the metadata cache " << path);
+		if (ftruncate(m_Fd, offset) != 0)
+		{
+			ERR("Could not truncate " << path << ": " << strerror(errno));
+			Close();
+			return false;
+		}
+	}
+
+	bool isUsable = true;
+	if (offset == 0)
+	{
+		isUsable = append(0, Server, server);
+	}
+	else if (cachedServer != server)
+	{
+		ERR("The metadata cache " << path << " was filled from " << (cachedServer.empty() ? "an unknown server" : cachedServer) << ", not from " << server);
+		isUsable = false;
+	}
+
+	flock(m_Fd, LOCK_UN);
+	if (!isUsable)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void MetadataCache::Close()
+{
+	if (m_Mapped)
+	{
+		munmap((void*)m_Mapped, m_MappedSize);
+		m_Mapped = nullptr;
+		m_MappedSize = 0;
+	}
+	if (m_Fd >= 0)
+	{
+		close(m_Fd);
+		m_Fd = -1;
+	}
+	for (auto& offsets : m_Offsets)
+	{
+		offsets.clear();
+	}
+}
+
+bool MetadataCache::append(const int64_t& cl, const Kind& kind, const std::string& payload)
+{
+	RecordHeader header = {};
+	header.magic = RecordMagic;
+	header.size = payload.size();
+	header.cl = cl;
+	header.kind = kind;
+	header.checksum = Checksum(payload.data(), payload.size());
+
+	// Written at once, so that records of several threads and processes
+	// never interleave.
+	std::string record((const char*)&header, sizeof(header));
+	record += payload;
+
+	std::lock_guard<std::mutex> lock(m_AppendMutex);
+	flock(m_Fd, LOCK_EX);
+	size_t written = 0;
+	while (written < record.size())
+	{
+		const ssize_t result = write(m_Fd, record.data() + written, record.size() - written);
+		if (result < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (result < 0)
+		{
+			break;
+		}
+		written += result;
+	}
+	flock(m_Fd, LOCK_UN);
+
+	if (written != record.size())
+	{
+		WARN("Could not append CL " << cl << " to the metadata cache " << m_Path << ": " << strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+bool MetadataCache::Get(const std::string& cl, const Kind& kind, std::string& description, FileTable& files)
+{
+	if (!IsEnabled())
+	{
+		return false;
+	}
+
+	auto offsetIt = m_Offsets[kind].find(std::stoll(cl));
+	if (offsetIt == m_Offsets[kind].end())
+	{
+		m_Misses++;
+		return false;
+	}
+
+	RecordHeader header;
+	std::memcpy(&header, m_Mapped + offsetIt->second - sizeof(header), sizeof(header));
+	PayloadReader reader { m_Mapped + offsetIt->second, m_Mapped + offsetIt->second + header.size, true };
+
+	uint32_t size = 0;
+	const char* bytes = reader.GetBytes(size);
+	description.assign(bytes, size);
+
+	const uint32_t fileCount = reader.Get<uint32_t>();
+	for (uint32_t i = 0; i < fileCount && reader.isValid; i++)
+	{
+		uint32_t depotFileSize = 0;
+		const char* depotFile = reader.GetBytes(depotFileSize);
+		const int32_t revision = reader.Get<int32_t>();
+		const uint8_t action = reader.Get<uint8_t>();
+		const uint8_t typeFlags = reader.Get<uint8_t>();
+		uint32_t digestSize = 0;
+		const char* digest = reader.GetBytes(digestSize);
+		const int64_t fileSize = reader.Get<int64_t>();
+		uint32_t fromDepotFileSize = 0;
+		const char* fromDepotFile = reader.GetBytes(fromDepotFileSize);
+		const int32_t fromRevision = reader.Get<int32_t>();
+		if (!reader.isValid)
+		{
+			break;
+		}
+
+		const size_t row = files.AddFile(depotFile, depotFileSize, revision, (FileAction)action, typeFlags);
+		files.SetDigest(row, digest, digestSize);
+		files.SetFileSize(row, fileSize);
+		if (fromDepotFileSize > 0)
+		{
+			files.SetFromDepotFile(row, fromDepotFile, fromDepotFileSize, fromRevision);
+		}
+	}
+
+	if (!reader.isValid)
+	{
+		// The checksum matched, so the record was written by another version.
+		WARN("Ignoring the unreadable record of CL " << cl << " in the metadata cache " << m_Path);
+		files.Clear();
+		m_Misses++;
+		return false;
+	}
+
+	m_Hits++;
+	return true;
+}
+
+void MetadataCache::Put(const std::string& cl, const Kind& kind, const std::string& description, const FileTable& files)
+{
+	if (!IsEnabled())
+	{
+		return;
+	}
+
+	PayloadWriter writer;
+	writer.PutString(description);
+	writer.PutU32(files.GetSize());
+	for (size_t row = 0; row < files.GetSize(); row++)
+	{
+		writer.PutString(files.GetDepotFile(row));
+		writer.PutI32(files.GetRevision(row));
+		writer.PutU8(files.GetAction(row));
+		writer.PutU8(files.GetTypeFlags(row));
+		writer.PutString(files.GetDigest(row));
+		writer.PutI64(files.GetFileSize(row));
+		writer.PutString(files.GetFromDepotFile(row));
+		writer.PutI32(files.GetFromRevision(row));
+	}
+
+	if (append(std::stoll(cl), kind, writer.data))
+	{
+		m_Stores++;
+	}
+}
+
+std::string MetadataCache::GetStats()
+{
+	const long long hits = m_Hits;
+	const long long misses = m_Misses;
+
+	std::ostringstream stats;
+	stats << std::fixed << std::setprecision(2)
+	      << "Metadata cache: " << hits << " hits, " << misses << " misses ("
+	      << (hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0) << "% hit rate), "
+	      << m_Stores << " stored";
+	return stats.str();
+}
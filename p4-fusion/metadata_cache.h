@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+
+#include "common.h"
+#include "commands/file_table.h"
+
+// Keeps the files and descriptions of the changelists described so far
+// in a file, so that reruns and re-conversions with other options do not
+// describe them again. Submitted changelists never change, so records
+// are only ever appended, each with a checksum. The records present when
+// the file is opened are memory mapped and indexed by CL; a record cut
+// short by a crash ends the file and is dropped. The file starts with a
+// record of the server it was filled from, and is not used for others.
+class MetadataCache
+{
+public:
+	enum Kind : uint8_t
+	{
+		Server,
+		Describe,
+		FileLog,
+	};
+
+	struct RecordHeader
+	{
+		uint32_t magic;
+		uint32_t size; // Of the payload following the header
+		int64_t cl;
+		uint8_t kind;
+		uint8_t reserved[3];
+		uint32_t checksum; // Of the payload
+	};
+
+private:
+	std::string m_Path;
+	int m_Fd;
+	const char* m_Mapped;
+	size_t m_MappedSize;
+	// Offsets of the payloads in the mapped file, by CL and kind.
+	std::unordered_map<int64_t, size_t> m_Offsets[FileLog + 1];
+	std::mutex m_AppendMutex;
+
+	std::atomic<long long> m_Hits;
+	std::atomic<long long> m_Misses;
+	std::atomic<long long> m_Stores;
+
+	MetadataCache();
+
+	bool append(const int64_t& cl, const Kind& kind, const std::string& payload);
+
+public:
+	static MetadataCache* GetSingleton();
+
+	~MetadataCache();
+
+	// An empty path disables the cache. Returns false if the file cannot be
+	// used, e.g. because it was filled from another server.
+	bool Initialize(const std::string& path, const std::string& server);
+	void Close();
+	bool IsEnabled() const { return m_Fd >= 0; }
+
+	// Adds the cached files of the CL to `files`, which is expected to be empty.
+	bool Get(const std::string& cl, const Kind& kind, std::string& description, FileTable& files);
+	void Put(const std::string& cl, const Kind& kind, const std::string& description, const FileTable& files);
+
+	std::string GetStats();
+};
@@ -8,6 +8,7 @@
 
 #include <csignal>
 #include <memory>
+#include <algorithm>
 
 #include "commands/stream_result.h"
 #include "utils/std_helpers.h"
@@ -23,8 +24,10 @@ std::string P4API::P4CLIENT;
 int P4API::CommandRetries = 1;
 int P4API::CommandRefreshThreshold = 1;
 std::mutex P4API::InitializationMutex;
+Semaphore P4API::ConnectionSemaphore(1);
 
 P4API::P4API()
+    : m_Refresh(std::random_device()())
 {
 	if (!Initialize())
 	{
@@ -35,22 +38,30 @@ P4API::P4API()
 	AddClientSpecView(ClientSpec.mapping);
 }
 
-bool P4API::Initialize()
+bool P4API::InitializeClient(ClientApi& client)
 {
 	MTR_SCOPE("P4", __func__);
 
-	// Helix Core C++ API seems to crash while making connections parallely.
-	std::unique_lock<std::mutex> lock(InitializationMutex);
-
 	Error e;
 	StrBuf msg;
 
-	m_Usage = 0;
-	m_ClientAPI.SetPort(P4PORT.c_str());
-	m_ClientAPI.SetUser(P4USER.c_str());
-	m_ClientAPI.SetClient(P4CLIENT.c_str());
-	m_ClientAPI.SetProtocol("tag", "");
-	m_ClientAPI.Init(&e);
+	{
+		// Helix Core C++ API seems to crash while making connections parallely.
+		std::unique_lock<std::mutex> lock(InitializationMutex);
+
+		client.SetPort(P4PORT.c_str());
+		client.SetUser(P4USER.c_str());
+		client.SetClient(P4CLIENT.c_str());
+		client.SetProtocol("tag", "");
+	}
+
+	{
+		// Connecting to a remote SSL server takes several round trips. This is
+		// still one connection at a time by default, for the crashes above, and
+		// only runs in parallel when --parallelConnects allows it.
+		SemaphoreLock connectLock(ConnectionSemaphore);
+		client.Init(&e);
+	}
 
 	if (!CheckErrors(e, msg))
 	{
@@ -61,19 +72,89 @@ bool P4API::Initialize()
 	return true;
 }
 
-bool P4API::Deinitialize()
+void P4API::DeinitializeClient(ClientApi& client)
 {
 	std::unique_lock<std::mutex> lock(InitializationMutex);
 
 	Error e;
 	StrBuf msg;
 
-	m_ClientAPI.Final(&e);
+	client.Final(&e);
 	CheckErrors(e, msg);
+}
+
+bool P4API::Initialize()
+{
+	m_Usage = 0;
+	m_Refresh.Reset(CommandRefreshThreshold);
+	m_ClientAPI.reset(new ClientApi());
+	return InitializeClient(*m_ClientAPI);
+}
 
+bool P4API::Deinitialize()
+{
+	DeinitializeClient(*m_ClientAPI);
 	return true;
 }
 
+std::unique_ptr<ClientApi> P4API::ConnectStandby()
+{
+	std::unique_ptr<ClientApi> client(new ClientApi());
+	if (!InitializeClient(*client))
+	{
+		DeinitializeClient(*client);
+		client.reset();
+	}
+	return client;
+}
+
+void P4API::RetireClient(std::unique_ptr<ClientApi> client)
+{
+	DeinitializeClient(*client);
+}
+
+void P4API::RefreshIfAged()
+{
+	const int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	if (!m_StandbyClientAPI.valid() && m_Refresh.ShouldConnectStandby(m_Usage, nowMs))
+	{
+		// Connect the replacement while this connection keeps serving commands.
+		m_StandbyClientAPI = std::async(std::launch::async, &P4API::ConnectStandby);
+	}
+
+	if (!m_Refresh.IsAged(m_Usage)
+	    || !m_StandbyClientAPI.valid()
+	    || m_StandbyClientAPI.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+	{
+		// Not aged yet, or the standby is still connecting or backing off; keep using the current connection.
+		return;
+	}
+
+	std::unique_ptr<ClientApi> standby = m_StandbyClientAPI.get();
+	if (!standby)
+	{
+		const int64_t backoffMs = m_Refresh.OnRefreshFailed(nowMs);
+		if (m_Refresh.GetFailedRefreshes() >= CommandRetries)
+		{
+			ERR("Could not refresh the connection after " << CommandRetries << " retries. Exiting.");
+			std::exit(1);
+		}
+		ERR("Could not refresh connection due to old age. Retrying in " << backoffMs << "ms");
+		return;
+	}
+
+	// Closing the aged connection takes the initialization lock and a round
+	// trip, so it is done in the background like the connecting.
+	m_RetiredClientAPIs.erase(std::remove_if(m_RetiredClientAPIs.begin(), m_RetiredClientAPIs.end(), [](const std::future<void>& retired)
+	                              { return retired.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }),
+	    m_RetiredClientAPIs.end());
+	std::unique_ptr<ClientApi> aged = std::move(m_ClientAPI);
+	m_ClientAPI = std::move(standby);
+	m_RetiredClientAPIs.push_back(std::async(std::launch::async, &P4API::RetireClient, std::move(aged)));
+	m_Usage = 0;
+	m_Refresh.Reset(CommandRefreshThreshold);
+}
+
 bool P4API::Reinitialize()
 {
 	MTR_SCOPE("P4", __func__);
@@ -84,6 +165,20 @@ bool P4API::Reinitialize()
 
 P4API::~P4API()
 {
+	for (std::future<void>& retired : m_RetiredClientAPIs)
+	{
+		retired.wait();
+	}
+
+	if (m_StandbyClientAPI.valid())
+	{
+		std::unique_ptr<ClientApi> standby = m_StandbyClientAPI.get();
+		if (standby)
+		{
+			DeinitializeClient(*standby);
+		}
+	}
+
 	if (!Deinitialize())
 	{
 		ERR("P4API context was not destroyed successfully");
@@ -246,6 +341,29 @@ std::unique_ptr<ChangesResult> P4API::ChangesFromTo(const std::string& path, con
 	                                     });
 }
 
+std::unique_ptr<ChangesResult> P4API::ChangesInRange(const std::string& path, const int64_t& from, const int64_t& to, int32_t maxCount)
+{
+	MTR_SCOPE("P4", __func__);
+
+	std::vector<std::string> args = {
+		"-s", "submitted", // Only include submitted CLs
+		"-r" // Send CLs in chronological order
+	};
+
+	std::string maxCountStr;
+	if (maxCount != -1)
+	{
+		maxCountStr = std::to_string(maxCount);
+
+		args.push_back("-m"); // Only send max this many number of CLs
+		args.push_back(maxCountStr);
+	}
+
+	args.push_back(path + "@" + std::to_string(from) + ",@" + std::to_string(to));
+
+	return Run<ChangesResult>("changes", args);
+}
+
 std::unique_ptr<ChangesResult> P4API::LatestChange(const std::string& path)
 {
 	MTR_SCOPE("P4", __func__);
@@ -274,6 +392,14 @@ std::unique_ptr<DescribeResult> P4API::Describe(const std::string& cl)
 	                                           cl });
 }
 
+std::unique_ptr<DescribeResult> P4API::DescribeHeader(const std::string& cl)
+{
+	MTR_SCOPE("P4", __func__);
+	return Run<DescribeResult>("describe", { "-s", // Omit the diffs
+	                                           "-m", "1", // List a single file
+	                                           cl });
+}
+
 std::unique_ptr<FileLogResult> P4API::FileLog(const std::string& changelist)
 {
 	return Run<FileLogResult>("filelog", {
@@ -284,6 +410,18 @@ std::unique_ptr<FileLogResult> P4API::FileLog(const std::string& changelist)
 	                                     });
 }
 
+std::unique_ptr<FilesResult> P4API::Files(const std::vector<std::string>& paths, const std::string& cl)
+{
+	MTR_SCOPE("P4", __func__);
+
+	std::vector<std::string> args = { "-e" }; // Exclude deleted, purged and archived revisions
+	for (const std::string& path : paths)
+	{
+		args.push_back(path + "@" + cl);
+	}
+	return Run<FilesResult>("files", args);
+}
+
 std::unique_ptr<SizesResult> P4API::Size(const std::string& file)
 {
 	return Run<SizesResult>("sizes", { "-a", "-s", file });
@@ -310,7 +448,7 @@ std::unique_ptr<PrintResult> P4API::PrintFile(const std::string& filePathRevisio
 	                                 });
 }
 
-std::unique_ptr<PrintResult> P4API::PrintFiles(const std::vector<std::string>& fileRevisions)
+std::unique_ptr<PrintResult> P4API::PrintFiles(const std::vector<std::string>& fileRevisions, KeepAlive* keepAlive)
 {
 	MTR_SCOPE("P4", __func__);
 
@@ -319,7 +457,7 @@ std::unique_ptr<PrintResult> P4API::PrintFiles(const std::vector<std::string>& f
 		return std::unique_ptr<PrintResult>(new PrintResult());
 	}
 
-	return Run<PrintResult>("print", fileRevisions);
+	return RunEx<PrintResult>("print", fileRevisions, CommandRetries, keepAlive);
 }
 
 std::unique_ptr<Result> P4API::Sync(const std::string& path)
@@ -10,13 +10,17 @@
 #include <chrono>
 #include <cstdint>
 #include <memory>
+#include <future>
 
 #include "common.h"
+#include "utils/semaphore.h"
+#include "utils/refresh_schedule.h"
 
 #include "commands/file_map.h"
 #include "commands/changes_result.h"
 #include "commands/describe_result.h"
 #include "commands/filelog_result.h"
+#include "commands/files_result.h"
 #include "commands/sizes_result.h"
 #include "commands/sync_result.h"
 #include "commands/print_result.h"
@@ -28,19 +32,32 @@
 
 class P4API
 {
-	ClientApi m_ClientAPI;
+	std::unique_ptr<ClientApi> m_ClientAPI;
 	FileMap m_ClientMapping;
 	int m_Usage;
 
+	// Aged connections are replaced by a standby connection established in the background.
+	std::future<std::unique_ptr<ClientApi>> m_StandbyClientAPI;
+	// The replaced connections, being closed in the background.
+	std::vector<std::future<void>> m_RetiredClientAPIs;
+	RefreshSchedule m_Refresh;
+
 	bool Initialize();
 	bool Deinitialize();
 	bool Reinitialize();
-	bool CheckErrors(Error& e, StrBuf& msg);
+	static bool CheckErrors(Error& e, StrBuf& msg);
+
+	static bool InitializeClient(ClientApi& client);
+	static void DeinitializeClient(ClientApi& client);
+	static std::unique_ptr<ClientApi> ConnectStandby();
+	static void RetireClient(std::unique_ptr<ClientApi> client);
+	void RefreshIfAged();
 
 	template <class T>
 	std::unique_ptr<T> Run(const char* command, const std::vector<std::string>& stringArguments);
+	// keepAlive, when given, can abort the command; the result of an aborted command is incomplete.
 	template <class T>
-	std::unique_ptr<T> RunEx(const char* command, const std::vector<std::string>& stringArguments, const int commandRetries);
+	std::unique_ptr<T> RunEx(const char* command, const std::vector<std::string>& stringArguments, const int commandRetries, KeepAlive* keepAlive = nullptr);
 
 public:
 	static std::string P4PORT;
@@ -51,7 +68,10 @@ public:
 	static int CommandRefreshThreshold;
 
 	// Helix Core C++ API seems to crash while making connections parallely.
+	// Guards the configuration of the client before connecting, and its teardown.
 	static std::mutex InitializationMutex;
+	// Bounds how many connections can be established at the same time.
+	static Semaphore ConnectionSemaphore;
 
 	static bool InitializeLibraries();
 	static bool ShutdownLibraries();
@@ -71,16 +91,22 @@ public:
 	std::unique_ptr<ChangesResult> Changes(const std::string& path);
 	std::unique_ptr<ChangesResult> Changes(const std::string& path, const std::string& from, int32_t maxCount);
 	std::unique_ptr<ChangesResult> ChangesFromTo(const std::string& path, const std::string& from, const std::string& to);
+	// Submitted CLs numbered within [from, to] in chronological order, with short descriptions.
+	std::unique_ptr<ChangesResult> ChangesInRange(const std::string& path, const int64_t& from, const int64_t& to, int32_t maxCount);
 	std::unique_ptr<ChangesResult> LatestChange(const std::string& path);
 	std::unique_ptr<ChangesResult> OldestChange(const std::string& path);
 	std::unique_ptr<DescribeResult> Describe(const std::string& cl);
+	// Describes the CL with at most one of its files, for its full description.
+	std::unique_ptr<DescribeResult> DescribeHeader(const std::string& cl);
 	std::unique_ptr<FileLogResult> FileLog(const std::string& changelist);
+	// The files of the paths at the changelist, without the deleted ones.
+	std::unique_ptr<FilesResult> Files(const std::vector<std::string>& paths, const std::string& cl);
 	std::unique_ptr<SizesResult> Size(const std::string& file);
 	std::unique_ptr<Result> Sync();
 	std::unique_ptr<Result> Sync(const std::string& path);
 	std::unique_ptr<SyncResult> GetFilesToSyncAtCL(const std::string& path, const std::string& cl);
 	std::unique_ptr<PrintResult> PrintFile(const std::string& filePathRevision);
-	std::unique_ptr<PrintResult> PrintFiles(const std::vector<std::string>& fileRevisions);
+	std::unique_ptr<PrintResult> PrintFiles(const std::vector<std::string>& fileRevisions, KeepAlive* keepAlive = nullptr);
 	void UpdateClientSpec();
 	std::unique_ptr<ClientResult> Client();
 	std::unique_ptr<StreamResult> Stream(const std::string& path);
@@ -89,7 +115,7 @@ public:
 };
 
 template <class T>
-inline std::unique_ptr<T> P4API::RunEx(const char* command, const std::vector<std::string>& stringArguments, const int commandRetries)
+inline std::unique_ptr<T> P4API::RunEx(const char* command, const std::vector<std::string>& stringArguments, const int commandRetries, KeepAlive* keepAlive)
 {
 	std::string argsString;
 	for (const std::string& stringArg : stringArguments)
@@ -105,13 +131,14 @@ inline std::unique_ptr<T> P4API::RunEx(const char* command, const std::vector<st
 
 	std::unique_ptr<T> clientUser = std::unique_ptr<T>(new T());
 
-	m_ClientAPI.SetArgv(argsCharArray.size(), argsCharArray.data());
-	m_ClientAPI.Run(command, clientUser.get());
+	m_ClientAPI->SetBreak(keepAlive);
+	m_ClientAPI->SetArgv(argsCharArray.size(), argsCharArray.data());
+	m_ClientAPI->Run(command, clientUser.get());
 
 	int retries = commandRetries;
-	while (m_ClientAPI.Dropped() || clientUser->GetError().IsError())
+	while (m_ClientAPI->Dropped() || clientUser->GetError().IsError())
 	{
-		if (retries == 0)
+		if (retries == 0 || (keepAlive && !keepAlive->IsAlive()))
 		{
 			break;
 		}
@@ -132,13 +159,26 @@ inline std::unique_ptr<T> P4API::RunEx(const char* command, const std::vector<st
 
 		clientUser = std::unique_ptr<T>(new T());
 
-		m_ClientAPI.SetArgv(argsCharArray.size(), argsCharArray.data());
-		m_ClientAPI.Run(command, clientUser.get());
+		m_ClientAPI->SetBreak(keepAlive);
+		m_ClientAPI->SetArgv(argsCharArray.size(), argsCharArray.data());
+		m_ClientAPI->Run(command, clientUser.get());
 
 		retries--;
 	}
+	m_ClientAPI->SetBreak(nullptr);
+
+	if (keepAlive && !keepAlive->IsAlive())
+	{
+		// The caller gave up on this command, which also drops the connection when
+		// it is aborted midway. Start over with a fresh one for the next command.
+		if (m_ClientAPI->Dropped() && !Reinitialize())
+		{
+			ERR("Could not reinitialize P4API after aborting p4 " << command);
+		}
+		return clientUser;
+	}
 
-	if (m_ClientAPI.Dropped() || clientUser->GetError().IsFatal())
+	if (m_ClientAPI->Dropped() || clientUser->GetError().IsFatal())
 	{
 		ERR("Exiting due to receiving errors even after retrying " << CommandRetries << " times");
 		Deinitialize();
@@ -146,29 +186,7 @@ inline std::unique_ptr<T> P4API::RunEx(const char* command, const std::vector<st
 	}
 
 	m_Usage++;
-	if (m_Usage > CommandRefreshThreshold)
-	{
-		int refreshRetries = CommandRetries;
-		while (refreshRetries > 0)
-		{
-			WARN("Trying to refresh the connection due to age (" << m_Usage << " > " << CommandRefreshThreshold << ").");
-			if (Reinitialize())
-			{
-				SUCCESS("Connection was refreshed");
-				break;
-			}
-			ERR("Could not refresh connection due to old age. Retrying in 5 seconds");
-			std::this_thread::sleep_for(std::chrono::seconds(5));
-
-			refreshRetries--;
-		}
-
-		if (refreshRetries == 0)
-		{
-			ERR("Could not refresh the connection after " << CommandRetries << " retries. Exiting.");
-			std::exit(1);
-		}
-	}
+	RefreshIfAged();
 
 	return clientUser;
 }
@@ -6,6 +6,9 @@
  */
 #include "thread_pool.h"
 
+#include <sstream>
+#include <iomanip>
+
 #include "common.h"
 
 #include "utils/arguments.h"
@@ -13,18 +16,83 @@
 
 #include "minitrace.h"
 
-ThreadPool* ThreadPool::GetSingleton()
+ThreadPool* ThreadPool::GetMetadataPool()
+{
+	static ThreadPool metadataPool("Metadata", true);
+	return &metadataPool;
+}
+
+ThreadPool* ThreadPool::GetContentPool()
+{
+	static ThreadPool contentPool("Content", true);
+	return &contentPool;
+}
+
+ThreadPool* ThreadPool::GetCPUPool()
+{
+	static ThreadPool cpuPool("CPU", false);
+	return &cpuPool;
+}
+
+void ThreadPool::RaiseAllCaughtExceptions()
+{
+	GetMetadataPool()->RaiseCaughtExceptions();
+	GetContentPool()->RaiseCaughtExceptions();
+	GetCPUPool()->RaiseCaughtExceptions();
+}
+
+void ThreadPool::ShutDownAll()
+{
+	// Pools feeding work into other pools go first.
+	GetMetadataPool()->ShutDown();
+	GetCPUPool()->ShutDown();
+	GetContentPool()->ShutDown();
+}
+
+void ThreadPool::PrintAllStats()
+{
+	PRINT(GetMetadataPool()->GetStats());
+	PRINT(GetContentPool()->GetStats());
+	PRINT(GetCPUPool()->GetStats());
+}
+
+ThreadPool::ThreadPool(const std::string& name, const bool hasP4Contexts)
+    : m_Name(name)
+    , m_HasP4Contexts(hasP4Contexts)
+    , m_ShouldStop(false)
+    , m_HasShutDownBeenCalled(true)
+    , m_JobsProcessing(0)
+    , m_JobsCompleted(0)
+    , m_BusyTimeNs(0)
+    , m_QueueWaitTimeNs(0)
+    , m_MaxQueueDepth(0)
 {
-	static ThreadPool singleton;
-	return &singleton;
 }
 
 void ThreadPool::AddJob(Job function)
 {
 	{
 		std::unique_lock<std::mutex> lock(m_JobsMutex);
-		m_Jobs.push_back(function);
+		m_Jobs.push_back(QueuedJob { function, Timer::Now() });
+		m_JobsProcessing++;
+		if (m_Jobs.size() > m_MaxQueueDepth)
+		{
+			m_MaxQueueDepth = m_Jobs.size();
+		}
+	}
+	m_CV.notify_one();
+}
+
+void ThreadPool::AddPriorityJob(Job function)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_JobsMutex);
+		m_Jobs.push_front(QueuedJob { function, Timer::Now() });
 		m_JobsProcessing++;
+		if (m_Jobs.size() > m_MaxQueueDepth)
+		{
+			m_MaxQueueDepth = m_Jobs.size();
+		}
 	}
 	m_CV.notify_one();
 }
@@ -77,7 +145,7 @@ void ThreadPool::ShutDown()
 	m_ThreadNames.clear();
 	m_P4Contexts.clear();
 
-	SUCCESS("Thread pool shut down successfully");
+	SUCCESS(m_Name << " thread pool shut down successfully");
 }
 
 void ThreadPool::Resize(int size)
@@ -86,27 +154,57 @@ void ThreadPool::Resize(int size)
 	Initialize(size);
 }
 
+std::string ThreadPool::GetStats()
+{
+	size_t queued = 0;
+	size_t maxQueueDepth = 0;
+	{
+		std::unique_lock<std::mutex> lock(m_JobsMutex);
+		queued = m_Jobs.size();
+		maxQueueDepth = m_MaxQueueDepth;
+	}
+
+	const long long completed = m_JobsCompleted;
+	const double busyS = m_BusyTimeNs * 1e-9;
+	const double waitS = m_QueueWaitTimeNs * 1e-9;
+
+	std::ostringstream stats;
+	stats << std::fixed << std::setprecision(2)
+	      << m_Name << " pool: " << m_Threads.size() << " threads, "
+	      << completed << " jobs completed, "
+	      << queued << " queued (max " << maxQueueDepth << "), "
+	      << busyS << "s busy, "
+	      << (completed > 0 ? waitS / completed : 0.0) << "s average queue wait";
+	return stats.str();
+}
+
 void ThreadPool::Initialize(int size)
 {
 	m_HasShutDownBeenCalled = false;
 	m_ShouldStop = false;
 	m_JobsProcessing = 0;
 
+	// Each worker connects on its own thread, so that it can start
+	// processing jobs as soon as its own connection is ready.
 	m_P4Contexts.resize(size);
 
 	for (int i = 0; i < size; i++)
 	{
 		m_ThreadExceptions.push_back(nullptr);
-		m_ThreadNames.push_back("Worker #" + std::to_string(i));
+		m_ThreadNames.push_back(m_Name + " Worker #" + std::to_string(i));
 		m_Threads.push_back(std::thread([this, i]()
 		    {
 			    MTR_META_THREAD_NAME(m_ThreadNames.at(i).c_str());
 
-			    P4API* localP4 = &m_P4Contexts[i];
+			    if (m_HasP4Contexts)
+			    {
+				    m_P4Contexts[i].reset(new P4API());
+			    }
+			    P4API* localP4 = m_P4Contexts[i].get();
 
 			    while (true)
 			    {
-				    Job job;
+				    QueuedJob job;
 				    {
 					    std::unique_lock<std::mutex> lock(m_JobsMutex);
 
@@ -122,9 +220,12 @@ void ThreadPool::Initialize(int size)
 					    m_Jobs.pop_front();
 				    }
 
+				    const TimePoint startTime = Timer::Now();
+				    m_QueueWaitTimeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(startTime - job.queuedAt).count();
+
 				    try
 				    {
-					    job(localP4);
+					    job.function(localP4);
 				    }
 				    catch (const std::exception& e)
 				    {
@@ -132,6 +233,9 @@ void ThreadPool::Initialize(int size)
 
 					    m_ThreadExceptions[i] = std::current_exception();
 				    }
+
+				    m_BusyTimeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(Timer::Now() - startTime).count();
+				    m_JobsCompleted++;
 				    m_JobsProcessing--;
 			    }
 		    }));
@@ -7,26 +7,43 @@
 #pragma once
 
 #include <thread>
+#include <memory>
 #include <deque>
 #include <functional>
 #include <atomic>
 #include <condition_variable>
 
 #include "common.h"
+#include "utils/timer.h"
 
 class P4API;
 
+// Work is split across independently sized pools so that slow bulk
+// transfers never hold up cheap metadata calls, and CPU-bound work
+// never sits behind either of them.
 class ThreadPool
 {
+public:
+	// CPU pool jobs receive a nullptr P4API context.
 	typedef std::function<void(P4API*)> Job;
 
+private:
+	struct QueuedJob
+	{
+		Job function;
+		TimePoint queuedAt;
+	};
+
+	const std::string m_Name;
+	const bool m_HasP4Contexts;
+
 	std::vector<std::thread> m_Threads;
 	std::mutex m_ThreadExceptionsMutex;
 	std::vector<std::exception_ptr> m_ThreadExceptions;
 	std::vector<std::string> m_ThreadNames;
-	std::vector<P4API> m_P4Contexts;
+	std::vector<std::unique_ptr<P4API>> m_P4Contexts;
 
-	std::deque<Job> m_Jobs;
+	std::deque<QueuedJob> m_Jobs;
 	std::mutex m_JobsMutex;
 
 	std::condition_variable m_CV;
@@ -36,17 +53,39 @@ class ThreadPool
 
 	std::atomic<long> m_JobsProcessing;
 
+	// Instrumentation
+	std::atomic<long long> m_JobsCompleted;
+	std::atomic<long long> m_BusyTimeNs;
+	std::atomic<long long> m_QueueWaitTimeNs;
+	size_t m_MaxQueueDepth; // Guarded by m_JobsMutex
+
 public:
-	static ThreadPool* GetSingleton();
+	// `p4 describe`, `p4 filelog` and other cheap server metadata calls.
+	static ThreadPool* GetMetadataPool();
+	// `p4 print` calls transferring file contents.
+	static ThreadPool* GetContentPool();
+	// Local work without a Perforce connection, sized to the cores.
+	static ThreadPool* GetCPUPool();
+
+	static void RaiseAllCaughtExceptions();
+	static void ShutDownAll();
+	static void PrintAllStats();
 
+	ThreadPool(const std::string& name, const bool hasP4Contexts);
 	~ThreadPool();
 
 	void Initialize(int size);
 	void AddJob(Job function);
+	// Queues the job ahead of every other waiting job.
+	void AddPriorityJob(Job function);
 	void Wait();
 	void RaiseCaughtExceptions();
 	void ShutDown();
 
 	void Resize(int size);
 	int GetThreadCount() const { return m_Threads.size(); }
+	const std::string& GetName() const { return m_Name; }
+
+	// Summary of the jobs processed so far, their busy and queueing time and the deepest the queue has been.
+	std::string GetStats();
 };
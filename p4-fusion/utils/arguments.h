@@ -45,17 +45,34 @@ public:
 	std::string GetSourcePath() const { return GetParameter("--src"); };
 	std::string GetClient() const { return GetParameter("--client"); };
 	std::string GetNetworkThreads() const { return GetParameter("--networkThreads"); };
+	std::string GetMetadataThreads() const { return GetParameter("--metadataThreads"); };
+	std::string GetCPUThreads() const { return GetParameter("--cpuThreads"); };
 	std::string GetFileSystemThreads() const { return GetParameter("--fileSystemThreads"); };
 	std::string GetPrintBatch() const { return GetParameter("--printBatch"); };
 	std::string GetLookAhead() const { return GetParameter("--lookAhead"); };
 	std::string GetRetries() const { return GetParameter("--retries"); };
 	std::string GetRefresh() const { return GetParameter("--refresh"); };
+	std::string GetParallelConnects() const { return GetParameter("--parallelConnects"); };
 	std::string GetFsyncEnable() const { return GetParameter("--fsyncEnable"); };
 	std::string GetIncludeBinaries() const { return GetParameter("--includeBinaries"); };
 	std::string GetMaxChanges() const { return GetParameter("--maxChanges"); };
+	std::string GetChangesWindow() const { return GetParameter("--changesWindow"); };
 	std::string GetFlushRate() const { return GetParameter("--flushRate"); };
 	std::string GetNoColor() const { return GetParameter("--noColor"); };
 	std::string GetNoMerge() const { return GetParameter("--noMerge"); };
 	std::string GetStreamMappings() const { return GetParameter("--streamMappings"); };
+	std::string GetHedgeDownloads() const { return GetParameter("--hedgeDownloads"); };
+	std::string GetHedgeMinDelay() const { return GetParameter("--hedgeMinDelay"); };
+	std::string GetDownloadCache() const { return GetParameter("--downloadCache"); };
+	std::string GetDownloadCacheSize() const { return GetParameter("--downloadCacheSize"); };
+	std::string GetMetadataCache() const { return GetParameter("--metadataCache"); };
+	std::string GetDedupContents() const { return GetParameter("--dedupContents"); };
+	std::string GetVerifyDigests() const { return GetParameter("--verifyDigests"); };
+	std::string GetDaemon() const { return GetParameter("--daemon"); };
+	std::string GetPollInterval() const { return GetParameter("--pollInterval"); };
+	std::string GetBaselineCL() const { return GetParameter("--baselineCL"); };
+	std::string GetSegments() const { return GetParameter("--segments"); };
+	std::string GetManifest() const { return GetParameter("--manifest"); };
+	std::string GetManifestJobs() const { return GetParameter("--manifestJobs"); };
 	std::vector<std::string> GetBranches() const { return GetParameterList("--branch"); };
 };
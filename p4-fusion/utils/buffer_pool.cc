@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "buffer_pool.h"
+
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <iomanip>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+struct ThreadCache
+{
+	std::vector<char*> blocks[BufferPool::ClassCount];
+
+	~ThreadCache()
+	{
+		BufferPool::GetSingleton()->Reclaim(blocks);
+	}
+};
+
+thread_local ThreadCache LocalCache;
+}
+
+BufferPool* BufferPool::GetSingleton()
+{
+	static BufferPool singleton;
+	return &singleton;
+}
+
+BufferPool::BufferPool()
+    : m_Hits(0)
+    , m_Misses(0)
+    , m_MappedAllocations(0)
+    , m_BytesInUse(0)
+    , m_HighWaterBytes(0)
+    , m_CachedBytes(0)
+{
+}
+
+BufferPool::~BufferPool()
+{
+	for (int sizeClass = 0; sizeClass < ClassCount; sizeClass++)
+	{
+		for (char* block : m_FreeBlocks[sizeClass])
+		{
+			std::free(block);
+		}
+	}
+}
+
+int BufferPool::GetClass(size_t size)
+{
+	int sizeClass = 0;
+	while (GetClassSize(sizeClass) < size)
+	{
+		sizeClass++;
+	}
+	return sizeClass;
+}
+
+void BufferPool::AddBytesInUse(long long bytes)
+{
+	const long long inUse = m_BytesInUse += bytes;
+
+	long long highWater = m_HighWaterBytes;
+	while (inUse > highWater && !m_HighWaterBytes.compare_exchange_weak(highWater, inUse))
+	{
+	}
+}
+
+char* BufferPool::Allocate(size_t size, size_t& capacity)
+{
+	if (size > GetClassSize(ClassCount - 1))
+	{
+		const size_t pageSize = sysconf(_SC_PAGESIZE);
+		capacity = (size + pageSize - 1) / pageSize * pageSize;
+
+		void* block = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (block == MAP_FAILED)
+		{
+			throw std::bad_alloc();
+		}
+
+		m_MappedAllocations++;
+		AddBytesInUse(capacity);
+		return (char*)block;
+	}
+
+	const int sizeClass = GetClass(size);
+	capacity = GetClassSize(sizeClass);
+	AddBytesInUse(capacity);
+
+	std::vector<char*>& localBlocks = LocalCache.blocks[sizeClass];
+	if (!localBlocks.empty())
+	{
+		char* block = localBlocks.back();
+		localBlocks.pop_back();
+		m_CachedBytes -= capacity;
+		m_Hits++;
+		return block;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_FreeBlocksMutex[sizeClass]);
+		if (!m_FreeBlocks[sizeClass].empty())
+		{
+			char* block = m_FreeBlocks[sizeClass].back();
+			m_FreeBlocks[sizeClass].pop_back();
+			m_CachedBytes -= capacity;
+			m_Hits++;
+			return block;
+		}
+	}
+
+	char* block = (char*)std::malloc(capacity);
+	if (!block)
+	{
+		throw std::bad_alloc();
+	}
+	m_Misses++;
+	return block;
+}
+
+void BufferPool::Free(char* block, size_t capacity)
+{
+	AddBytesInUse(-(long long)capacity);
+
+	if (capacity > GetClassSize(ClassCount - 1))
+	{
+		munmap(block, capacity);
+		return;
+	}
+
+	const int sizeClass = GetClass(capacity);
+
+	std::vector<char*>& localBlocks = LocalCache.blocks[sizeClass];
+	if (localBlocks.size() < ThreadCacheSize)
+	{
+		localBlocks.push_back(block);
+		m_CachedBytes += capacity;
+		return;
+	}
+
+	if (m_CachedBytes + capacity <= MaxCachedBytes)
+	{
+		std::lock_guard<std::mutex> lock(m_FreeBlocksMutex[sizeClass]);
+		m_FreeBlocks[sizeClass].push_back(block);
+		m_CachedBytes += capacity;
+		return;
+	}
+
+	std::free(block);
+}
+
+void BufferPool::Reclaim(std::vector<char*> (&threadBlocks)[ClassCount])
+{
+	for (int sizeClass = 0; sizeClass < ClassCount; sizeClass++)
+	{
+		std::lock_guard<std::mutex> lock(m_FreeBlocksMutex[sizeClass]);
+		m_FreeBlocks[sizeClass].insert(m_FreeBlocks[sizeClass].end(), threadBlocks[sizeClass].begin(), threadBlocks[sizeClass].end());
+		threadBlocks[sizeClass].clear();
+	}
+}
+
+std::string BufferPool::GetStats()
+{
+	const long long hits = m_Hits;
+	const long long misses = m_Misses;
+	const double mb = 1024.0 * 1024.0;
+
+	std::ostringstream stats;
+	stats << std::fixed << std::setprecision(2)
+	      << "Buffer pool: " << hits << " hits, " << misses << " misses ("
+	      << (hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0) << "% hit rate), "
+	      << m_MappedAllocations << " mapped, "
+	      << m_BytesInUse / mb << " MB in use (high-water " << m_HighWaterBytes / mb << " MB), "
+	      << m_CachedBytes / mb << " MB cached";
+	return stats.str();
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Recycles the memory holding file contents across changelists, instead of
+// going back to malloc for every revision. Blocks are rounded up to
+// power-of-two size classes; freed blocks are first kept in a small cache
+// local to the freeing thread, then in a shared cache of bounded size.
+// Blocks larger than the largest class are mapped directly from the OS,
+// so that they are returned to it as soon as they are freed.
+class BufferPool
+{
+public:
+	static const int MinClassShift = 10; // 1 KiB
+	static const int MaxClassShift = 24; // 16 MiB
+	static const int ClassCount = MaxClassShift - MinClassShift + 1;
+	// Blocks of each class cached by every thread.
+	static const int ThreadCacheSize = 8;
+	// Upper bound on the bytes held by the caches, beyond which freed blocks go back to malloc.
+	static const size_t MaxCachedBytes = (size_t)512 * 1024 * 1024;
+
+private:
+	std::mutex m_FreeBlocksMutex[ClassCount];
+	std::vector<char*> m_FreeBlocks[ClassCount];
+
+	std::atomic<long long> m_Hits;
+	std::atomic<long long> m_Misses;
+	std::atomic<long long> m_MappedAllocations;
+	std::atomic<long long> m_BytesInUse;
+	std::atomic<long long> m_HighWaterBytes;
+	std::atomic<long long> m_CachedBytes;
+
+	BufferPool();
+
+	static int GetClass(size_t size);
+	static size_t GetClassSize(int sizeClass) { return (size_t)1 << (sizeClass + MinClassShift); }
+
+	void AddBytesInUse(long long bytes);
+
+public:
+	static BufferPool* GetSingleton();
+
+	~BufferPool();
+
+	// Returns a block of at least `size` bytes, and its actual size in `capacity`.
+	char* Allocate(size_t size, size_t& capacity);
+	void Free(char* block, size_t capacity);
+	// Moves the blocks cached by a thread to the shared cache as the thread exits.
+	void Reclaim(std::vector<char*> (&threadBlocks)[ClassCount]);
+
+	long long GetHits() const { return m_Hits; }
+	long long GetMisses() const { return m_Misses; }
+	long long GetMappedAllocations() const { return m_MappedAllocations; }
+	long long GetBytesInUse() const { return m_BytesInUse; }
+	long long GetHighWaterBytes() const { return m_HighWaterBytes; }
+	long long GetCachedBytes() const { return m_CachedBytes; }
+
+	std::string GetStats();
+};
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "content_buffer.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include "buffer_pool.h"
+
+std::atomic<long long> ContentBuffer::CopiedBytes(0);
+
+ContentBuffer::Storage::~Storage()
+{
+	if (data)
+	{
+		BufferPool::GetSingleton()->Free(data, capacity);
+	}
+}
+
+ContentBuffer::ContentBuffer(const char* data, size_t size)
+{
+	Append(data, size);
+}
+
+void ContentBuffer::Reserve(size_t size)
+{
+	if (!m_Bytes)
+	{
+		m_Bytes = std::make_shared<Storage>();
+	}
+	if (size <= m_Bytes->capacity)
+	{
+		return;
+	}
+
+	size_t capacity = 0;
+	char* data = BufferPool::GetSingleton()->Allocate(size, capacity);
+	if (m_Bytes->data)
+	{
+		std::memcpy(data, m_Bytes->data, m_Bytes->size);
+		CopiedBytes += m_Bytes->size;
+		BufferPool::GetSingleton()->Free(m_Bytes->data, m_Bytes->capacity);
+	}
+	m_Bytes->data = data;
+	m_Bytes->capacity = capacity;
+}
+
+void ContentBuffer::Append(const char* data, size_t size)
+{
+	const size_t newSize = GetSize() + size;
+	if (newSize > GetCapacity())
+	{
+		// Growing moves the bytes appended so far.
+		Reserve(std::max(newSize, 2 * GetCapacity()));
+	}
+	std::memcpy(m_Bytes->data + m_Bytes->size, data, size);
+	m_Bytes->size = newSize;
+	CopiedBytes += size;
+}
+
+void ContentBuffer::Clear()
+{
+	m_Bytes.reset();
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <memory>
+#include <atomic>
+#include <cstddef>
+
+// Holds the contents of a downloaded file revision. Copies of a ContentBuffer
+// share the same bytes, and moving one transfers them, so the contents are
+// written once by the print results and handed to the Git writer as-is.
+// Only append to a buffer while it has a single owner.
+// The memory is drawn from, and given back to, the BufferPool.
+class ContentBuffer
+{
+	struct Storage
+	{
+		char* data = nullptr;
+		size_t size = 0;
+		size_t capacity = 0;
+
+		~Storage();
+	};
+
+	std::shared_ptr<Storage> m_Bytes;
+
+public:
+	// Bytes copied into content buffers so far, counting the bytes moved
+	// around by a buffer growing past its capacity.
+	static std::atomic<long long> CopiedBytes;
+
+	ContentBuffer() = default;
+	ContentBuffer(const char* data, size_t size);
+
+	void Reserve(size_t size);
+	void Append(const char* data, size_t size);
+	// Drops the reference to the bytes held by this buffer.
+	void Clear();
+
+	const char* GetData() const { return m_Bytes ? m_Bytes->data : nullptr; }
+	size_t GetSize() const { return m_Bytes ? m_Bytes->size : 0; }
+	size_t GetCapacity() const { return m_Bytes ? m_Bytes->capacity : 0; }
+	bool IsEmpty() const { return GetSize() == 0; }
+};
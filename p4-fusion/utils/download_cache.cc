@@ -0,0 +1,454 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "download_cache.h"
+
+#include <algorithm>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "common.h"
+
+constexpr double DownloadCache::EvictionTarget;
+constexpr int DownloadCache::EvictionRetrySeconds;
+
+// Followed by the size of the contents, the key and a newline.
+static const char* EntryMagic = "p4-fusion-cache 1 ";
+static const size_t EntryMagicSize = std::strlen(EntryMagic);
+static const size_t EntrySizeDigits = 16;
+
+// Temporary files older than this were left behind by a process that died.
+static const time_t StaleTempSeconds = 60 * 60;
+
+// In nanoseconds, so that entries used within the same second keep their order.
+static int64_t GetUsedAtNs(const struct stat& entryStat)
+{
+#ifdef __APPLE__
+	const struct timespec& usedAt = entryStat.st_mtimespec;
+#else
+	const struct timespec& usedAt = entryStat.st_mtim;
+#endif
+	return (int64_t)usedAt.tv_sec * 1000000000 + usedAt.tv_nsec;
+}
+
+static uint64_t HashKey(const std::string& key, uint64_t hash)
+{
+	// FNV-1a
+	for (const char& c : key)
+	{
+		hash ^= (unsigned char)c;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static bool ReadAll(const int& fd, char* data, const size_t& size)
+{
+	size_t done = 0;
+	while (done < size)
+	{
+		const ssize_t result = read(fd, data + done, size - done);
+		if (result < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (result <= 0)
+		{
+			return false;
+		}
+		done += result;
+	}
+	return true;
+}
+
+static bool WriteAll(const int& fd, const char* data, const size_t& size)
+{
+	size_t written = 0;
+	while (written < size)
+	{
+		const ssize_t result = write(fd, data + written, size - written);
+		if (result < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return false;
+		}
+		written += result;
+	}
+	return true;
+}
+
+DownloadCache* DownloadCache::GetSingleton()
+{
+	static DownloadCache singleton;
+	return &singleton;
+}
+
+DownloadCache::DownloadCache()
+    : m_MaxSize(0)
+    , m_Size(0)
+    , m_TempCounter(0)
+    , m_IsEvictionRequested(false)
+    , m_ShouldStopEvicting(false)
+    , m_Hits(0)
+    , m_Misses(0)
+    , m_Stores(0)
+    , m_Evictions(0)
+{
+}
+
+DownloadCache::~DownloadCache()
+{
+	stopEvictions();
+}
+
+std::string DownloadCache::GetKey(const std::string& server, const std::string& depotFileRevision, const std::string& digest)
+{
+	if (digest.empty())
+	{
+		return "";
+	}
+	return server + "\t" + depotFileRevision + "\t" + digest;
+}
+
+bool DownloadCache::Initialize(const std::string& directory, const uint64_t& maxSize)
+{
+	stopEvictions();
+	m_Directory.clear();
+	if (directory.empty())
+	{
+		return true;
+	}
+
+	// Entries are spread over 256 subdirectories, named after the first
+	// byte of the hash of their key.
+	std::vector<std::string> directories = { directory, directory + "/tmp" };
+	for (int i = 0; i < 256; i++)
+	{
+		std::ostringstream shard;
+		shard << directory << "/" << std::hex << std::setw(2) << std::setfill('0') << i;
+		directories.push_back(shard.str());
+	}
+	for (const std::string& path : directories)
+	{
+		if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+		{
+			ERR("Could not create the download cache directory " << path << ": " << strerror(errno));
+			return false;
+		}
+	}
+
+	m_Directory = directory;
+	m_MaxSize = maxSize;
+
+	// Also finds the size of the entries already in the cache.
+	evict();
+	return true;
+}
+
+std::string DownloadCache::getEntryPath(const std::string& key) const
+{
+	// Two differently seeded hashes, so that collisions practically never
+	// make entries overwrite each other.
+	const uint64_t hash = HashKey(key, 0xcbf29ce484222325ULL);
+
+	std::ostringstream path;
+	path << m_Directory << "/" << std::hex << std::setfill('0')
+	     << std::setw(2) << (hash >> 56) << "/"
+	     << std::setw(16) << hash << std::setw(16) << HashKey(key, 0x84222325cbf29ce4ULL);
+	return path.str();
+}
+
+bool DownloadCache::Get(const std::string& key, ContentBuffer& contents)
+{
+	if (!IsEnabled() || key.empty())
+	{
+		return false;
+	}
+
+	const int fd = open(getEntryPath(key).c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		m_Misses++;
+		return false;
+	}
+
+	// The file needs to be exactly the header, the key and the contents.
+	const size_t headerSize = EntryMagicSize + EntrySizeDigits + 1;
+	std::vector<char> header(headerSize + key.size() + 1);
+	struct stat entryStat;
+	bool isValid = fstat(fd, &entryStat) == 0 && ReadAll(fd, header.data(), header.size())
+	    && std::memcmp(header.data(), EntryMagic, EntryMagicSize) == 0
+	    && std::memcmp(header.data() + headerSize, key.data(), key.size()) == 0
+	    && header.back() == '\n';
+
+	uint64_t size = 0;
+	if (isValid)
+	{
+		size = std::strtoull(std::string(header.data() + EntryMagicSize, EntrySizeDigits).c_str(), nullptr, 16);
+		isValid = (uint64_t)entryStat.st_size == header.size() + size;
+	}
+
+	ContentBuffer cached;
+	if (isValid && size > 0)
+	{
+		cached.Reserve(size);
+
+		static thread_local std::vector<char> chunk(1024 * 1024);
+		uint64_t remaining = size;
+		while (isValid && remaining > 0)
+		{
+			const size_t chunkSize = std::min<uint64_t>(remaining, chunk.size());
+			isValid = ReadAll(fd, chunk.data(), chunkSize);
+			cached.Append(chunk.data(), chunkSize);
+			remaining -= chunkSize;
+		}
+	}
+
+	if (isValid)
+	{
+		// Marks the entry as recently used
+		futimens(fd, nullptr);
+	}
+	close(fd);
+
+	if (!isValid)
+	{
+		m_Misses++;
+		return false;
+	}
+
+	m_Hits++;
+	contents = std::move(cached);
+	return true;
+}
+
+void DownloadCache::Put(const std::string& key, const ContentBuffer& contents)
+{
+	if (!IsEnabled() || key.empty() || contents.GetSize() > m_MaxSize)
+	{
+		return;
+	}
+
+	std::ostringstream header;
+	header << EntryMagic << std::hex << std::setw(EntrySizeDigits) << std::setfill('0') << contents.GetSize() << "\n"
+	       << key << "\n";
+	const std::string headerData = header.str();
+
+	const std::string tempPath = m_Directory + "/tmp/" + std::to_string(getpid()) + "-" + std::to_string(m_TempCounter++);
+	const int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		WARN("Could not create " << tempPath << " in the download cache: " << strerror(errno));
+		return;
+	}
+
+	const bool isWritten = WriteAll(fd, headerData.data(), headerData.size())
+	    && WriteAll(fd, contents.GetData(), contents.GetSize());
+	close(fd);
+
+	// Readers either find the previous entry or the complete new one.
+	if (!isWritten || std::rename(tempPath.c_str(), getEntryPath(key).c_str()) != 0)
+	{
+		WARN("Could not add " << tempPath << " to the download cache: " << strerror(errno));
+		unlink(tempPath.c_str());
+		return;
+	}
+
+	m_Stores++;
+	if ((m_Size += headerData.size() + contents.GetSize()) > m_MaxSize)
+	{
+		requestEviction();
+	}
+}
+
+void DownloadCache::WaitForEviction()
+{
+	std::unique_lock<std::mutex> lock(m_EvictionMutex);
+	m_EvictionCV.wait(lock, [this]()
+	    { return !m_IsEvictionRequested; });
+}
+
+void DownloadCache::requestEviction()
+{
+	std::lock_guard<std::mutex> lock(m_EvictionMutex);
+	if (m_IsEvictionRequested || std::chrono::steady_clock::now() < m_NextEvictionAt)
+	{
+		return;
+	}
+
+	m_IsEvictionRequested = true;
+	if (!m_EvictionThread.joinable())
+	{
+		m_EvictionThread = std::thread(&DownloadCache::runEvictions, this);
+	}
+	m_EvictionCV.notify_all();
+}
+
+void DownloadCache::runEvictions()
+{
+	std::unique_lock<std::mutex> lock(m_EvictionMutex);
+	while (true)
+	{
+		m_EvictionCV.wait(lock, [this]()
+		    { return m_IsEvictionRequested || m_ShouldStopEvicting; });
+		if (m_ShouldStopEvicting)
+		{
+			break;
+		}
+
+		lock.unlock();
+		const bool isEvicted = evict();
+		lock.lock();
+
+		if (!isEvicted)
+		{
+			m_NextEvictionAt = std::chrono::steady_clock::now() + std::chrono::seconds(EvictionRetrySeconds);
+		}
+		m_IsEvictionRequested = false;
+		m_EvictionCV.notify_all();
+	}
+}
+
+void DownloadCache::stopEvictions()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_EvictionMutex);
+		m_ShouldStopEvicting = true;
+	}
+	m_EvictionCV.notify_all();
+	if (m_EvictionThread.joinable())
+	{
+		m_EvictionThread.join();
+	}
+
+	std::lock_guard<std::mutex> lock(m_EvictionMutex);
+	m_ShouldStopEvicting = false;
+	m_IsEvictionRequested = false;
+	m_NextEvictionAt = std::chrono::steady_clock::time_point();
+}
+
+bool DownloadCache::evict()
+{
+	const std::string lockPath = m_Directory + "/lock";
+	const int lockFd = open(lockPath.c_str(), O_RDWR | O_CREAT, 0644);
+	if (lockFd < 0)
+	{
+		WARN("Could not open " << lockPath << ": " << strerror(errno));
+		return false;
+	}
+	if (flock(lockFd, LOCK_EX | LOCK_NB) != 0)
+	{
+		// Another process is already at it.
+		close(lockFd);
+		return false;
+	}
+
+	struct Entry
+	{
+		std::string path;
+		int64_t usedAtNs;
+		uint64_t size;
+	};
+	std::vector<Entry> entries;
+	uint64_t totalSize = 0;
+
+	const time_t now = time(nullptr);
+	for (int i = 0; i <= 256; i++)
+	{
+		std::ostringstream directoryPath;
+		if (i == 256)
+		{
+			directoryPath << m_Directory << "/tmp";
+		}
+		else
+		{
+			directoryPath << m_Directory << "/" << std::hex << std::setw(2) << std::setfill('0') << i;
+		}
+
+		DIR* directory = opendir(directoryPath.str().c_str());
+		if (!directory)
+		{
+			continue;
+		}
+		while (struct dirent* dirEntry = readdir(directory))
+		{
+			if (dirEntry->d_name[0] == '.')
+			{
+				continue;
+			}
+
+			const std::string path = directoryPath.str() + "/" + dirEntry->d_name;
+			struct stat entryStat;
+			if (stat(path.c_str(), &entryStat) != 0)
+			{
+				continue;
+			}
+
+			if (i == 256)
+			{
+				if (now - entryStat.st_mtime > StaleTempSeconds)
+				{
+					unlink(path.c_str());
+				}
+				continue;
+			}
+
+			entries.push_back(Entry { path, GetUsedAtNs(entryStat), (uint64_t)entryStat.st_size });
+			totalSize += entryStat.st_size;
+		}
+		closedir(directory);
+	}
+
+	if (totalSize > m_MaxSize)
+	{
+		std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b)
+		    { return a.usedAtNs < b.usedAtNs; });
+
+		// Open readers of a removed entry keep reading it until they close it.
+		const uint64_t targetSize = m_MaxSize * EvictionTarget;
+		for (size_t i = 0; i < entries.size() && totalSize > targetSize; i++)
+		{
+			if (unlink(entries[i].path.c_str()) == 0)
+			{
+				totalSize -= entries[i].size;
+				m_Evictions++;
+			}
+		}
+	}
+	m_Size = totalSize;
+
+	flock(lockFd, LOCK_UN);
+	close(lockFd);
+	return true;
+}
+
+std::string DownloadCache::GetStats()
+{
+	const long long hits = m_Hits;
+	const long long misses = m_Misses;
+	const double mb = 1024.0 * 1024.0;
+
+	std::ostringstream stats;
+	stats << std::fixed << std::setprecision(2)
+	      << "Download cache: " << hits << " hits, " << misses << " misses ("
+	      << (hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0) << "% hit rate), "
+	      << m_Stores << " stored, " << m_Evictions << " evicted, "
+	      << m_Size / mb << " MB of " << m_MaxSize / mb << " MB";
+	return stats.str();
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <cstdint>
+
+#include "content_buffer.h"
+
+// Keeps the printed file revisions on disk, so that reruns and
+// re-conversions with other options do not print them again. Entries are
+// keyed by the server, the revision and its digest, and named after a
+// hash of the key, which is also stored in the entry and checked on
+// reads. Entries are written to a temporary file and renamed into
+// place, so that several processes can share the cache. Reads refresh
+// the modification time of an entry, and the least recently used
+// entries are removed once the cache grows past its size, by whichever
+// process holds the lock file of the cache at the time.
+class DownloadCache
+{
+	std::string m_Directory;
+	uint64_t m_MaxSize;
+
+	// Estimate of the bytes in the cache, including the entries added by
+	// this process since the last scan, but not by other processes.
+	std::atomic<uint64_t> m_Size;
+	std::atomic<uint64_t> m_TempCounter;
+
+	// Eviction scans the whole cache, so it runs on a thread of its own
+	// instead of the network thread adding the entry.
+	std::thread m_EvictionThread;
+	std::mutex m_EvictionMutex;
+	std::condition_variable m_EvictionCV;
+	bool m_IsEvictionRequested;
+	bool m_ShouldStopEvicting;
+	std::chrono::steady_clock::time_point m_NextEvictionAt;
+
+	std::atomic<long long> m_Hits;
+	std::atomic<long long> m_Misses;
+	std::atomic<long long> m_Stores;
+	std::atomic<long long> m_Evictions;
+
+	DownloadCache();
+	~DownloadCache();
+
+	std::string getEntryPath(const std::string& key) const;
+	void requestEviction();
+	void runEvictions();
+	void stopEvictions();
+	// Returns false if another process is evicting.
+	bool evict();
+
+public:
+	// Eviction goes down to this fraction of the size, so that it does not
+	// run again for every entry added.
+	static constexpr double EvictionTarget = 0.9;
+	// While another process holds the lock, the size of this one stays
+	// over the limit, so it waits this long before trying again.
+	static constexpr int EvictionRetrySeconds = 10;
+
+	static DownloadCache* GetSingleton();
+
+	// Identifies a revision across servers, or an empty key for revisions
+	// without a digest, which are not cached.
+	static std::string GetKey(const std::string& server, const std::string& depotFileRevision, const std::string& digest);
+
+	// Creates the cache directory if needed. An empty directory disables the cache.
+	bool Initialize(const std::string& directory, const uint64_t& maxSize);
+	bool IsEnabled() const { return !m_Directory.empty(); }
+
+	bool Get(const std::string& key, ContentBuffer& contents);
+	void Put(const std::string& key, const ContentBuffer& contents);
+	// Blocks until the eviction requested by the entries added so far is done.
+	void WaitForEviction();
+
+	std::string GetStats();
+};
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "latency_tracker.h"
+
+#include <cmath>
+
+LatencyTracker::LatencyTracker()
+    : m_Count(0)
+{
+	for (int i = 0; i < BucketCount; i++)
+	{
+		m_Buckets[i] = 0;
+	}
+}
+
+int LatencyTracker::GetBucket(int64_t milliseconds)
+{
+	if (milliseconds <= 0)
+	{
+		return 0;
+	}
+
+	int bucket = (int)std::ceil(std::log2((double)milliseconds) * 4.0);
+	if (bucket >= BucketCount)
+	{
+		return BucketCount - 1;
+	}
+	return bucket;
+}
+
+int64_t LatencyTracker::GetBucketUpperBound(int bucket)
+{
+	return (int64_t)std::ceil(std::pow(2.0, bucket / 4.0));
+}
+
+void LatencyTracker::Record(int64_t milliseconds)
+{
+	m_Buckets[GetBucket(milliseconds)]++;
+	m_Count++;
+}
+
+int64_t LatencyTracker::GetPercentile(double percentile) const
+{
+	const int64_t count = m_Count;
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	const int64_t rank = (int64_t)std::ceil(count * percentile / 100.0);
+	int64_t seen = 0;
+	for (int i = 0; i < BucketCount; i++)
+	{
+		seen += m_Buckets[i];
+		if (seen >= rank)
+		{
+			return GetBucketUpperBound(i);
+		}
+	}
+	return GetBucketUpperBound(BucketCount - 1);
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free histogram of command latencies, used to derive deadlines from
+// the observed percentiles. Buckets grow geometrically (4 per doubling),
+// so percentiles are accurate to within ~19% of the true value.
+class LatencyTracker
+{
+	static const int BucketCount = 128;
+
+	std::atomic<int64_t> m_Buckets[BucketCount];
+	std::atomic<int64_t> m_Count;
+
+	static int GetBucket(int64_t milliseconds);
+	static int64_t GetBucketUpperBound(int bucket);
+
+public:
+	LatencyTracker();
+
+	void Record(int64_t milliseconds);
+	int64_t GetCount() const { return m_Count; }
+
+	// Returns the latency in milliseconds under which `percentile` percent
+	// of the recorded samples fall, or 0 if nothing was recorded yet.
+	int64_t GetPercentile(double percentile) const;
+};
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "path_interner.h"
+
+#include <vector>
+#include <stdexcept>
+#include <cstring>
+
+const PathInterner::ID PathInterner::Root;
+
+PathInterner* PathInterner::GetSingleton()
+{
+	static PathInterner singleton;
+	return &singleton;
+}
+
+PathInterner::PathInterner()
+    : m_NextID(0)
+{
+	for (ID i = 0; i < MaxChunks; i++)
+	{
+		m_Chunks[i] = nullptr;
+	}
+
+	// Reserve the root.
+	AddNode(Root, "");
+}
+
+PathInterner::~PathInterner()
+{
+	for (ID i = 0; i < MaxChunks; i++)
+	{
+		delete[] m_Chunks[i].load();
+	}
+}
+
+PathInterner::ID PathInterner::AddNode(const ID& parent, const std::string& name)
+{
+	const ID id = m_NextID++;
+	if (id >> ChunkShift >= MaxChunks)
+	{
+		throw std::length_error("Too many paths to intern");
+	}
+
+	std::atomic<Node*>& chunk = m_Chunks[id >> ChunkShift];
+	Node* nodes = chunk.load(std::memory_order_acquire);
+	if (!nodes)
+	{
+		// Whoever gets to install the chunk first wins.
+		Node* newNodes = new Node[ChunkSize];
+		if (chunk.compare_exchange_strong(nodes, newNodes, std::memory_order_acq_rel))
+		{
+			nodes = newNodes;
+		}
+		else
+		{
+			delete[] newNodes;
+		}
+	}
+
+	Node& node = nodes[id & (ChunkSize - 1)];
+	node.parent = parent;
+	node.name = name;
+	return id;
+}
+
+PathInterner::ID PathInterner::InternComponent(const ID& parent, const std::string& name)
+{
+	const Key key { parent, &name };
+	Shard& shard = m_Shards[KeyHash()(key) % ShardCount];
+
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto found = shard.ids.find(key);
+	if (found != shard.ids.end())
+	{
+		return found->second;
+	}
+
+	const ID id = AddNode(parent, name);
+	shard.ids.insert({ Key { parent, &GetNode(id).name }, id });
+	return id;
+}
+
+PathInterner::ID PathInterner::Intern(const std::string& path, const ID& parent)
+{
+	return Intern(path.data(), path.size(), parent);
+}
+
+PathInterner::ID PathInterner::Intern(const char* path, const size_t& size, const ID& parent)
+{
+	if (size == 0)
+	{
+		return parent;
+	}
+
+	// Reused across calls so that already interned paths cost no allocation.
+	static thread_local std::string name;
+
+	ID id = parent;
+	size_t start = 0;
+	while (true)
+	{
+		const char* separator = (const char*)std::memchr(path + start, '/', size - start);
+		const size_t end = separator ? separator - path : size;
+		name.assign(path + start, end - start);
+		id = InternComponent(id, name);
+		if (end == size)
+		{
+			return id;
+		}
+		start = end + 1;
+	}
+}
+
+std::string PathInterner::GetPath(const ID& id) const
+{
+	std::string path;
+	GetPath(id, path);
+	return path;
+}
+
+void PathInterner::GetPath(const ID& id, std::string& path) const
+{
+	size_t size = 0;
+	for (ID current = id; current != Root; current = GetParent(current))
+	{
+		size += GetName(current).size() + 1;
+	}
+
+	// Filled from the leaf up.
+	path.resize(size > 0 ? size - 1 : 0);
+	size_t end = path.size();
+	for (ID current = id; current != Root; current = GetParent(current))
+	{
+		const std::string& name = GetName(current);
+		end -= name.size();
+		name.copy(&path[end], name.size());
+		if (end > 0)
+		{
+			path[--end] = '/';
+		}
+	}
+}
+
+bool PathInterner::HasComponent(ID id, const std::string& name) const
+{
+	for (; id != Root; id = GetParent(id))
+	{
+		if (GetName(id) == name)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool PathInterner::IsUnder(ID id, const ID& ancestor) const
+{
+	while (id != Root)
+	{
+		id = GetParent(id);
+		if (id == ancestor)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+PathInterner::ID PathInterner::Rebase(const ID& id, const ID& ancestor, const ID& newParent)
+{
+	if (id == ancestor)
+	{
+		return newParent;
+	}
+	if (id == Root)
+	{
+		throw std::invalid_argument("Path is not under the directory to rebase from");
+	}
+	return InternComponent(Rebase(GetParent(id), ancestor, newParent), GetName(id));
+}
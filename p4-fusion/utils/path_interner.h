@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+
+// Process-wide dictionary of the depot and repository paths. A path is
+// stored as the id of its parent directory plus its leaf name, so every
+// directory prefix is stored once however many files live under it, and
+// prefix checks become walks over integer ids. Ids are stable for the
+// whole run, and paths are never removed: the memory grows with every
+// distinct path seen, which in daemon and manifest runs adds up over all
+// the depot paths converted and all the changelists polled.
+//
+// Interning is sharded by the hash of the component, and reading a path
+// back from its id takes no lock at all.
+class PathInterner
+{
+public:
+	typedef uint32_t ID;
+	// The empty path, parent of all the top level components.
+	static const ID Root = 0;
+
+private:
+	struct Node
+	{
+		ID parent;
+		std::string name;
+	};
+
+	// Nodes live in chunks which are never moved nor freed, so that a node
+	// can be read without a lock once its id has been handed out.
+	static const int ChunkShift = 16;
+	static const ID ChunkSize = (ID)1 << ChunkShift;
+	static const ID MaxChunks = (ID)1 << (32 - ChunkShift);
+	static const int ShardCount = 64;
+
+	// Points into the name of a node, or at the name being looked up.
+	struct Key
+	{
+		ID parent;
+		const std::string* name;
+
+		bool operator==(const Key& other) const { return parent == other.parent && *name == *other.name; }
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const { return std::hash<std::string>()(*key.name) * 31 + key.parent; }
+	};
+
+	struct Shard
+	{
+		std::mutex mutex;
+		std::unordered_map<Key, ID, KeyHash> ids;
+	};
+
+	std::atomic<Node*> m_Chunks[MaxChunks];
+	std::atomic<ID> m_NextID;
+	Shard m_Shards[ShardCount];
+
+	Node& GetNode(const ID& id) const { return m_Chunks[id >> ChunkShift].load(std::memory_order_acquire)[id & (ChunkSize - 1)]; }
+	ID AddNode(const ID& parent, const std::string& name);
+
+public:
+	static PathInterner* GetSingleton();
+
+	PathInterner();
+	~PathInterner();
+
+	PathInterner(const PathInterner&) = delete;
+	PathInterner& operator=(const PathInterner&) = delete;
+
+	// Returns the id of the '/' separated path, relative to `parent`.
+	ID Intern(const std::string& path, const ID& parent = Root);
+	ID Intern(const char* path, const size_t& size, const ID& parent = Root);
+	// Returns the id of the child component `name` of `parent`.
+	ID InternComponent(const ID& parent, const std::string& name);
+
+	ID GetParent(const ID& id) const { return GetNode(id).parent; }
+	const std::string& GetName(const ID& id) const { return GetNode(id).name; }
+	std::string GetPath(const ID& id) const;
+	// Writes the path into `path`, reusing its buffer.
+	void GetPath(const ID& id, std::string& path) const;
+	// Is any component of the path named `name`?
+	bool HasComponent(ID id, const std::string& name) const;
+
+	// Is `id` a path strictly below the `ancestor` directory?
+	bool IsUnder(ID id, const ID& ancestor) const;
+	// Re-roots the part of the path below `ancestor` under `newParent`,
+	// e.g. to take a depot path relative to a branch.
+	ID Rebase(const ID& id, const ID& ancestor, const ID& newParent = Root);
+
+	ID GetCount() const { return m_NextID; }
+};
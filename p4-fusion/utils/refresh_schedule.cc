@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "refresh_schedule.h"
+
+#include <algorithm>
+
+const int64_t RefreshSchedule::MinBackoffMs;
+const int64_t RefreshSchedule::MaxBackoffMs;
+
+RefreshSchedule::RefreshSchedule(unsigned seed)
+    : m_Threshold(1)
+    , m_RefreshAt(2)
+    , m_FailedRefreshes(0)
+    , m_RetryAtMs(0)
+    , m_Random(seed)
+{
+}
+
+void RefreshSchedule::Reset(int threshold)
+{
+	m_Threshold = std::max(1, threshold);
+	// Spread the refreshes over an extra quarter of the threshold.
+	const int stagger = std::uniform_int_distribution<int>(0, m_Threshold / 4)(m_Random);
+	m_RefreshAt = m_Threshold + 1 + stagger;
+	m_FailedRefreshes = 0;
+	m_RetryAtMs = 0;
+}
+
+bool RefreshSchedule::ShouldConnectStandby(int usage, int64_t nowMs) const
+{
+	const int standbyLead = std::max(1, m_Threshold / 10);
+	return usage >= m_RefreshAt - standbyLead && nowMs >= m_RetryAtMs;
+}
+
+int64_t RefreshSchedule::OnRefreshFailed(int64_t nowMs)
+{
+	m_FailedRefreshes++;
+	int64_t backoff = MinBackoffMs;
+	for (int i = 1; i < m_FailedRefreshes && backoff < MaxBackoffMs; i++)
+	{
+		backoff *= 2;
+	}
+	backoff = std::min(backoff, MaxBackoffMs);
+	m_RetryAtMs = nowMs + backoff;
+	return backoff;
+}
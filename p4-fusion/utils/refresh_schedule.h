@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+// Decides when an aged connection connects its standby and switches over to
+// it. Refresh points are randomly staggered so that workers don't all
+// reconnect at once, and failed standbys are retried with an exponential
+// backoff instead of on the very next command.
+class RefreshSchedule
+{
+	int m_Threshold;
+	int m_RefreshAt;
+	int m_FailedRefreshes;
+	int64_t m_RetryAtMs;
+	std::minstd_rand m_Random;
+
+public:
+	static const int64_t MinBackoffMs = 1000;
+	static const int64_t MaxBackoffMs = 60 * 1000;
+
+	explicit RefreshSchedule(unsigned seed);
+
+	// Starts over for a fresh connection that ages after `threshold` commands.
+	void Reset(int threshold);
+
+	int GetRefreshAt() const { return m_RefreshAt; }
+	int GetFailedRefreshes() const { return m_FailedRefreshes; }
+	int64_t GetRetryAtMs() const { return m_RetryAtMs; }
+
+	// Whether the standby should start connecting after `usage` commands.
+	bool ShouldConnectStandby(int usage, int64_t nowMs) const;
+	bool IsAged(int usage) const { return usage >= m_RefreshAt; }
+
+	// Returns the backoff before the next standby is connected.
+	int64_t OnRefreshFailed(int64_t nowMs);
+};
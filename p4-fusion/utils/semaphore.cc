@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include "semaphore.h"
+
+Semaphore::Semaphore(int limit)
+    : m_Limit(limit)
+    , m_Available(limit)
+{
+}
+
+void Semaphore::SetLimit(int limit)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_Available += limit - m_Limit;
+		m_Limit = limit;
+	}
+	m_CV.notify_all();
+}
+
+void Semaphore::Acquire()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_CV.wait(lock, [this]()
+	    { return m_Available > 0; });
+	m_Available--;
+}
+
+void Semaphore::Release()
+{
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_Available++;
+	}
+	m_CV.notify_one();
+}
+
+SemaphoreLock::SemaphoreLock(Semaphore& semaphore)
+    : m_Semaphore(semaphore)
+{
+	m_Semaphore.Acquire();
+}
+
+SemaphoreLock::~SemaphoreLock()
+{
+	m_Semaphore.Release();
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+
+// Counting semaphore, as C++11 does not come with one.
+class Semaphore
+{
+	std::mutex m_Mutex;
+	std::condition_variable m_CV;
+	int m_Limit;
+	int m_Available;
+
+public:
+	Semaphore(int limit);
+
+	// Changes the number of holders allowed at once.
+	void SetLimit(int limit);
+	int GetLimit() const { return m_Limit; }
+
+	void Acquire();
+	void Release();
+};
+
+// Holds a semaphore for the duration of a scope.
+class SemaphoreLock
+{
+	Semaphore& m_Semaphore;
+
+public:
+	SemaphoreLock(Semaphore& semaphore);
+	~SemaphoreLock();
+
+	SemaphoreLock(const SemaphoreLock&) = delete;
+	SemaphoreLock& operator=(const SemaphoreLock&) = delete;
+};
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#include <vector>
+#include <string>
+#include <utility>
+#include <memory>
+
+#include "common.h"
+#include "p4/strtable.h"
+#include "utils/timer.h"
+#include "commands/describe_result.h"
+#include "commands/filelog_result.h"
+
+// Measures the per-file cost of decoding the tagged output of `p4 describe`
+// and `p4 filelog` into a FileTable, replaying records shaped like the ones
+// received from a server.
+
+typedef std::vector<std::pair<std::string, std::string>> Record;
+
+static const char* Actions[] = { "edit", "add", "delete", "integrate", "branch", "move/add" };
+static const char* Types[] = { "text", "text+x", "binary+F", "ktext", "utf16" };
+
+static std::string DepotFile(const int& i)
+{
+	return "//depot/main/src/module" + std::to_string(i % 97) + "/pkg" + std::to_string(i % 13) + "/File" + std::to_string(i) + ".java";
+}
+
+// The fields of the n-th file are received in one partial dictionary.
+static std::vector<Record> RecordDescribe(const int& fileCount)
+{
+	std::vector<Record> records;
+	for (int i = 0; i < fileCount; i++)
+	{
+		const std::string index = std::to_string(i);
+		records.push_back({
+		    { "depotFile" + index, DepotFile(i) },
+		    { "action" + index, Actions[i % 6] },
+		    { "type" + index, Types[i % 5] },
+		    { "rev" + index, std::to_string(1 + i % 40) },
+		    { "fileSize" + index, std::to_string(1000 + i) },
+		    { "digest" + index, "8E0CB2B45B0C5A7C1A0CC2B2E59B8C1D" },
+		});
+	}
+	return records;
+}
+
+// One dictionary per file, with its latest revision and where it was integrated from.
+static std::vector<Record> RecordFileLog(const int& fileCount)
+{
+	std::vector<Record> records;
+	for (int i = 0; i < fileCount; i++)
+	{
+		records.push_back({
+		    { "depotFile", DepotFile(i) },
+		    { "change0", "123456" },
+		    { "action0", Actions[i % 6] },
+		    { "type0", Types[i % 5] },
+		    { "rev0", std::to_string(1 + i % 40) },
+		    { "how0,0", "copy into" },
+		    { "file0,0", "//depot/release/src/File" + std::to_string(i) + ".java" },
+		    { "erev0,0", "#" + std::to_string(1 + i % 40) },
+		    { "how0,1", "branch from" },
+		    { "file0,1", "//depot/dev/src/File" + std::to_string(i) + ".java" },
+		    { "erev0,1", "#" + std::to_string(1 + i % 7) },
+		});
+	}
+	return records;
+}
+
+static std::vector<std::unique_ptr<StrBufDict>> Replay(const std::vector<Record>& records)
+{
+	std::vector<std::unique_ptr<StrBufDict>> dicts;
+	for (const Record& record : records)
+	{
+		dicts.emplace_back(new StrBufDict());
+		for (const auto& field : record)
+		{
+			dicts.back()->SetVar(field.first.c_str(), field.second.c_str());
+		}
+	}
+	return dicts;
+}
+
+template <class T>
+static void Measure(const std::string& name, const std::vector<std::unique_ptr<StrBufDict>>& dicts, void (*decode)(T&, StrDict*))
+{
+	const int rounds = 20;
+
+	// The first round interns the paths, which is not part of the steady state.
+	{
+		T warmup;
+		for (const auto& dict : dicts)
+		{
+			decode(warmup, dict.get());
+		}
+	}
+
+	Timer timer;
+	for (int round = 0; round < rounds; round++)
+	{
+		T result;
+		for (const auto& dict : dicts)
+		{
+			decode(result, dict.get());
+		}
+	}
+	const double perFileNs = timer.GetTimeS() * 1e9 / ((double)rounds * dicts.size());
+
+	SUCCESS(name << ": " << dicts.size() << " files, " << perFileNs << " ns per file");
+}
+
+static void DecodeDescribe(DescribeResult& result, StrDict* dict)
+{
+	result.OutputStatPartial(dict);
+}
+
+static void DecodeFileLog(FileLogResult& result, StrDict* dict)
+{
+	result.OutputStat(dict);
+}
+
+int main()
+{
+	const int fileCount = 100000;
+
+	Measure<DescribeResult>("p4 describe", Replay(RecordDescribe(fileCount)), DecodeDescribe);
+	Measure<FileLogResult>("p4 filelog", Replay(RecordFileLog(fileCount)), DecodeFileLog);
+
+	return 0;
+}
@@ -9,11 +9,15 @@
 #include "tests.common.h"
 #include "tests.utils.h"
 #include "tests.git.h"
+#include "tests.filter.h"
 
 int main()
 {
 	TEST_REPORT("Utils", TestUtils());
 	TEST_REPORT("GitAPI", TestGitAPI());
+	TEST_REPORT("ConversionState", TestConversionState());
+	TEST_REPORT("CommitIndex", TestCommitIndex());
+	TEST_REPORT("PathFilter", TestPathFilter());
 
 	SUCCESS("All test cases passed");
 	return 0;
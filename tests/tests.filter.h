@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2022 Salesforce, Inc.
+ * All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ * For full license text, see the LICENSE.txt file in the repo root or https://opensource.org/licenses/BSD-3-Clause
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include "tests.common.h"
+#include "commands/file_map.h"
+#include "commands/path_filter.h"
+
+int TestPathFilter()
+{
+	TEST_START();
+
+	{
+		PathFilter filter;
+		filter.AddRule("//depot/...", PathFilter::Include);
+		filter.AddRule("//depot/main/*.bin", PathFilter::Exclude);
+		filter.AddRule("//depot/main/keep.bin", PathFilter::Include);
+		filter.AddRule("//depot/.../build/...", PathFilter::Exclude);
+
+		TEST(filter.Match("//depot/a.txt"), 0);
+		TEST(filter.Match("//depot/main/a.bin"), 1);
+		TEST(filter.Match("//depot/main/sub/a.bin"), 0);
+		TEST(filter.Match("//depot/main/keep.bin"), 2);
+		TEST(filter.Match("//depot/main/build/keep.bin"), 3);
+		TEST(filter.Match("//other/a.txt"), PathFilter::NoRule);
+		TEST(filter.Match("//depot"), PathFilter::NoRule);
+		TEST(filter.IsIncluded("//depot/main/keep.bin"), true);
+		TEST(filter.IsIncluded("//depot/main/a.bin"), false);
+		TEST(filter.IsIncluded("//other/a.txt"), false);
+	}
+
+	{
+		PathFilter filter(false);
+		filter.AddRule("//Depot/%%1/Src/...", PathFilter::Include);
+		TEST(filter.IsIncluded("//depot/main/src/a.txt"), true);
+		TEST(filter.IsIncluded("//DEPOT/MAIN/SRC/A.TXT"), true);
+		TEST(filter.IsIncluded("//depot/main/dev/src/a.txt"), false);
+	}
+
+	{
+		// The compiled view agrees with MapApi on every path.
+		const std::vector<std::vector<std::string>> views = {
+			{
+			    "//depot/... //client/...",
+			},
+			{
+			    "//depot/main/... //client/main/...",
+			    "-//depot/main/docs/... //client/main/docs/...",
+			    "+//depot/release/... //client/main/...",
+			    "//depot/main/docs/keep.md //client/main/docs/keep.md",
+			},
+			{
+			    "//depot/.../src/*.cc //client/src/%%1.cc",
+			    "-//depot/.../test/... //client/test/...",
+			    "//depot/%%1/%%2.h //client/%%1/%%2.h",
+			    "&//depot/shared/... //client/shared/...",
+			    "-//depot/*/secret* //client/secret...",
+			},
+		};
+		const std::vector<std::string> paths = {
+			"//depot/a.txt",
+			"//depot/main/a.txt",
+			"//depot/main/docs/a.md",
+			"//depot/main/docs/keep.md",
+			"//depot/main/docs/keep.md2",
+			"//depot/release/b.txt",
+			"//depot/x/src/a.cc",
+			"//depot/x/y/src/a.cc",
+			"//depot/x/src/y/a.cc",
+			"//depot/x/test/src/a.cc",
+			"//depot/x/a.h",
+			"//depot/x/y/a.h",
+			"//depot/shared/z/a.txt",
+			"//depot/x/secret.txt",
+			"//depot/x/y/secret.txt",
+			"//depot",
+			"//other/a.txt",
+		};
+
+		int disagreements = 0;
+		for (const std::vector<std::string>& view : views)
+		{
+			FileMap map;
+			map.InsertTranslationMapping(view);
+			const PathFilter filter = map.CompileLeft();
+			for (const std::string& path : paths)
+			{
+				if (filter.IsIncluded(path) != map.IsInLeft(path))
+				{
+					ERR("PathFilter and MapApi disagree on " << path);
+					disagreements++;
+				}
+			}
+		}
+		TEST(disagreements, 0);
+	}
+
+	TEST_END();
+	return TEST_EXIT_CODE();
+}
@@ -6,8 +6,15 @@
  */
 #pragma once
 
+#include <map>
+#include <fstream>
+#include <cstdio>
+
 #include "tests.common.h"
 #include "git_api.h"
+#include "conversion_state.h"
+#include "commit_index.h"
+#include "commands/change_history.h"
 
 int TestGitAPI()
 {
@@ -17,8 +24,11 @@ int TestGitAPI()
 
 	TEST(git.InitializeRepository("/tmp/test-repo"), true);
 	git.CreateIndex();
-	git.AddFileToIndex("foo.txt", { 'x', 'y', 'z' }, false);
-	git.Commit(
+	const git_oid blob = git.AddFileToIndex("foo.txt", ContentBuffer("xyz", 3), false);
+	TEST(std::string(git_oid_tostr_s(&blob)), "d66d9d758f74e0849d7e0b9a39dcf29b07179124");
+	// Other files can be committed from the same blob.
+	git.AddBlobToIndex("bar.txt", blob, true);
+	const std::string firstCL = git.Commit(
 	    "//a/b/c/...",
 	    "12345678",
 	    "test.user",
@@ -34,7 +44,7 @@ int TestGitAPI()
 	TEST(git.DetectLatestCL(), "12345678");
 
 	git.RemoveFileFromIndex("foo.txt");
-	git.Commit(
+	const std::string secondCL = git.Commit(
 	    "//a/b/c/...",
 	    "12345679",
 	    "test.user.2",
@@ -49,8 +59,292 @@ int TestGitAPI()
 	TEST(git.IsRepositoryClonedFrom("//x/y/z/..."), false);
 	TEST(git.DetectLatestCL(), "12345679");
 
+	const std::map<std::string, std::string> tips = git.GetBranchTips();
+	TEST(tips.size(), 1);
+	TEST(tips.count(git.GetHeadBranchRef()), 1);
+
+	// An older CL on another branch does not hide the latest one.
+	const std::string headBranchRef = git.GetHeadBranchRef();
+	git.SetActiveBranch("older");
+	git.Commit(
+	    "//a/b/c/...",
+	    "12345600",
+	    "test.user",
+	    "test@user",
+	    0,
+	    "Test description",
+	    30000000,
+	    "");
+	TEST(git.GetHeadBranchRef(), "refs/heads/older");
+	TEST(git.GetBranchTips().size(), 2);
+	TEST(git.DetectLatestCL(), "12345679");
+
+	// Leaves the repository as it was for the next run.
+	git.SetActiveBranch(headBranchRef.substr(std::string("refs/heads/").size()));
+	git.DeleteReference("refs/heads/older");
+	TEST(git.GetHeadBranchRef(), headBranchRef);
+	TEST(git.GetBranchTips().size(), 1);
+
+	const std::string firstCommit = git.GetFirstCommit();
+	TEST(git.SetFirstCommit(firstCommit), true);
+	TEST(git.SetFirstCommit("0123456789012345678901234567890123456789"), false);
+	TEST(git.GetFirstCommit(), firstCommit);
+
 	git.CloseIndex();
 
+	// A segment committed from a snapshot of the first CL is copied onto the
+	// first CL as the commits made one after the other.
+	GitAPI segmentGit(false);
+	segmentGit.OpenRepository("/tmp/test-repo");
+	segmentGit.CreateDetachedIndex("refs/p4-fusion/segments/1", firstCommit);
+	segmentGit.AddFileToIndex("foo.txt", ContentBuffer("xyz", 3), false);
+	segmentGit.AddBlobToIndex("bar.txt", blob, true);
+	const std::string snapshot = segmentGit.Commit(
+	    "//a/b/c/...",
+	    "12345678",
+	    "test.user",
+	    "test@user",
+	    0,
+	    "Snapshot of //a/b/c/... at CL 12345678",
+	    10000000,
+	    "");
+	segmentGit.RemoveFileFromIndex("foo.txt");
+	const std::string segmentCL = segmentGit.Commit(
+	    "//a/b/c/...",
+	    "12345679",
+	    "test.user.2",
+	    "test2@user",
+	    0,
+	    "Test description",
+	    20000000,
+	    "");
+	segmentGit.CloseIndex();
+	TEST(segmentGit.GetCommitTree(snapshot), segmentGit.GetCommitTree(firstCL));
+	TEST(segmentCL == secondCL, false);
+	TEST(segmentGit.RewriteCommit(segmentCL, firstCL), secondCL);
+	// The segment does not move the branch being converted.
+	TEST(segmentGit.GetBranchTips().size(), 1);
+
+	segmentGit.SetReference("refs/heads/rewritten", segmentCL);
+	TEST(segmentGit.GetBranchTips().size(), 2);
+	segmentGit.DeleteReference("refs/heads/rewritten");
+	segmentGit.DeleteReference("refs/heads/rewritten");
+	TEST(segmentGit.GetBranchTips().size(), 1);
+
+	// As left behind by segments which did not finish.
+	segmentGit.SetReference("refs/p4-fusion/segments/0", snapshot);
+	TEST(segmentGit.DeleteReferences("refs/p4-fusion/segments/"), 2);
+	TEST(segmentGit.DeleteReferences("refs/p4-fusion/segments/"), 0);
+	TEST(segmentGit.GetBranchTips().size(), 1);
+
+	// A baseline is committed as the latest CL up to it of any of the paths,
+	// and the conversion continues after it.
+	{
+		ChangeHistory depot;
+		depot.Add("120", "", "test.user", 12000000);
+		ChangeHistory mapped;
+		mapped.Add("150", "", "test.user.2", 15000000);
+		std::vector<ChangeHistory> latestChanges = { depot, mapped, ChangeHistory() };
+		ChangeHistory changes;
+		changes.AppendMerged(latestChanges);
+		const size_t baseline = changes.GetSize() - 1;
+		TEST(changes.GetNumber(baseline), "150");
+
+		RemoveTestDirectory("/tmp/test-baseline-repo");
+		GitAPI baselineGit(false);
+		TEST(baselineGit.InitializeRepository("/tmp/test-baseline-repo"), true);
+		baselineGit.CreateIndex();
+		baselineGit.AddFileToIndex("foo.txt", ContentBuffer("xyz", 3), false);
+		baselineGit.AddFileToIndex("bar.txt", ContentBuffer("abc", 3), false);
+		const std::string snapshot = baselineGit.Commit(
+		    "//a/b/c/...",
+		    changes.GetNumber(baseline),
+		    changes.GetUser(baseline),
+		    "test2@user",
+		    0,
+		    "Snapshot of //a/b/c/... at CL 160",
+		    changes.GetTimestamp(baseline),
+		    "");
+		baselineGit.CloseIndex();
+		TEST(baselineGit.GetCommitCL(snapshot), "150");
+		TEST(baselineGit.DetectLatestCL(), "150");
+		TEST(baselineGit.IsRepositoryClonedFrom("//a/b/c/..."), true);
+
+		// As the conversion resuming after the baseline does.
+		GitAPI resumedGit(false);
+		resumedGit.OpenRepository("/tmp/test-baseline-repo");
+		resumedGit.CreateIndex();
+		TEST(resumedGit.GetCommitTree(resumedGit.GetBranchTips().at(resumedGit.GetHeadBranchRef())), resumedGit.GetCommitTree(snapshot));
+		resumedGit.RemoveFileFromIndex("bar.txt");
+		resumedGit.Commit(
+		    "//a/b/c/...",
+		    "161",
+		    "test.user",
+		    "test@user",
+		    0,
+		    "Test description",
+		    16100000,
+		    "");
+		resumedGit.CloseIndex();
+		TEST(resumedGit.DetectLatestCL(), "161");
+		TEST(resumedGit.GetBranchTips().size(), 1);
+	}
+	RemoveTestDirectory("/tmp/test-baseline-repo");
+
+	TEST_END();
+	return TEST_EXIT_CODE();
+}
+
+int TestConversionState()
+{
+	TEST_START();
+
+	const std::string path = ConversionState::GetPath("/tmp/test-repo");
+	TEST(path, "/tmp/test-repo/p4-fusion-state");
+
+	ConversionState state;
+	state.depotPath = "//a/b c/...";
+	state.lastCL = "12345679";
+	state.nextCL = "12345680";
+	state.rootCommit = "0123456789012345678901234567890123456789";
+	state.branchTips["refs/heads/main"] = "1111111111111111111111111111111111111111";
+	state.branchTips["refs/heads/release/1.0"] = "2222222222222222222222222222222222222222";
+	TEST(state.Save(path, true), true);
+
+	ConversionState loaded;
+	TEST(loaded.Load(path), true);
+	TEST(loaded.depotPath, state.depotPath);
+	TEST(loaded.lastCL, state.lastCL);
+	TEST(loaded.nextCL, state.nextCL);
+	TEST(loaded.rootCommit, state.rootCommit);
+	TEST(loaded.branchTips == state.branchTips, true);
+
+	// A newer save replaces the whole state.
+	state.lastCL = "12345680";
+	state.nextCL = "";
+	state.branchTips.erase("refs/heads/release/1.0");
+	TEST(state.Save(path, false), true);
+	TEST(loaded.Load(path), true);
+	TEST(loaded.lastCL, "12345680");
+	TEST(loaded.nextCL, "");
+	TEST(loaded.branchTips.size(), 1);
+
+	// Incomplete files are not trusted, and leave the state untouched.
+	{
+		std::ofstream truncated(path, std::ios::trunc);
+		truncated << "p4-fusion-state 1\ndepot-path //a/...\nlast-cl 1\n";
+	}
+	TEST(loaded.Load(path), false);
+	TEST(loaded.lastCL, "12345680");
+	TEST(loaded.Load("/tmp/test-repo/missing-state"), false);
+
+	TEST_END();
+	return TEST_EXIT_CODE();
+}
+
+int TestCommitIndex()
+{
+	TEST_START();
+
+	const std::string repo = "/tmp/test-repo";
+	std::remove(CommitIndex::GetCommitsPath(repo).c_str());
+	std::remove(CommitIndex::GetBranchesPath(repo).c_str());
+	std::remove(CommitIndex::GetOIDsPath(repo).c_str());
+
+	const std::string oidA = "1111111111111111111111111111111111111111";
+	const std::string oidB = "2222222222222222222222222222222222222222";
+	const std::string oidC = "abcdefabcdefabcdefabcdefabcdefabcdefabcd";
+	const std::string oidD = "0000000000000000000000000000000000000001";
+
+	{
+		CommitIndex index;
+		TEST(index.Open(repo, true, false), true);
+		TEST(index.IsEmpty(), true);
+		TEST(index.GetLastCL(), -1);
+		TEST(index.Append("100", "refs/heads/main", oidA), true);
+		TEST(index.Append("105", "refs/heads/main", oidB), true);
+		TEST(index.Append("105", "refs/heads/dev", oidC), true);
+		// Out of CL order, or not an OID
+		TEST(index.Append("104", "refs/heads/main", oidD), false);
+		TEST(index.Append("106", "refs/heads/main", "xyz"), false);
+		TEST(index.GetSize(), 3);
+		TEST(index.GetLastCL(), 105);
+
+		TEST(index.FindCommit("105", "refs/heads/dev"), oidC);
+		TEST(index.FindCommits("105").size(), 2);
+		TEST(index.FindCommits("101").size(), 0);
+
+		CommitIndex::Commit commit;
+		TEST(index.FindChange(oidC, commit), true);
+		TEST(commit.cl, "105");
+		TEST(commit.branch, "refs/heads/dev");
+	}
+
+	// Reopened from the mapped files, with the OIDs sorted on the last close.
+	{
+		CommitIndex index;
+		TEST(index.Open(repo, true, false), true);
+		TEST(index.GetSize(), 3);
+		TEST(index.FindCommit("100", "refs/heads/main"), oidA);
+		TEST(index.FindCommit("100", "refs/heads/dev"), "");
+
+		CommitIndex::Commit commit;
+		TEST(index.FindChange(oidA, commit), true);
+		TEST(commit.cl, "100");
+		TEST(index.FindChange(oidD, commit), false);
+
+		TEST(index.Append("110", "refs/heads/release", oidD), true);
+		TEST(index.FindChange(oidD, commit), true);
+		TEST(commit.branch, "refs/heads/release");
+	}
+
+	// A record cut short by a crash is dropped.
+	{
+		std::ofstream commits(CommitIndex::GetCommitsPath(repo), std::ios::app | std::ios::binary);
+		commits << "partial";
+	}
+	{
+		CommitIndex index;
+		TEST(index.Open(repo, false, false), true);
+		TEST(index.GetSize(), 4);
+		TEST(index.GetLastCL(), 110);
+		TEST(index.Append("111", "refs/heads/main", oidA), false);
+
+		CommitIndex::Commit commit;
+		TEST(index.FindChange(oidB, commit), true);
+		TEST(commit.cl, "105");
+	}
+
+	// The sorted OIDs are refreshed while the index stays open.
+	{
+		CommitIndex index;
+		TEST(index.Open(repo, true, false), true);
+		const size_t reopenedSize = index.GetSize();
+		std::string firstOID;
+		size_t appended = 0;
+		for (size_t i = 0; i < CommitIndex::OIDsRefreshCount; i++)
+		{
+			char oid[41];
+			snprintf(oid, sizeof(oid), "%040zx", i);
+			firstOID = firstOID.empty() ? oid : firstOID;
+			appended += index.Append(std::to_string(200 + i), "refs/heads/main", oid);
+		}
+		TEST(appended, CommitIndex::OIDsRefreshCount);
+		TEST(index.GetSize(), reopenedSize + CommitIndex::OIDsRefreshCount);
+
+		std::ifstream oids(CommitIndex::GetOIDsPath(repo), std::ios::binary | std::ios::ate);
+		TEST((size_t)oids.tellg(), index.GetSize() * 24);
+
+		CommitIndex::Commit commit;
+		TEST(index.FindChange(firstOID, commit), true);
+		TEST(commit.cl, "200");
+		TEST(index.FindCommit("110", "refs/heads/release"), oidD);
+		const std::string oidE = "ffffffffffffffffffffffffffffffffffffffff";
+		TEST(index.Append("5000", "refs/heads/main", oidE), true);
+		TEST(index.FindChange(oidE, commit), true);
+		TEST(commit.cl, "5000");
+	}
+
 	TEST_END();
 	return TEST_EXIT_CODE();
 }
@@ -7,10 +7,40 @@
 #pragma once
 
 #include <array>
+#include <fstream>
+#include <sstream>
 #include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <cstdio>
 #include "tests.common.h"
 #include "utils/std_helpers.h"
 #include "utils/time_helpers.h"
+#include "utils/latency_tracker.h"
+#include "utils/semaphore.h"
+#include "utils/refresh_schedule.h"
+#include "utils/content_buffer.h"
+#include "utils/buffer_pool.h"
+#include "utils/download_cache.h"
+#include "metadata_cache.h"
+#include "blob_table.h"
+#include "manifest.h"
+#include "commands/file_table.h"
+#include "commands/tag_keys.h"
+#include "utils/path_interner.h"
+#include "commands/change_history.h"
+#include "branch_set.h"
+
+#include <ftw.h>
+
+// Removes a directory the tests created, with everything in it.
+static void RemoveTestDirectory(const std::string& path)
+{
+	nftw(path.c_str(), [](const char* entry, const struct stat*, int, struct FTW*) -> int
+	    { return std::remove(entry); },
+	    16, FTW_DEPTH | FTW_PHYS);
+}
 
 int TestUtils()
 {
@@ -111,6 +141,597 @@ int TestUtils()
 		TEST(actual, expected);
 	}
 
+	{
+		// At most the limit of holders at once, while many threads contend.
+		Semaphore semaphore(3);
+		TEST(semaphore.GetLimit(), 3);
+		std::mutex mutex;
+		int holders = 0;
+		int maxHolders = 0;
+		int acquired = 0;
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 16; t++)
+		{
+			threads.emplace_back([&]()
+			    {
+				    for (int i = 0; i < 50; i++)
+				    {
+					    SemaphoreLock lock(semaphore);
+					    {
+						    std::lock_guard<std::mutex> counts(mutex);
+						    holders++;
+						    acquired++;
+						    maxHolders = std::max(maxHolders, holders);
+					    }
+					    std::this_thread::yield();
+					    std::lock_guard<std::mutex> counts(mutex);
+					    holders--;
+				    }
+			    });
+		}
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+		TEST(acquired, 16 * 50);
+		TEST(maxHolders > 0 && maxHolders <= 3, true);
+
+		// Raising the limit lets more holders in at once, lowering it lets
+		// the current holders finish.
+		semaphore.SetLimit(5);
+		for (int i = 0; i < 5; i++)
+		{
+			semaphore.Acquire();
+		}
+		semaphore.SetLimit(1);
+		for (int i = 0; i < 5; i++)
+		{
+			semaphore.Release();
+		}
+		TEST(semaphore.GetLimit(), 1);
+		SemaphoreLock single(semaphore);
+	}
+
+	{
+		TagKeys keys("how0,");
+		const StrPtr& first = keys.Get(0);
+		TEST(std::string(first.Text(), first.Length()), "how0,0");
+		TEST(std::string(keys.Get(12).Text()), "how0,12");
+		TEST(&keys.Get(12) == &keys.Get(12), true);
+		// Past the cached names, the key is formatted for the call.
+		const StrPtr& past = keys.Get(TagKeys::CachedCount + 7);
+		TEST(std::string(past.Text(), past.Length()), "how0," + std::to_string(TagKeys::CachedCount + 7));
+		TEST(std::string(keys.Get(1000000).Text()), "how0,1000000");
+		TEST(std::string(first.Text()), "how0,0");
+	}
+
+	{
+		RefreshSchedule schedule(42);
+		schedule.Reset(100);
+		TEST(schedule.GetRefreshAt() > 100 && schedule.GetRefreshAt() <= 126, true);
+		TEST(schedule.ShouldConnectStandby(0, 0), false);
+		TEST(schedule.ShouldConnectStandby(schedule.GetRefreshAt() - 11, 0), false);
+		TEST(schedule.ShouldConnectStandby(schedule.GetRefreshAt() - 10, 0), true);
+		TEST(schedule.IsAged(schedule.GetRefreshAt() - 1), false);
+		TEST(schedule.IsAged(schedule.GetRefreshAt()), true);
+
+		// A failed standby is not retried before its backoff has passed.
+		const int usage = schedule.GetRefreshAt();
+		TEST(schedule.OnRefreshFailed(5000), RefreshSchedule::MinBackoffMs);
+		TEST(schedule.ShouldConnectStandby(usage, 5000), false);
+		TEST(schedule.ShouldConnectStandby(usage + 50, 5999), false);
+		TEST(schedule.ShouldConnectStandby(usage, 6000), true);
+
+		// Every further failure doubles the backoff, up to the maximum.
+		TEST(schedule.OnRefreshFailed(6000), 2 * RefreshSchedule::MinBackoffMs);
+		TEST(schedule.ShouldConnectStandby(usage, 7999), false);
+		TEST(schedule.ShouldConnectStandby(usage, 8000), true);
+		TEST(schedule.OnRefreshFailed(8000), 4 * RefreshSchedule::MinBackoffMs);
+		for (int i = 0; i < 10; i++)
+		{
+			schedule.OnRefreshFailed(8000);
+		}
+		TEST(schedule.GetFailedRefreshes(), 13);
+		TEST(schedule.GetRetryAtMs(), 8000 + RefreshSchedule::MaxBackoffMs);
+
+		// A successful refresh starts a new schedule without any backoff.
+		schedule.Reset(100);
+		TEST(schedule.GetFailedRefreshes(), 0);
+		TEST(schedule.ShouldConnectStandby(schedule.GetRefreshAt() - 10, 0), true);
+
+		schedule.Reset(1);
+		TEST(schedule.GetRefreshAt(), 2);
+		TEST(schedule.ShouldConnectStandby(1, 0), true);
+	}
+
+	{
+		LatencyTracker latency;
+		TEST(latency.GetPercentile(99.0), 0);
+
+		for (int i = 0; i < 99; i++)
+		{
+			latency.Record(100);
+		}
+		latency.Record(60 * 1000);
+		TEST(latency.GetCount(), 100);
+		TEST(latency.GetPercentile(50.0) >= 100, true);
+		TEST(latency.GetPercentile(50.0) < 120, true);
+		TEST(latency.GetPercentile(99.0) < 120, true);
+		TEST(latency.GetPercentile(100.0) >= 60 * 1000, true);
+	}
+
+	{
+		const std::string chunk(1000, 'x');
+		const long long copiedBefore = ContentBuffer::CopiedBytes;
+
+		ContentBuffer downloaded;
+		downloaded.Reserve(4 * chunk.size());
+		for (int i = 0; i < 4; i++)
+		{
+			downloaded.Append(chunk.data(), chunk.size());
+		}
+		const char* bytes = downloaded.GetData();
+
+		FileTable files;
+		const size_t row = files.AddFile("//a/b/c.txt", "1", "add", "text");
+		files.SetContents(row, std::move(downloaded));
+
+		// Every byte is copied once on its way in, and never again.
+		TEST(files.GetContents(row).GetData() == bytes, true);
+		TEST(files.GetContents(row).GetSize(), 4 * chunk.size());
+		TEST(ContentBuffer::CopiedBytes - copiedBefore, 4 * chunk.size());
+
+		ContentBuffer shared = files.GetContents(row);
+		files.ClearContents(row);
+		TEST(shared.GetData() == bytes, true);
+	}
+
+	{
+		FileTable files;
+		files.AddFile("//a/b/c.txt", "3", "edit", "text");
+		files.AddFile("//a/b/d.bin", "1", "add", "binary+x");
+		files.AddFile("//a/b/e.txt", "2", "integrate", "text+x");
+		files.AddFile("//a/b/f.txt", "7", "move/delete", "text");
+		files.SetFromDepotFile(2, "//a/x/e.txt", "#5");
+		files.SetRelativePath(2, PathInterner::GetSingleton()->Intern("b/e.txt"));
+		TEST(files.GetSize(), 4);
+
+		// Keep d.bin and e.txt, swapped around.
+		files.Reorder({ 2, 1 });
+		TEST(files.GetSize(), 2);
+		TEST(files.GetDepotFile(0), "//a/b/e.txt");
+		TEST(files.GetDepotFileRevision(0), "//a/b/e.txt#2");
+		TEST(files.IsIntegrated(0), true);
+		TEST(files.IsExecutable(0), true);
+		TEST(files.IsBinary(0), false);
+		TEST(files.GetFromDepotFile(0), "//a/x/e.txt");
+		TEST(files.GetFromRevision(0), 5);
+		TEST(files.GetRelativePath(0), "b/e.txt");
+		TEST(files.GetDepotFile(1), "//a/b/d.bin");
+		TEST(files.IsBinary(1), true);
+		TEST(files.HasFromDepotFile(1), false);
+		TEST(files.GetRelativePath(1), "");
+
+		files.SetFakeIntegrationDeleteAction(0);
+		TEST(files.IsDeleted(0), true);
+		TEST(files.IsIntegrated(0), false);
+
+		const std::string digest = "0123456789ABCDEF0123456789ABCDEF";
+		files.SetDigest(1, digest.data(), digest.size());
+		TEST(files.GetDigest(1), digest);
+		files.SetDigest(0, "0123456789abcdef0123456789abcdeX", 32);
+		TEST(files.HasDigest(0), false);
+		TEST(files.GetDigest(0), "");
+		files.Reorder({ 1 });
+		TEST(files.GetDigest(0), digest);
+	}
+
+	{
+		// Every known action lands in its own slot of the hash table.
+		const std::vector<std::pair<std::string, FileAction>> actions = {
+			{ "add", FileAction::FileAdd },
+			{ "edit", FileEdit },
+			{ "delete", FileAction::FileDelete },
+			{ "branch", FileAction::FileBranch },
+			{ "move/add", FileAction::FileMoveAdd },
+			{ "move/delete", FileAction::FileMoveDelete },
+			{ "integrate", FileAction::FileIntegrate },
+			{ "import", FileAction::FileImport },
+			{ "purge", FileAction::FilePurge },
+			{ "archive", FileAction::FileArchive },
+			{ FAKE_INTEGRATION_DELETE_ACTION_NAME, FileAction::FileIntegrateDelete },
+		};
+		int parsedActions = 0;
+		for (const auto& action : actions)
+		{
+			parsedActions += FileTable::ParseAction(action.first) == action.second;
+		}
+		TEST(parsedActions, actions.size());
+
+		// Unknown names sharing a slot with a known one fall back to guessing.
+		TEST(FileTable::ParseAction("adds"), FileEdit);
+		TEST(FileTable::ParseAction("obliterate/delete"), FileAction::FileDelete);
+		TEST(FileTable::ParseAction("move/copy"), FileAction::FileMoveAdd);
+		TEST(FileTable::ParseAction(""), FileEdit);
+
+		TEST(FileTable::ParseTypeFlags("text"), 0);
+		TEST(FileTable::ParseTypeFlags("text+x"), FileTable::TypeExecutable);
+		TEST(FileTable::ParseTypeFlags("text+kx"), FileTable::TypeTranslated);
+		TEST(FileTable::ParseTypeFlags("text+ko"), FileTable::TypeTranslated);
+		TEST(FileTable::ParseTypeFlags("ktext"), FileTable::TypeTranslated);
+		TEST(FileTable::ParseTypeFlags("utf16"), FileTable::TypeTranslated);
+		TEST(FileTable::ParseTypeFlags("utf8"), 0);
+		TEST(FileTable::ParseTypeFlags("binary+F"), FileTable::TypeBinary);
+		TEST(FileTable::ParseTypeFlags("binary+x"), FileTable::TypeBinary | FileTable::TypeExecutable);
+		TEST(FileTable::ParseTypeFlags("ubinary"), FileTable::TypeBinary);
+		TEST(FileTable::ParseTypeFlags("newbinary+l"), FileTable::TypeBinary);
+		TEST(FileTable::ParseTypeFlags("xtext"), 0);
+		TEST(FileTable::ParseTypeFlags("+x"), FileTable::TypeExecutable);
+		TEST(FileTable::ParseTypeFlags("text+"), 0);
+	}
+
+	{
+		// Large enough to rather not live on the stack.
+		std::unique_ptr<PathInterner> interner(new PathInterner());
+		PathInterner& paths = *interner;
+		const PathInterner::ID file = paths.Intern("//depot/main/src/a.txt");
+		const PathInterner::ID sibling = paths.Intern("//depot/main/src/b.txt");
+		const PathInterner::ID main = paths.Intern("//depot/main");
+		const PathInterner::ID release = paths.Intern("//depot/release");
+
+		TEST(paths.Intern("//depot/main/src/a.txt"), file);
+		TEST(paths.GetPath(file), "//depot/main/src/a.txt");
+		TEST(paths.GetName(file), "a.txt");
+		TEST(paths.GetParent(file), paths.GetParent(sibling));
+		TEST(paths.GetPath(paths.GetParent(file)), "//depot/main/src");
+		TEST(paths.GetPath(paths.Intern("relative/path")), "relative/path");
+		TEST(paths.Intern(""), PathInterner::Root);
+
+		// Written into a buffer reused for several paths.
+		std::string buffer = "a longer path written before";
+		paths.GetPath(file, buffer);
+		TEST(buffer, "//depot/main/src/a.txt");
+		paths.GetPath(main, buffer);
+		TEST(buffer, "//depot/main");
+		paths.GetPath(PathInterner::Root, buffer);
+		TEST(buffer, "");
+
+		TEST(paths.HasComponent(file, "src"), true);
+		TEST(paths.HasComponent(file, "a.txt"), true);
+		TEST(paths.HasComponent(file, "release"), false);
+		TEST(paths.HasComponent(paths.Intern("//depot/main/.git/config"), ".git"), true);
+		TEST(paths.HasComponent(paths.Intern("//depot/main/sub/.git"), ".git"), true);
+		TEST(paths.HasComponent(paths.Intern("//depot/main/a.git"), ".git"), false);
+
+		TEST(paths.IsUnder(file, main), true);
+		TEST(paths.IsUnder(file, release), false);
+		TEST(paths.IsUnder(main, main), false);
+		TEST(paths.IsUnder(paths.Intern("//depot/mainline/a.txt"), main), false);
+
+		const PathInterner::ID relative = paths.Rebase(file, main);
+		TEST(paths.GetPath(relative), "src/a.txt");
+		TEST(relative, paths.Intern("src/a.txt"));
+		TEST(paths.GetPath(paths.Rebase(file, main, release)), "//depot/release/src/a.txt");
+	}
+
+	{
+		// The deepest branch wins, in whichever order the branches are listed.
+		const std::vector<Branch> branches = { Branch("tree", "tree"), Branch("tree/sub", "tree-sub"), Branch("other", "other") };
+		const std::vector<Branch> reversed = { Branch("other", "other"), Branch("tree/sub", "tree-sub"), Branch("tree", "tree") };
+		const BranchTrie trie(branches);
+		const BranchTrie reversedTrie(reversed);
+		PathInterner* paths = PathInterner::GetSingleton();
+
+		TEST(trie.Find(paths->Intern("tree/sub/a.txt")), 1);
+		TEST(reversedTrie.Find(paths->Intern("tree/sub/a.txt")), 1);
+		TEST(trie.Find(paths->Intern("tree/subway/a.txt")), 0);
+		TEST(reversedTrie.Find(paths->Intern("tree/b/c.txt")), 2);
+		TEST(trie.Find(paths->Intern("tree/sub")), 0);
+		TEST(trie.Find(paths->Intern("tree")), -1);
+		TEST(trie.Find(paths->Intern("elsewhere/a.txt")), -1);
+	}
+
+	{
+		// Sharding the files of a large changelist doesn't change its groups.
+		std::vector<std::string> view = { "//depot/... //client/...", "-//depot/main/skip/... //client/main/skip/..." };
+		BranchSet branchSet(view, "//depot/...", { "main", "dev", "release" }, {}, {}, false);
+		const char* branches[] = { "main", "dev", "release", "other" };
+		auto createTable = [&branches]()
+		{
+			FileTable files;
+			for (int i = 0; i < 3 * (int)BranchSet::ParallelParseMinFiles; i++)
+			{
+				const std::string branch = branches[i % 4];
+				const std::string directory = i % 7 == 0 ? "/skip/" : "/src/";
+				const size_t row = files.AddFile("//depot/" + branch + directory + std::to_string(i) + ".txt", "1", i % 3 == 0 ? "integrate" : "edit", i % 11 == 0 ? "binary" : "text");
+				if (i % 3 == 0)
+				{
+					files.SetFromDepotFile(row, "//depot/" + std::string(branches[(i / 3) % 4]) + "/src/" + std::to_string(i) + ".txt", "#1");
+				}
+			}
+			return files;
+		};
+
+		std::unique_ptr<ChangedFileGroups> serial = branchSet.ParseAffectedFiles(createTable());
+
+		std::mutex threadsMutex;
+		std::vector<std::thread> threads;
+		std::unique_ptr<ChangedFileGroups> sharded = branchSet.ParseAffectedFiles(createTable(), [&threads, &threadsMutex](const std::function<void()>& job)
+		    {
+			    std::lock_guard<std::mutex> lock(threadsMutex);
+			    threads.push_back(std::thread(job));
+		    });
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+
+		TEST(threads.size() > 1, true);
+		TEST(sharded->totalFileCount, serial->totalFileCount);
+		TEST(sharded->branchedFileGroups.size(), serial->branchedFileGroups.size());
+		int mismatches = 0;
+		for (size_t i = 0; i < serial->branchedFileGroups.size() && i < sharded->branchedFileGroups.size(); i++)
+		{
+			const BranchedFileGroup& expected = serial->branchedFileGroups[i];
+			const BranchedFileGroup& actual = sharded->branchedFileGroups[i];
+			mismatches += expected.sourceBranch != actual.sourceBranch || expected.targetBranch != actual.targetBranch || expected.begin != actual.begin || expected.end != actual.end;
+		}
+		for (int row = 0; row < serial->totalFileCount && row < sharded->totalFileCount; row++)
+		{
+			mismatches += serial->files.GetDepotFileID(row) != sharded->files.GetDepotFileID(row) || serial->files.GetRelativePathID(row) != sharded->files.GetRelativePathID(row);
+		}
+		TEST(mismatches, 0);
+	}
+
+	{
+		const std::string chunk(1000, 'x');
+		const long long copiedBefore = ContentBuffer::CopiedBytes;
+
+		// Without a size hint, growing the buffer moves what was already appended.
+		ContentBuffer downloaded;
+		downloaded.Append(chunk.data(), chunk.size());
+		downloaded.Append(chunk.data(), chunk.size());
+		TEST(ContentBuffer::CopiedBytes - copiedBefore > 2 * chunk.size(), true);
+	}
+
+	{
+		BufferPool* pool = BufferPool::GetSingleton();
+
+		size_t capacity = 0;
+		char* block = pool->Allocate(3000, capacity);
+		TEST(capacity, 4096);
+		pool->Free(block, capacity);
+		const long long hitsBefore = pool->GetHits();
+
+		// Same size class, served from the cache of this thread.
+		size_t reusedCapacity = 0;
+		char* reused = pool->Allocate(4000, reusedCapacity);
+		TEST(reused == block, true);
+		TEST(reusedCapacity, 4096);
+		TEST(pool->GetHits() - hitsBefore, 1);
+		pool->Free(reused, reusedCapacity);
+
+		const long long mappedBefore = pool->GetMappedAllocations();
+		const long long inUseBefore = pool->GetBytesInUse();
+		size_t largeCapacity = 0;
+		char* large = pool->Allocate(((size_t)1 << BufferPool::MaxClassShift) + 1, largeCapacity);
+		TEST(pool->GetMappedAllocations() - mappedBefore, 1);
+		TEST(pool->GetHighWaterBytes() >= inUseBefore + (long long)largeCapacity, true);
+		pool->Free(large, largeCapacity);
+		TEST(pool->GetBytesInUse(), inUseBefore);
+	}
+
+	{
+		ChangeHistory history;
+		history.Add("12", "second", "alice", 200);
+		history.Add("7", "first", "bob", 100);
+		ChangeHistory other;
+		other.Add("30", "third", "alice", 300);
+		other.Add("9", "tied", "bob", 200);
+		history.Append(other);
+		history.Sort();
+		TEST(history.GetSize(), 4);
+		TEST(history.GetNumber(0), "7");
+		TEST(history.GetDescription(0), "first");
+		TEST(history.GetUser(0), "bob");
+		TEST(history.GetNumber(1), "12");
+		TEST(history.GetNumber(2), "9");
+		TEST(history.GetDescription(3), "third");
+		TEST(history.GetUser(3), "alice");
+		TEST(history.GetTimestamp(3), 300);
+		history.Truncate(2);
+		TEST(history.GetSize(), 2);
+		history.Truncate(5);
+		TEST(history.GetSize(), 2);
+	}
+
+	{
+		ChangeHistory depot;
+		depot.Add("3", "a", "alice", 30);
+		depot.Add("5", "b", "bob", 50);
+		depot.Add("8", "c", "alice", 80);
+		ChangeHistory mapped;
+		mapped.Add("4", "d", "carol", 40);
+		mapped.Add("5", "b", "bob", 50);
+		std::vector<ChangeHistory> sources(2);
+		sources[0] = depot;
+		sources[1] = mapped;
+
+		ChangeHistory merged;
+		merged.AppendMerged(sources);
+		merged.AppendMerged(std::vector<ChangeHistory>(1));
+		TEST(merged.GetSize(), 4);
+		TEST(merged.GetNumber(0), "3");
+		TEST(merged.GetNumber(1), "4");
+		TEST(merged.GetUser(1), "carol");
+		TEST(merged.GetNumber(2), "5");
+		TEST(merged.GetNumber(3), "8");
+		TEST(merged.GetTimestamp(3), 80);
+		TEST(merged.GetDescription(3), "");
+	}
+
+	{
+		char directory[] = "/tmp/test-download-cache-XXXXXX";
+		TEST(mkdtemp(directory) != nullptr, true);
+		const std::string key = DownloadCache::GetKey("ssl:perforce:1666", "//a/b/c.txt#3", "0123456789ABCDEF0123456789ABCDEF");
+		TEST(DownloadCache::GetKey("ssl:perforce:1666", "//a/b/c.txt#3", ""), "");
+
+		DownloadCache* cache = DownloadCache::GetSingleton();
+		TEST(cache->Initialize(directory, 1024), true);
+		TEST(cache->IsEnabled(), true);
+
+		ContentBuffer contents;
+		TEST(cache->Get(key, contents), false);
+		cache->Put(key, ContentBuffer("abc\n", 4));
+		TEST(cache->Get(key, contents), true);
+		TEST(std::string(contents.GetData(), contents.GetSize()), "abc\n");
+		TEST(cache->Get(DownloadCache::GetKey("ssl:perforce:1666", "//a/b/c.txt#4", "0123456789ABCDEF0123456789ABCDEF"), contents), false);
+
+		// Entries larger than the whole cache are not kept.
+		cache->Put(DownloadCache::GetKey("ssl:perforce:1666", "//a/b/large.bin#1", "0123456789ABCDEF0123456789ABCDEF"), ContentBuffer(std::string(2048, 'x').data(), 2048));
+
+		// Filling the cache evicts the least recently used entries.
+		for (int i = 0; i < 10; i++)
+		{
+			cache->Put(DownloadCache::GetKey("ssl:perforce:1666", "//a/b/d.txt#" + std::to_string(i), "0123456789ABCDEF0123456789ABCDEF"), ContentBuffer(std::string(200, 'y').data(), 200));
+		}
+		cache->WaitForEviction();
+		int cached = 0;
+		for (int i = 0; i < 10; i++)
+		{
+			cached += cache->Get(DownloadCache::GetKey("ssl:perforce:1666", "//a/b/d.txt#" + std::to_string(i), "0123456789ABCDEF0123456789ABCDEF"), contents);
+		}
+		TEST(cached > 0 && cached < 10, true);
+
+		TEST(cache->Initialize("", 0), true);
+		RemoveTestDirectory(directory);
+	}
+
+	{
+		char directory[] = "/tmp/test-metadata-cache-XXXXXX";
+		TEST(mkdtemp(directory) != nullptr, true);
+		const std::string path = std::string(directory) + "/metadata";
+
+		MetadataCache* cache = MetadataCache::GetSingleton();
+		TEST(cache->Initialize(path, "ssl:perforce:1666"), true);
+		TEST(cache->IsEnabled(), true);
+
+		FileTable files;
+		files.AddFile("//a/b/c.txt", "3", "edit", "text");
+		files.AddFile("//a/b/d.bin", "1", "integrate", "binary+x");
+		files.SetFromDepotFile(1, "//a/x/d.bin", "#5");
+		files.SetDigest(1, "0123456789ABCDEF0123456789ABCDEF", 32);
+
+		std::string description;
+		FileTable cached;
+		TEST(cache->Get("42", MetadataCache::Describe, description, cached), false);
+		cache->Put("42", MetadataCache::Describe, "Some change\n", files);
+		cache->Put("43", MetadataCache::FileLog, "Another change\n", files);
+
+		// Records appended by this process are found on the next open.
+		TEST(cache->Initialize(path, "ssl:perforce:1666"), true);
+		TEST(cache->Get("42", MetadataCache::FileLog, description, cached), false);
+		TEST(cache->Get("42", MetadataCache::Describe, description, cached), true);
+		TEST(description, "Some change\n");
+		TEST(cached.GetSize(), 2);
+		TEST(cached.GetDepotFile(0), "//a/b/c.txt");
+		TEST(cached.GetRevision(0), 3);
+		TEST(cached.GetAction(0), FileEdit);
+		TEST(cached.HasDigest(0), false);
+		TEST(cached.IsBinary(1), true);
+		TEST(cached.IsExecutable(1), true);
+		TEST(cached.GetFromDepotFile(1), "//a/x/d.bin");
+		TEST(cached.GetFromRevision(1), 5);
+		TEST(cached.GetDigest(1), "0123456789ABCDEF0123456789ABCDEF");
+
+		// A record cut short is dropped.
+		std::ofstream(path, std::ios::app) << "partial";
+		TEST(cache->Initialize(path, "ssl:perforce:1666"), true);
+		FileTable cachedFileLog;
+		TEST(cache->Get("43", MetadataCache::FileLog, description, cachedFileLog), true);
+		TEST(description, "Another change\n");
+
+		// The cache is tied to the server it was filled from.
+		TEST(cache->Initialize(path, "ssl:other:1666"), false);
+		TEST(cache->IsEnabled(), false);
+		TEST(cache->Initialize("", ""), true);
+		RemoveTestDirectory(directory);
+	}
+
+	{
+		TEST(BlobTable::ComputeDigest("abc", 3).bytes[0], 0x90);
+		TEST(BlobTable::ComputeDigest("abc", 3).bytes[15], 0x72);
+
+		FileTable files;
+		const char* digest = "900150983CD24FB0D6963F7D28E17F72"; // "abc"
+		for (const char* type : { "text", "text", "text", "text+k", "text" })
+		{
+			const size_t row = files.AddFile("//a/b/c" + std::to_string(files.GetSize()) + ".txt", "1", "add", type);
+			files.SetDigest(row, digest, 32);
+			files.SetFileSize(row, 3);
+		}
+		files.SetFileSize(4, 4);
+		files.SetContents(0, ContentBuffer("abc", 3));
+		files.SetContents(1, ContentBuffer("abd", 3));
+
+		BlobTable table;
+		BlobTable* blobs = &table;
+		blobs->Initialize(false, true);
+		TEST(blobs->Claim(files, 0, "10"), false);
+		TEST(blobs->Claim(files, 1, "11"), false);
+
+		blobs->Initialize(true, true);
+		TEST(blobs->Claim(files, 0, "12"), false);
+		// Only an earlier changelist's claim is reused.
+		TEST(blobs->Claim(files, 1, "12"), false);
+		TEST(blobs->Claim(files, 1, "10"), false);
+		TEST(blobs->Claim(files, 2, "11"), true);
+		// Neither keyword expanded revisions nor other sizes share the contents.
+		TEST(blobs->Claim(files, 3, "13"), false);
+		TEST(blobs->Claim(files, 4, "13"), false);
+
+		git_oid blob = {};
+		blob.id[0] = 0xab;
+		git_oid found = {};
+		TEST(blobs->GetBlob(files, 2, found), false);
+		TEST(blobs->Verify(files, 0), true);
+		blobs->SetBlob(files, 0, blob);
+		TEST(blobs->GetBlob(files, 2, found), true);
+		TEST(found.id[0], 0xab);
+		TEST(blobs->Claim(files, 2, "14"), true);
+
+		// Mismatching contents are not committed for other revisions.
+		TEST(blobs->Verify(files, 1), false);
+		TEST(blobs->GetBlob(files, 2, found), false);
+		TEST(blobs->Claim(files, 2, "15"), false);
+
+		blobs->Initialize(false, false);
+	}
+
+	{
+		std::istringstream input("# Converted nightly\n"
+		                         "//depot/a/... repos/a\n"
+		                         "\n"
+		                         "  //depot/b/...\trepos/b main release/1.0:release\n");
+		Manifest manifest;
+		TEST(manifest.Parse(input, "manifest"), true);
+		TEST(manifest.jobs.size(), 2);
+		TEST(manifest.jobs[0].depotPath, "//depot/a/...");
+		TEST(manifest.jobs[0].srcPath, "repos/a");
+		TEST(manifest.jobs[0].branches.size(), 0);
+		TEST(manifest.jobs[1].depotPath, "//depot/b/...");
+		TEST(manifest.jobs[1].srcPath, "repos/b");
+		TEST(manifest.jobs[1].branches.size(), 2);
+		TEST(manifest.jobs[1].branches[1], "release/1.0:release");
+
+		// Lines without a repository, or sharing one, are rejected.
+		std::istringstream missingSrc("//depot/a/... repos/a\n//depot/b/...\n");
+		TEST(manifest.Parse(missingSrc, "manifest"), false);
+		std::istringstream sharedSrc("//depot/a/... repos/a\n//depot/b/... repos/a\n");
+		TEST(manifest.Parse(sharedSrc, "manifest"), false);
+		TEST(manifest.jobs.size(), 2);
+	}
+
 	TEST_END();
 	return TEST_EXIT_CODE();
 }